@@ -1,4 +1,8 @@
+#include <stdlib.h>
+#include <stdint.h>
+
 #include "atsc_psip_section.h"
+#include "scan.h"
 
 struct ATSC_extended_channel_name_descriptor read_ATSC_extended_channel_name_descriptor(const u8 *b)
 {
@@ -60,3 +64,147 @@ struct tvct_channel read_tvct_channel(const u8 *b)
 	return v;
 }
 
+
+struct mgt_table read_mgt_table(const u8 *b)
+{
+	struct mgt_table v;
+	v.table_type                = getBits(b,  0,16);
+	v.reserved0                 = getBits(b, 16, 3);
+	v.table_type_PID            = getBits(b, 19,13);
+	v.reserved1                 = getBits(b, 32, 3);
+	v.table_type_version_number = getBits(b, 35, 5);
+	v.number_bytes              = getBits(b, 40,32);
+	v.reserved2                 = getBits(b, 72, 4);
+	v.table_type_descriptors_length = getBits(b, 76,12);
+	return v;
+}
+
+static int utf8_put(char *d, unsigned int cp)
+{
+	if (cp < 0x80) {
+		d[0] = cp;
+		return 1;
+	}
+	if (cp < 0x800) {
+		d[0] = 0xc0 | cp >> 6;
+		d[1] = 0x80 | (cp & 0x3f);
+		return 2;
+	}
+	if (cp < 0x10000) {
+		d[0] = 0xe0 | cp >> 12;
+		d[1] = 0x80 | (cp >> 6 & 0x3f);
+		d[2] = 0x80 | (cp & 0x3f);
+		return 3;
+	}
+	d[0] = 0xf0 | cp >> 18;
+	d[1] = 0x80 | (cp >> 12 & 0x3f);
+	d[2] = 0x80 | (cp >> 6 & 0x3f);
+	d[3] = 0x80 | (cp & 0x3f);
+	return 4;
+}
+
+/* UTF-16BE units into d (at least 3 bytes per unit), returns the length */
+static int utf16_to_utf8(char *d, const u8 *b, int n)
+{
+	unsigned int cp, lo;
+	int i, len = 0;
+
+	for (i = 0; i < n; i++) {
+		cp = b[2 * i] << 8 | b[2 * i + 1];
+		if (cp >= 0xd800 && cp < 0xdc00 && i + 1 < n) {
+			lo = b[2 * i + 2] << 8 | b[2 * i + 3];
+			if (lo >= 0xdc00 && lo < 0xe000) {
+				cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+				i++;
+			}
+		}
+		if (cp == 0 || (cp >= 0xd800 && cp < 0xe000))
+			continue;
+		len += utf8_put(d + len, cp);
+	}
+	return len;
+}
+
+char *atsc_short_name(const struct tvct_channel *ch)
+{
+	const u16 units[7] = {
+		ch->short_name0, ch->short_name1, ch->short_name2, ch->short_name3,
+		ch->short_name4, ch->short_name5, ch->short_name6
+	};
+	u8 b[14];
+	char *name = malloc(7 * 3 + 1);
+	int i, len;
+
+	for (i = 0; i < 7; i++) {
+		b[2 * i] = units[i] >> 8;
+		b[2 * i + 1] = units[i] & 0xff;
+	}
+	len = utf16_to_utf8(name, b, 7);
+	while (len > 0 && name[len - 1] == ' ')
+		len--;
+	name[len] = '\0';
+	return name;
+}
+
+/* modes that select a 256 code point page of Unicode, A/65 table 6.41 */
+static const u8 mss_page_mode[256] = {
+	[0x00 ... 0x06] = 1,
+	[0x09 ... 0x10] = 1,
+	[0x20 ... 0x27] = 1,
+	[0x30 ... 0x33] = 1,
+};
+
+#define MSS_MODE_UTF16	0x3f
+
+char *atsc_mss_to_utf8(const u8 *buf, int len)
+{
+	const u8 *end = buf + len, *seg;
+	char *out = NULL;
+	int n_strings, n_segments, i, j, k, n, pos;
+	int compression, mode;
+
+	if (len < 1)
+		return NULL;
+	n_strings = *buf++;
+	for (i = 0; i < n_strings; i++) {
+		if (buf + 4 > end)
+			break;
+		n_segments = buf[3];
+		buf += 4;	/* ISO_639_language_code */
+
+		free(out);
+		out = NULL;
+		pos = 0;
+		for (j = 0; j < n_segments; j++) {
+			if (buf + 3 > end || buf + 3 + buf[2] > end)
+				goto out;
+			compression = buf[0];
+			mode = buf[1];
+			n = buf[2];
+			seg = buf + 3;
+			buf += 3 + n;
+
+			if (compression != 0) {
+				/* the Huffman coding of A/65 Annex C is not supported */
+				verbosedebug("ATSC string compression %d not supported\n", compression);
+				continue;
+			}
+			out = realloc(out, pos + 3 * n + 1);
+			if (mss_page_mode[mode]) {
+				for (k = 0; k < n; k++) {
+					if (mode || seg[k])
+						pos += utf8_put(out + pos, mode << 8 | seg[k]);
+				}
+			} else if (mode == MSS_MODE_UTF16)
+				pos += utf16_to_utf8(out + pos, seg, n / 2);
+			else
+				verbosedebug("ATSC string mode 0x%02x skipped\n", mode);
+			out[pos] = '\0';
+		}
+		if (pos > 0)
+			return out;
+	}
+out:
+	free(out);
+	return NULL;
+}
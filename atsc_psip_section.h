@@ -57,4 +57,32 @@ struct tvct_channel {
 } PACKED;
 struct tvct_channel read_tvct_channel(const u8 *);
 
+/* master guide table, A/65 6.2 */
+#define ATSC_MGT_TVCT_CURRENT	0x0000
+#define ATSC_MGT_CVCT_CURRENT	0x0002
+#define ATSC_MGT_CHANNEL_ETT	0x0004
+#define ATSC_MGT_EIT_FIRST		0x0100	/* EIT-0 .. EIT-127 */
+#define ATSC_MGT_EIT_LAST		0x017F
+#define ATSC_MGT_ETT_FIRST		0x0200	/* event ETT-0 .. ETT-127 */
+#define ATSC_MGT_ETT_LAST		0x027F
+
+struct mgt_table {
+	u16 table_type                :16;
+	u8  reserved0                 : 3;
+	u16 table_type_PID            :13;
+	u8  reserved1                 : 3;
+	u8  table_type_version_number : 5;
+	u32 number_bytes              :32;
+	u8  reserved2                 : 4;
+	u16 table_type_descriptors_length :12;
+} PACKED;
+struct mgt_table read_mgt_table(const u8 *);
+
+/* the seven UTF-16 code units of a VCT short_name as UTF-8, malloc()ed */
+char *atsc_short_name(const struct tvct_channel *ch);
+
+/* the first decodable string of a multiple_string_structure (A/65 6.10)
+ * as UTF-8, malloc()ed, NULL if there is none */
+char *atsc_mss_to_utf8(const u8 *buf, int len);
+
 #endif
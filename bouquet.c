@@ -2,68 +2,136 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
-#include <fnmatch.h>
+#include <errno.h>
 
 #include "list.h"
 #include "scan.h"
 #include "section.h"
-#include "htable.h"
+#include "hmap.h"
+#include "match.h"
+#include "lcn.h"
+#include "collate.h"
+#include "bouquet.h"
 
 extern char * dvbtext2utf8(char* dvbtext, int dvbtextlen);
 
 // only video/audio streams for VDR output
-#define SERVICE_CHECK(s)		(((((s)->video_pid != 0) | (((s)->audio_pid[0] != 0) << 1)) & ctx->serv_select) && !(ctx->ca_select == 0 && (s)->scrambled))
+#define SERVICE_CHECK(s)		(((((s)->video_pid != 0) | (((s)->audio_pid != 0) << 1)) & ctx->serv_select) && !(ctx->ca_select == 0 && (s)->scrambled))
 
 struct bouquet {
-	struct htable_entry hash;
-	unsigned char hash_key[2];
+	uint64_t key;
 	int bouquet_id;
 	char *bouquet_name;
 	char *bouquet_ml_name;
-	struct htable services;
+	struct hmap services;		// service key -> struct bouquet_member
+	int dump_index;				// position in the output, bouquet_dump() only
+	// where the bouquet comes from, for scoped rules
+	int network_id;				// original_network_id of its first transport or -1
+	int position;				// orbital position of that network or POSITION_UNKNOWN
 };
 
-struct bouquet_service {
-	struct htable_entry hash;
-	unsigned char hash_key[6];
+// a (nid, tid, sid) with every bouquet it belongs to
+struct bouquet_member {
+	struct bouquet **bouquets;
+	int n_bouquets;
+	int size;
 	struct transponder *tp;
 	struct service *sp;
 };
 
-#define	STAGE_PRE_SCAN		1
-#define	STAGE_POST_SCAN		2
-#define	STAGE_PRE_OUTPUT	4
-
-struct bouquet_ctx;
+// bouquets created by add=/move= get keys above the 16 bit bouquet_id range
+#define USER_BOUQUET_KEY	0x10000
+
+enum rule_type {
+	RULE_LANG,
+	RULE_MERGE,
+	RULE_RENAME,
+	RULE_ADD,
+	RULE_MOVE,
+	RULE_S,
+	RULE_IGNORE,
+	RULE_REMOVE
+};
 
 struct bouquet_option_params {
 	const char *option_name;
 	int min_args;
 	int max_args;
 	int priority;
-	int stage;
-	void (*action)(struct bouquet_ctx *ctx, int argc, char **argv);
+	enum rule_type type;
+	int first_pattern;		// index of the first pattern argument, -1 for none
+};
+
+// orbital positions in 0.1 degrees, east positive
+#define POSITION_UNKNOWN	-10000
+#define SCOPE_MAX			32
+
+// [onid N,...] or [position 19.2E,...] of a rules file
+struct rule_scope {
+	enum { SCOPE_ONID, SCOPE_POSITION } type;
+	int n_values;
+	int values[SCOPE_MAX];
+	char *text;
 };
 
 struct bouquet_option {
 	char **argv;
 	int argc;
+	int index;		// position in the option string, keeps the sort stable
 	struct bouquet_option_params *params;
+	struct rule_scope *scope;	// NULL applies everywhere
+	const char *file;			// NULL for the option string
+	int line;					// or the option number there
+	unsigned int hits;			// services or bouquets the rule applied to
+};
+
+// options of one pass compiled into a single matcher, pattern ids are
+// indices into rules
+struct rule_set {
+	struct bouquet_option **rules;
+	int n_rules;
+	struct matcher *matcher;
+	uint32_t *hits;
+	struct bouquet **targets;	// add=/move= target bouquet per rule
 };
 
 struct bouquet_config {
 	const char **languages;
-	struct bouquet_option **options;
+	struct bouquet_option **options;	// NULL terminated
+	int n_options;
 	// option strings are allocated here
 	char *opt_buf;
+	// lines, file names and scopes of rules files
+	void **allocs;
+	int n_allocs;
+};
+
+struct bouquet_service_pair {
+	struct transponder *tp;
+	struct service *sp;
 };
 
 struct bouquet_ctx {
 	struct bouquet_config cfg;
-	struct htable bouquets;
+	struct hmap bouquets;		// key -> struct bouquet
+	// reverse index: service key -> struct bouquet_member, maintained
+	// along with bouquet.services
+	struct hmap members;
+	uint64_t next_user_key;
+	// s=, add= and move= applied to services; merge=, rename= and ignore=
+	// to bouquets after that; remove= before output
+	struct rule_set service_rules;
+	struct rule_set bouquet_rules;
+	struct rule_set remove_rules;
+	uint32_t stamp;
 	struct list_head *scanned_transponders;
 	int serv_select;
 	int ca_select;
+	// set by bouquet_prepare()
+	int prepared;
+	int n_mapped;
+	struct bouquet_service_pair *unmapped;
+	int n_unmapped;
 };
 
 #define ARRAY(var, type, size_incr)	struct {type (*buf); int len; int _size; int _incr;} var = {NULL, 0, 0, (size_incr)}
@@ -84,49 +152,85 @@ do {												\
 } while(0)
 #define ARRAY_CLEAN(arr)		free((arr).buf); (arr).buf = NULL; (arr)._size = 0; (arr).len = 0
 
-static void bouquet_init_key(struct bouquet *bp, int id)
+static uint64_t service_key(int nid, int tid, int sid)
 {
-	bp->hash_key[0] = id & 0xff;
-	bp->hash_key[1] = id>>8 & 0xff;
-	htable_entry_init(&bp->hash, bp->hash_key, sizeof(bp->hash_key));
+	return (uint64_t)(nid & 0xffff) << 32 | (uint64_t)(tid & 0xffff) << 16 | (sid & 0xffff);
+}
+
+static struct bouquet_member *member_get(struct bouquet_ctx *ctx, uint64_t key)
+{
+	struct bouquet_member *m;
+
+	if ((m = hmap_get(&ctx->members, key)) == NULL) {
+		m = calloc(1, sizeof(struct bouquet_member));
+		hmap_put(&ctx->members, key, m);
+	}
+	return m;
 }
 
-static void init_service(struct bouquet_service *s, int nid, int tid, int sid)
+static void member_add(struct bouquet_member *m, struct bouquet *bp)
 {
-	s->hash_key[0] = sid & 0xff;
-	s->hash_key[1] = sid>>8 & 0xff;
-	s->hash_key[2] = tid & 0xff;
-	s->hash_key[3] = tid>>8 & 0xff;
-	s->hash_key[4] = nid & 0xff;
-	s->hash_key[5] = nid>>8 & 0xff;
-	htable_entry_init(&s->hash, s->hash_key, sizeof(s->hash_key));
-	s->tp = NULL;
-	s->sp = NULL;
+	if (m->n_bouquets == m->size) {
+		m->size = (m->size)? m->size * 2 : 4;
+		m->bouquets = realloc(m->bouquets, m->size * sizeof(struct bouquet *));
+	}
+	m->bouquets[m->n_bouquets++] = bp;
 }
 
-static struct bouquet *bouquet_entry_create(int id, const char *name, const char *ml_name)
+// keeps the order, bouquet names are listed in it
+static void member_del(struct bouquet_member *m, struct bouquet *bp)
+{
+	int i;
+
+	for (i = 0; i < m->n_bouquets; i++) {
+		if (m->bouquets[i] == bp) {
+			memmove(&m->bouquets[i], &m->bouquets[i + 1],
+				(m->n_bouquets - i - 1) * sizeof(struct bouquet *));
+			m->n_bouquets--;
+			return;
+		}
+	}
+}
+
+// adds a service to a bouquet, returns its member entry
+static struct bouquet_member *bouquet_add_service(struct bouquet_ctx *ctx, struct bouquet *bp, uint64_t key)
+{
+	struct bouquet_member *m;
+
+	if ((m = hmap_get(&bp->services, key)) == NULL) {
+		m = member_get(ctx, key);
+		hmap_put(&bp->services, key, m);
+		member_add(m, bp);
+	}
+	return m;
+}
+
+static struct bouquet *bouquet_entry_create(uint64_t key, int id, const char *name, const char *ml_name)
 {
 	struct bouquet *bp;
 
 	bp = malloc(sizeof(struct bouquet));
+	bp->key = key;
 	bp->bouquet_id = id;
 	bp->bouquet_name = (name)? strdup(name) : NULL;
 	bp->bouquet_ml_name = (ml_name)? strdup(ml_name) : NULL;
-	bouquet_init_key(bp, id);
-	htable_init(&bp->services, 256, 0);
+	hmap_init(&bp->services, 256);
+	bp->network_id = -1;
+	bp->position = POSITION_UNKNOWN;
 	return bp;
 }
 
 static void bouquet_entry_free(struct bouquet *bp)
 {
-	struct bouquet_service *sp;
+	struct bouquet_member *m;
+	uint64_t key;
 
 	if (bp->bouquet_name) free(bp->bouquet_name);
 	if (bp->bouquet_ml_name) free(bp->bouquet_ml_name);
-	HTABLE_FOREACH(&bp->services, sp, struct bouquet_service, hash,
-		free(sp);
+	HMAP_FOREACH(&bp->services, key, m,
+		member_del(m, bp);
 	);
-	htable_free(&bp->services);
+	hmap_free(&bp->services);
 	free(bp);
 }
 
@@ -142,11 +246,6 @@ static char *strip_space(char *s)
 	return s;
 }
 
-static int pattern_match(const char *pattern, const char *string)
-{
-	return fnmatch(pattern, string, 0);
-}
-
 // lang=string,string,...
 static void opt_lang(struct bouquet_ctx *ctx, int argc, char **argv)
 {
@@ -158,117 +257,6 @@ static void opt_lang(struct bouquet_ctx *ctx, int argc, char **argv)
 	ctx->cfg.languages[argc - 1] = NULL;
 }
 
-// merge=target,pattern,pattern,...
-static void opt_merge(struct bouquet_ctx *ctx, int argc, char **argv)
-{
-	char *target_name = argv[1];
-	struct bouquet *bp, *target_ptr = NULL;
-	struct bouquet_service *sp;
-	int i;
-
-	HTABLE_FOREACH(&ctx->bouquets, bp, struct bouquet, hash,
-		for (i = 2; i < argc; i++) {
-			if (pattern_match(argv[i], bp->bouquet_name) == 0)
-				break;
-		}
-		if (i < argc) {
-			// matched
-			if (target_ptr == NULL) {
-				// becomes a new target
-				target_ptr = bp;
-				free(bp->bouquet_name);
-				bp->bouquet_name = strdup(target_name);
-			} else {
-				HTABLE_FOREACH(&bp->services, sp, struct bouquet_service, hash,
-					htable_remove_noresize(&bp->services, &sp->hash);
-					if (htable_lookup(&target_ptr->services, &sp->hash) == NULL)
-						htable_insert(&target_ptr->services, &sp->hash);
-					else
-						free(sp);
-				);
-				htable_remove_noresize(&ctx->bouquets, &bp->hash);
-				bouquet_entry_free(bp);
-			}
-		}
-	);
-}
-
-// rename=old,new
-static void opt_rename(struct bouquet_ctx *ctx, int argc, char **argv)
-{
-	struct bouquet *bp;
-
-	HTABLE_FOREACH(&ctx->bouquets, bp, struct bouquet, hash,
-		if (strcmp(argv[1], bp->bouquet_name) == 0) {
-			free(bp->bouquet_name);
-			bp->bouquet_name = strdup(argv[2]);
-			break;
-		}
-	);
-}
-
-//  add=bouquet,pattern,pattern,...
-// move=bouquet,pattern,pattern,...
-static void opt_add(struct bouquet_ctx *ctx, int argc, char **argv)
-{
-	struct list_head *p1, *p2;
-	struct transponder *tp;
-	struct service *sp;
-	struct bouquet *bp, *bp2;
-	struct bouquet_service *bsp, *bsp2;
-	int i, found;
-
-	found = 0;
-	HTABLE_FOREACH(&ctx->bouquets, bp, struct bouquet, hash,
-		if (strcmp(argv[1], bp->bouquet_name) == 0) {
-			found = 1;
-			break;
-		}
-	);
-	if (!found) {
-		bp = bouquet_entry_create(-1, argv[1], NULL);
-		htable_insert(&ctx->bouquets, &bp->hash);
-	}
-	list_for_each(p1, ctx->scanned_transponders) {
-		tp = list_entry(p1, struct transponder, list);
-		list_for_each(p2, &tp->services) {
-			sp = list_entry(p2, struct service, list);
-			if (!SERVICE_CHECK(sp))
-				continue;
-			for (i = 2; i < argc; i++) {
-				if (pattern_match(argv[i], sp->service_name) == 0)
-					break;
-			}
-			if (i < argc) {
-				// matched
-				struct htable_entry *e;
-				bsp = malloc(sizeof(struct bouquet_service));
-				init_service(bsp, tp->original_network_id, tp->transport_stream_id, sp->service_id);
-				if ((e = htable_lookup(&bp->services, &bsp->hash)) != NULL) {
-					free(bsp);
-					bsp = container_of(e, struct bouquet_service, hash);
-				} else {
-					htable_insert(&bp->services, &bsp->hash);
-				}
-				bsp->tp = tp;
-				bsp->sp = sp;
-				if (strcmp(argv[0], "move") == 0) {
-					// remove from other bouquets
-					HTABLE_FOREACH(&ctx->bouquets, bp2, struct bouquet, hash,
-						if (bp2 == bp)
-							continue;
-						e = htable_remove(&bp2->services, &bsp->hash);
-						if (e) {
-							bsp2 = container_of(e, struct bouquet_service, hash);
-							free(bsp2);
-						}
-					);
-				}
-			}
-		}
-	}
-}
-
 struct substring_pair {
 	char *buf;
 	int len;
@@ -313,146 +301,656 @@ static char *replace(char *src, char *sub, char *repl)
 	return start;
 }
 
-// s=substring,substitution
-static void opt_s(struct bouquet_ctx *ctx, int argc, char **argv)
+static struct bouquet_option_params option_params[] = {
+	{"lang", 1, -1, 10, RULE_LANG, 1},
+	{"merge", 2, -1, 10, RULE_MERGE, 2},
+	{"rename", 2, 2, 10, RULE_RENAME, -1},
+	{"add", 2, -1, 20, RULE_ADD, 2},
+	{"move", 2, -1, 20, RULE_MOVE, 2},
+	{"s", 2, 2, 30, RULE_S, -1},
+	{"ignore", 1, -1, 10, RULE_IGNORE, 1},
+	{"remove", 1, -1, 10, RULE_REMOVE, 1},
+};
+
+static int cmp_option(const void *a, const void *b){
+	const struct bouquet_option *o1 = *(struct bouquet_option **)a;
+	const struct bouquet_option *o2 = *(struct bouquet_option **)b;
+
+	if (o1->params->priority != o2->params->priority)
+		return o2->params->priority - o1->params->priority;
+	return o1->index - o2->index;
+}
+
+static void cfg_keep(struct bouquet_config *cfg, void *p)
 {
-	struct list_head *p1, *p2;
-	struct transponder *tp;
-	struct service *sp;
-	char *p;
+	cfg->allocs = realloc(cfg->allocs, (cfg->n_allocs + 1) * sizeof(void *));
+	cfg->allocs[cfg->n_allocs++] = p;
+}
 
-	list_for_each(p1, ctx->scanned_transponders) {
-		tp = list_entry(p1, struct transponder, list);
-		list_for_each(p2, &tp->services) {
-			sp = list_entry(p2, struct service, list);
-			if (!SERVICE_CHECK(sp))
-				continue;
-			if ((p = replace(sp->service_name, argv[1], argv[2])) != NULL) {
-				free(sp->service_name);
-				sp->service_name = p;
+// message prefix for rules file lines, the option string has none
+static const char *option_where(const char *file, int line)
+{
+	static char buf[512];
+
+	if (!file)
+		return "";
+	snprintf(buf, sizeof(buf), "%s:%d: ", file, line);
+	return buf;
+}
+
+// OPTION=VALUE,VALUE,... in tok, which must stay allocated
+static int add_option(struct bouquet_config *cfg, char *tok, struct rule_scope *scope,
+		const char *file, int line)
+{
+	struct bouquet_option *opt;
+	struct bouquet_option_params *params;
+	char *s, *arg, *save;
+	int i;
+	ARRAY(args, char *, 16);
+
+	s = strchr(tok, '=');
+	if (s != NULL)
+		*s++ = '\0';
+	else
+		s = tok + strlen(tok);
+	ARRAY_APPEND(args, tok);
+	for (; (arg = strtok_r(s, ",", &save)) != NULL; s = NULL) {
+		ARRAY_APPEND(args, arg);
+	}
+	params = NULL;
+	for (i = 0; i < sizeof(option_params)/sizeof(struct bouquet_option_params); i++) {
+		if (strcmp(args.buf[0], option_params[i].option_name) == 0) {
+			params = &option_params[i];
+			break;
+		}
+	}
+	if (!params) {
+		error("%sInvalid bouquet option: '%s'\n", option_where(file, line), args.buf[0]);
+		goto error;
+	}
+	if (
+		(params->min_args >= 0 && args.len - 1 < params->min_args) ||
+		(params->max_args >= 0 && args.len - 1 > params->max_args)
+	) {
+		error("%sInvalid number of arguments for bouquet option '%s'\n", option_where(file, line), args.buf[0]);
+		goto error;
+	}
+	if (scope && params->type == RULE_LANG) {
+		error("%sBouquet option 'lang' applies everywhere, put it before any scope\n", option_where(file, line));
+		goto error;
+	}
+	for (i = params->first_pattern; i > 0 && i < args.len; i++) {
+		if (!glob_valid(args.buf[i])) {
+			error("%sInvalid pattern '%s' for bouquet option '%s'\n", option_where(file, line), args.buf[i], args.buf[0]);
+			goto error;
+		}
+	}
+
+	opt = malloc(sizeof(struct bouquet_option));
+	opt->argc = args.len;
+	opt->argv = malloc((opt->argc + 1) * sizeof(char *));
+	for (i = 0; i < opt->argc; i++)
+		opt->argv[i] = args.buf[i];
+	opt->argv[opt->argc] = NULL;
+	opt->params = params;
+	opt->index = cfg->n_options;
+	opt->scope = scope;
+	opt->file = file;
+	opt->line = line;
+	opt->hits = 0;
+	cfg->options = realloc(cfg->options, (cfg->n_options + 2) * sizeof(struct bouquet_option *));
+	cfg->options[cfg->n_options++] = opt;
+	cfg->options[cfg->n_options] = NULL;
+	ARRAY_CLEAN(args);
+	return 0;
+error:
+	ARRAY_CLEAN(args);
+	return -1;
+}
+
+// [onid N,N,...], [position 19.2E,30.0W,...] or [global] in s
+static int parse_scope(struct bouquet_config *cfg, char *s, struct rule_scope **scope,
+		const char *file, int line)
+{
+	struct rule_scope *sc;
+	char *kind, *arg, *save, *end;
+	double pos;
+	long v;
+
+	end = s + strlen(s) - 1;
+	if (*end != ']')
+		goto bad;
+	*end = '\0';
+	s = strip_space(s + 1);
+	if (strcmp(s, "global") == 0) {
+		*scope = NULL;
+		return 0;
+	}
+
+	sc = calloc(1, sizeof(struct rule_scope));
+	cfg_keep(cfg, sc);
+	sc->text = strdup(s);
+	cfg_keep(cfg, sc->text);
+	kind = s;
+	s += strcspn(s, " \t");
+	if (*s)
+		*s++ = '\0';
+	if (strcmp(kind, "onid") == 0)
+		sc->type = SCOPE_ONID;
+	else if (strcmp(kind, "position") == 0)
+		sc->type = SCOPE_POSITION;
+	else
+		goto bad;
+	for (; (arg = strtok_r(s, ", \t", &save)) != NULL; s = NULL) {
+		if (sc->n_values == SCOPE_MAX) {
+			error("%sMore than %d values in a scope\n", option_where(file, line), SCOPE_MAX);
+			return -1;
+		}
+		if (sc->type == SCOPE_ONID) {
+			v = strtol(arg, &end, 0);
+			if (end == arg || *end || v < 0 || v > 0xffff)
+				goto bad_value;
+		} else {
+			pos = strtod(arg, &end);
+			if (end == arg || pos < 0 || pos > 180 || end[1] ||
+					(*end != 'E' && *end != 'e' && *end != 'W' && *end != 'w'))
+				goto bad_value;
+			v = (long)(pos * 10 + 0.5);
+			if (*end == 'W' || *end == 'w')
+				v = -v;
+		}
+		sc->values[sc->n_values++] = v;
+	}
+	if (sc->n_values == 0)
+		goto bad;
+	*scope = sc;
+	return 0;
+
+bad_value:
+	error("%sInvalid %s '%s'\n", option_where(file, line), kind, arg);
+	return -1;
+bad:
+	error("%sInvalid scope, expected [onid N,...], [position 19.2E,...] or [global]\n", option_where(file, line));
+	return -1;
+}
+
+#define RULES_DEPTH_MAX		8
+
+// include paths are relative to the including file
+static char *include_path(struct bouquet_config *cfg, const char *file, const char *name)
+{
+	const char *slash = strrchr(file, '/');
+	char *path;
+
+	if (name[0] == '/' || slash == NULL)
+		path = strdup(name);
+	else {
+		path = malloc(slash - file + 1 + strlen(name) + 1);
+		sprintf(path, "%.*s/%s", (int)(slash - file), file, name);
+	}
+	cfg_keep(cfg, path);
+	return path;
+}
+
+// one option per line, [scope] lines and 'include FILE', '#' comments;
+// a scope holds until the next one or the end of its file
+static int load_rules(struct bouquet_config *cfg, const char *path, struct rule_scope *scope, int depth)
+{
+	FILE *f;
+	char *line = NULL, *s, *file;
+	size_t size = 0;
+	int line_no = 0, ret = 0;
+
+	if (depth > RULES_DEPTH_MAX) {
+		error("%s: Bouquet rules includes nested too deep\n", path);
+		return -1;
+	}
+	if ((f = fopen(path, "r")) == NULL) {
+		error("Can't open bouquet rules '%s': %s\n", path, strerror(errno));
+		return -1;
+	}
+	file = strdup(path);
+	cfg_keep(cfg, file);
+	while (ret == 0 && getline(&line, &size, f) != -1) {
+		line_no++;
+		line[strcspn(line, "\r\n")] = '\0';
+		s = strip_space(line);
+		if (*s == '\0' || *s == '#')
+			continue;
+		s = strdup(s);
+		cfg_keep(cfg, s);
+		if (*s == '[')
+			ret = parse_scope(cfg, s, &scope, file, line_no);
+		else if (strncmp(s, "include", 7) == 0 && (s[7] == ' ' || s[7] == '\t'))
+			ret = load_rules(cfg, include_path(cfg, file, strip_space(s + 8)), scope, depth + 1);
+		else
+			ret = add_option(cfg, s, scope, file, line_no);
+	}
+	free(line);
+	fclose(f);
+	return ret;
+}
+
+static int bouquet_parse_options(struct bouquet_config *cfg, const char *optstring)
+{
+	char *s1, *s2, *tok, *path, *save1, *save2;
+	int n;
+
+	cfg->options = calloc(1, sizeof(struct bouquet_option *));
+	cfg->opt_buf = strdup(optstring);
+	for (n = 1, s1 = cfg->opt_buf; (tok = strtok_r(s1, ";", &save1)) != NULL; n++, s1 = NULL) {
+		if (strncmp(tok, "rules=", 6) == 0) {
+			for (s2 = tok + 6; (path = strtok_r(s2, ",", &save2)) != NULL; s2 = NULL) {
+				if (load_rules(cfg, path, NULL, 0) != 0)
+					return -1;
 			}
+		} else if (add_option(cfg, tok, NULL, NULL, n) != 0)
+			return -1;
+	}
+	qsort(cfg->options, cfg->n_options, sizeof(struct bouquet_option *), cmp_option);
+	return 0;
+}
+
+static void rule_set_add(struct rule_set *rs, struct bouquet_option *opt)
+{
+	int i;
+
+	rs->rules = realloc(rs->rules, (rs->n_rules + 1) * sizeof(struct bouquet_option *));
+	rs->rules[rs->n_rules] = opt;
+	for (i = opt->params->first_pattern; i > 0 && i < opt->argc; i++)
+		matcher_add(rs->matcher, opt->argv[i], rs->n_rules);
+	rs->n_rules++;
+}
+
+static void rule_set_free(struct rule_set *rs)
+{
+	free(rs->rules);
+	free(rs->hits);
+	free(rs->targets);
+	matcher_free(rs->matcher);
+}
+
+// compiles the options once, in the order they are applied
+static void bouquet_compile_options(struct bouquet_ctx *ctx)
+{
+	struct rule_set *sets[] = { &ctx->service_rules, &ctx->bouquet_rules, &ctx->remove_rules };
+	struct bouquet_option **opt;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(sets)/sizeof(sets[0]); i++)
+		sets[i]->matcher = matcher_create();
+	for (opt = ctx->cfg.options; *opt != NULL; opt++) {
+		switch ((*opt)->params->type) {
+		case RULE_LANG:
+			opt_lang(ctx, (*opt)->argc, (*opt)->argv);
+			break;
+		case RULE_S:
+		case RULE_ADD:
+		case RULE_MOVE:
+			rule_set_add(&ctx->service_rules, *opt);
+			break;
+		case RULE_MERGE:
+		case RULE_RENAME:
+		case RULE_IGNORE:
+			rule_set_add(&ctx->bouquet_rules, *opt);
+			break;
+		case RULE_REMOVE:
+			rule_set_add(&ctx->remove_rules, *opt);
+			break;
 		}
 	}
+	for (i = 0; i < sizeof(sets)/sizeof(sets[0]); i++) {
+		sets[i]->hits = calloc(sets[i]->n_rules + 1, sizeof(uint32_t));
+		sets[i]->targets = calloc(sets[i]->n_rules + 1, sizeof(struct bouquet *));
+	}
 }
 
-// remove=pattern,pattern,...
-// ignore=pattern,pattern,...
-static void opt_remove(struct bouquet_ctx *ctx, int argc, char **argv)
+static int rule_in_scope(const struct bouquet_option *opt, int network_id, int position)
+{
+	const struct rule_scope *sc = opt->scope;
+	int i, v;
+
+	if (!sc)
+		return 1;
+	v = (sc->type == SCOPE_ONID)? network_id : position;
+	for (i = 0; i < sc->n_values; i++) {
+		if (sc->values[i] == v)
+			return 1;
+	}
+	return 0;
+}
+
+static int tp_position(const struct transponder *tp)
+{
+	if (tp->orbital_pos == 0)
+		return POSITION_UNKNOWN;
+	return (tp->we_flag)? tp->orbital_pos : -tp->orbital_pos;
+}
+
+// orbital position of the first scanned transponder of a network
+static int network_position(struct bouquet_ctx *ctx, int network_id)
+{
+	struct list_head *pos;
+	struct transponder *tp;
+
+	list_for_each(pos, ctx->scanned_transponders) {
+		tp = list_entry(pos, struct transponder, list);
+		if (tp->original_network_id == network_id && tp->orbital_pos != 0)
+			return tp_position(tp);
+	}
+	return POSITION_UNKNOWN;
+}
+
+static struct bouquet *bouquet_find(struct bouquet_ctx *ctx, const char *name)
 {
+	struct bouquet *bp;
+	uint64_t key;
+
+	HMAP_FOREACH(&ctx->bouquets, key, bp,
+		if (strcmp(name, bp->bouquet_name) == 0)
+			return bp;
+	);
+	return NULL;
+}
+
+// add=/move= targets, existing bouquets are looked up by name; new ones
+// belong where their rule is scoped
+static void resolve_targets(struct bouquet_ctx *ctx)
+{
+	struct rule_set *rs = &ctx->service_rules;
+	struct bouquet_option *opt;
 	struct bouquet *bp;
 	int i;
 
-	HTABLE_FOREACH(&ctx->bouquets, bp, struct bouquet, hash,
-		for (i = 1; i < argc; i++) {
-			if (pattern_match(argv[i], bp->bouquet_name) == 0) {
-				htable_remove_noresize(&ctx->bouquets, &bp->hash);
-				bouquet_entry_free(bp);
-			}
+	for (i = 0; i < rs->n_rules; i++) {
+		opt = rs->rules[i];
+		if (opt->params->type != RULE_ADD && opt->params->type != RULE_MOVE)
+			continue;
+		if ((bp = bouquet_find(ctx, opt->argv[1])) == NULL) {
+			bp = bouquet_entry_create(ctx->next_user_key++, -1, opt->argv[1], NULL);
+			if (opt->scope && opt->scope->type == SCOPE_ONID)
+				bp->network_id = opt->scope->values[0];
+			if (opt->scope && opt->scope->type == SCOPE_POSITION)
+				bp->position = opt->scope->values[0];
+			hmap_put(&ctx->bouquets, bp->key, bp);
+		}
+		rs->targets[i] = bp;
+	}
+}
+
+//  add=bouquet,pattern,pattern,...
+// move=bouquet,pattern,pattern,...
+static void add_matched_service(struct bouquet_ctx *ctx, struct bouquet *bp,
+		struct transponder *tp, struct service *sp, int move)
+{
+	struct bouquet_member *m;
+	struct bouquet *bp2;
+	uint64_t key;
+	int i;
+
+	key = service_key(tp->original_network_id, tp->transport_stream_id, sp->service_id);
+	m = bouquet_add_service(ctx, bp, key);
+	m->tp = tp;
+	m->sp = sp;
+	if (move) {
+		// remove from the other bouquets it is a member of
+		for (i = m->n_bouquets - 1; i >= 0; i--) {
+			bp2 = m->bouquets[i];
+			if (bp2 == bp)
+				continue;
+			hmap_remove(&bp2->services, key);
+			member_del(m, bp2);
+		}
+	}
+}
+
+// s=substring,substitution first, add= and move= match the new name
+static void apply_service_rules(struct bouquet_ctx *ctx, struct transponder *tp, struct service *sp)
+{
+	struct rule_set *rs = &ctx->service_rules;
+	struct bouquet_option *opt;
+	int i, position;
+	char *p;
+
+	position = tp_position(tp);
+	for (i = 0; i < rs->n_rules; i++) {
+		opt = rs->rules[i];
+		if (opt->params->type != RULE_S ||
+				!rule_in_scope(opt, tp->original_network_id, position))
+			continue;
+		if ((p = replace(sp->service_name, opt->argv[1], opt->argv[2])) != NULL) {
+			free(sp->service_name);
+			sp->service_name = p;
+			opt->hits++;
+		}
+	}
+	if (matcher_match(rs->matcher, sp->service_name, rs->hits, ++ctx->stamp) == 0)
+		return;
+	for (i = 0; i < rs->n_rules; i++) {
+		opt = rs->rules[i];
+		if (rs->hits[i] != ctx->stamp ||
+				!rule_in_scope(opt, tp->original_network_id, position))
+			continue;
+		opt->hits++;
+		add_matched_service(ctx, rs->targets[i], tp, sp, opt->params->type == RULE_MOVE);
+	}
+}
+
+static void merge_into(struct bouquet_ctx *ctx, struct bouquet *target, struct bouquet *bp)
+{
+	struct bouquet_member *m;
+	uint64_t key;
+
+	HMAP_FOREACH(&bp->services, key, m,
+		member_del(m, bp);
+		if (hmap_get(&target->services, key) == NULL) {
+			hmap_put(&target->services, key, m);
+			member_add(m, target);
 		}
 	);
+	hmap_free(&bp->services);
+	hmap_remove(&ctx->bouquets, bp->key);
+	bouquet_entry_free(bp);
 }
 
-static struct bouquet_option_params option_params[] = {
-	{"lang", 1, -1, 10, STAGE_PRE_SCAN, opt_lang},
-	{"merge", 2, -1, 10, STAGE_POST_SCAN, opt_merge},
-	{"rename", 2, 2, 10, STAGE_POST_SCAN, opt_rename},
-	{"add", 2, -1, 20, STAGE_POST_SCAN, opt_add},
-	{"move", 2, -1, 20, STAGE_POST_SCAN, opt_add},
-	{"s", 2, 2, 30, STAGE_POST_SCAN, opt_s},
-	{"ignore", 1, -1, 10, STAGE_POST_SCAN, opt_remove},
-	{"remove", 1, -1, 10, STAGE_PRE_OUTPUT, opt_remove},
+// a bouquet during the bouquet rules, its hits are valid for its stamp
+struct bouquet_state {
+	struct bouquet *bp;		// NULL once merged or ignored
+	uint32_t *hits;
+	uint32_t stamp;
 };
 
-static int cmp_option(const void *a, const void *b){
-	return (*((struct bouquet_option **)b))->params->priority - (*((struct bouquet_option **)a))->params->priority;
+static void match_bouquet(struct bouquet_ctx *ctx, struct bouquet_state *st)
+{
+	st->stamp = ++ctx->stamp;
+	matcher_match(ctx->bouquet_rules.matcher, st->bp->bouquet_name, st->hits, st->stamp);
 }
 
-static int bouquet_parse_options(struct bouquet_config *cfg, const char *optstring)
+static void set_bouquet_name(struct bouquet_ctx *ctx, struct bouquet_state *st, const char *name)
+{
+	free(st->bp->bouquet_name);
+	st->bp->bouquet_name = strdup(name);
+	match_bouquet(ctx, st);
+}
+
+// merge=target,pattern,pattern,...
+// rename=old,new
+// ignore=pattern,pattern,...
+// Names are matched once and again only when a rule changes them, the
+// rules then just test the hits of each bouquet.
+static void apply_bouquet_rules(struct bouquet_ctx *ctx)
 {
+	struct rule_set *rs = &ctx->bouquet_rules;
 	struct bouquet_option *opt;
-	char *s1, *s2, *tok1, *tok2, *save1, *save2;
-	struct bouquet_option_params *params;
-	int i, ret;
-	ARRAY(args, char *, 16);
-	ARRAY(opts, struct bouquet_option *, 16);
+	struct bouquet_state *st, *target;
+	struct bouquet_state tmp;
+	struct bouquet *bp;
+	uint32_t *hits;
+	uint64_t key;
+	int i, j;
 
-	cfg->opt_buf = strdup(optstring);
-	for (s1 = cfg->opt_buf; (tok1 = strtok_r(s1, ";", &save1)) != NULL; s1 = NULL) {
-		ARRAY_RESET(args);
-		s2 = strchr(tok1, '=');
-		if (s2 != NULL)
-			*s2++ = '\0';
-		else
-			s2 = tok1 + strlen(tok1);
-		ARRAY_APPEND(args, tok1);
-		for (; (tok2 = strtok_r(s2, ",", &save2)) != NULL; s2 = NULL) {
-			ARRAY_APPEND(args, tok2);
-		}
-		params = NULL;
-		for (i = 0; i < sizeof(option_params)/sizeof(struct bouquet_option_params); i++) {
-			if (strcmp(args.buf[0], option_params[i].option_name) == 0) {
-				params = &option_params[i];
+	ARRAY(states, struct bouquet_state, 32);
+
+	if (rs->n_rules == 0)
+		return;
+
+	HMAP_FOREACH(&ctx->bouquets, key, bp,
+		tmp.bp = bp;
+		ARRAY_APPEND(states, tmp);
+	);
+	hits = calloc(states.len * rs->n_rules + 1, sizeof(uint32_t));
+	for (j = 0; j < states.len; j++) {
+		states.buf[j].hits = hits + j * rs->n_rules;
+		match_bouquet(ctx, &states.buf[j]);
+	}
+
+	for (i = 0; i < rs->n_rules; i++) {
+		opt = rs->rules[i];
+		target = NULL;
+		for (j = 0; j < states.len; j++) {
+			st = &states.buf[j];
+			if (!st->bp || !rule_in_scope(opt, st->bp->network_id, st->bp->position))
+				continue;
+			switch (opt->params->type) {
+			case RULE_MERGE:
+				if (st->hits[i] != st->stamp)
+					break;
+				opt->hits++;
+				if (target == NULL) {
+					// becomes a new target
+					target = st;
+					set_bouquet_name(ctx, st, opt->argv[1]);
+				} else {
+					merge_into(ctx, target->bp, st->bp);
+					st->bp = NULL;
+				}
+				break;
+			case RULE_RENAME:
+				if (strcmp(opt->argv[1], st->bp->bouquet_name) != 0)
+					break;
+				opt->hits++;
+				set_bouquet_name(ctx, st, opt->argv[2]);
+				break;
+			case RULE_IGNORE:
+				if (st->hits[i] != st->stamp)
+					break;
+				opt->hits++;
+				hmap_remove(&ctx->bouquets, st->bp->key);
+				bouquet_entry_free(st->bp);
+				st->bp = NULL;
+				break;
+			default:
 				break;
 			}
 		}
-		if (params) {
-			if (
-				(params->min_args >= 0 && args.len - 1 < params->min_args) ||
-				(params->max_args >= 0 && args.len - 1 > params->max_args)
-			) {
-				error("Invalid number of arguments for bouquet option '%s'\n", args.buf[0]);
-				goto error;
+	}
+	free(hits);
+	ARRAY_CLEAN(states);
+}
+
+// remove=pattern,pattern,...
+static void apply_remove_rules(struct bouquet_ctx *ctx)
+{
+	struct rule_set *rs = &ctx->remove_rules;
+	struct bouquet_option *opt;
+	struct bouquet *bp;
+	uint64_t key;
+	int i, matched;
+
+	ARRAY(removed, struct bouquet *, 16);
+
+	if (rs->n_rules == 0)
+		return;
+	HMAP_FOREACH(&ctx->bouquets, key, bp,
+		if (matcher_match(rs->matcher, bp->bouquet_name, rs->hits, ++ctx->stamp) == 0)
+			continue;
+		matched = 0;
+		for (i = 0; i < rs->n_rules; i++) {
+			opt = rs->rules[i];
+			if (rs->hits[i] == ctx->stamp && rule_in_scope(opt, bp->network_id, bp->position)) {
+				opt->hits++;
+				matched = 1;
 			}
-		} else {
-			error("Invalid bouquet option: '%s'\n", args.buf[0]);
-			goto error;
 		}
-		opt = malloc(sizeof(struct bouquet_option));
-		opt->argc = args.len;
-		opt->argv = malloc((opt->argc + 1) * sizeof(char *));
-		for (i = 0; i < opt->argc; i++)
-			opt->argv[i] = args.buf[i];
-		opt->argv[opt->argc] = NULL;
-		opt->params = params;
-		ARRAY_APPEND(opts, opt);
-	}
-	qsort(opts.buf, opts.len, sizeof(struct bouquet_option *), cmp_option);
-	ARRAY_APPEND(opts, NULL);
-	cfg->options = opts.buf;
-	ret = 0;
-	goto cleanup;
-error:
-	ret = -1;
-	for (i = 0; i < opts.len; i++)
-		free(opts.buf[i]->argv);
-	ARRAY_CLEAN(opts);
-cleanup:
-	ARRAY_CLEAN(args);
-	return ret;
+		if (matched) {
+			ARRAY_APPEND(removed, bp);
+		}
+	);
+	ARRAY_FOREACH(removed, bp,
+		hmap_remove(&ctx->bouquets, bp->key);
+		bouquet_entry_free(bp);
+	);
+	ARRAY_CLEAN(removed);
 }
 
-static void bouquet_process_options(struct bouquet_ctx *ctx, int stage)
+// rules that never applied are candidates for removal
+void bouquet_report_rules(struct bouquet_ctx *ctx)
 {
 	struct bouquet_option **opt;
+	int i, n_rules, n_unused;
+
+	n_rules = n_unused = 0;
+	for (opt = ctx->cfg.options; *opt != NULL; opt++) {
+		if ((*opt)->params->type == RULE_LANG)
+			continue;
+		n_rules++;
+		if ((*opt)->hits == 0)
+			n_unused++;
+	}
+	if (n_rules == 0)
+		return;
 
+	info("Bouquet rule hits:\n");
 	for (opt = ctx->cfg.options; *opt != NULL; opt++) {
-		if ((*opt)->params->stage & stage)
-			(*opt)->params->action(ctx, (*opt)->argc, (*opt)->argv);
+		if ((*opt)->params->type == RULE_LANG)
+			continue;
+		if ((*opt)->file)
+			info("%8u  %s:%d: ", (*opt)->hits, (*opt)->file, (*opt)->line);
+		else
+			info("%8u  option %d: ", (*opt)->hits, (*opt)->line);
+		if ((*opt)->scope)
+			info("[%s] ", (*opt)->scope->text);
+		info("%s=", (*opt)->argv[0]);
+		for (i = 1; i < (*opt)->argc; i++)
+			info("%s%s", (i > 1)? "," : "", (*opt)->argv[i]);
+		info("%s\n", ((*opt)->hits == 0)? "  (unused)" : "");
 	}
+	info("Unused bouquet rules: %d of %d\n", n_unused, n_rules);
 }
 
 void bouquet_free(struct bouquet_ctx *ctx)
 {
 	struct bouquet_option **opt;
+	struct bouquet *bp;
+	struct bouquet_member *m;
+	uint64_t key;
+	int i;
 
 	if (ctx->cfg.languages) free(ctx->cfg.languages);
 	if (ctx->cfg.opt_buf) free(ctx->cfg.opt_buf);
 	if (ctx->cfg.options) {
-		for (opt = ctx->cfg.options; *opt != NULL; opt++)
+		for (opt = ctx->cfg.options; *opt != NULL; opt++) {
 			free((*opt)->argv);
+			free(*opt);
+		}
 		free(ctx->cfg.options);
 	}
-	htable_free(&ctx->bouquets);
+	for (i = 0; i < ctx->cfg.n_allocs; i++)
+		free(ctx->cfg.allocs[i]);
+	free(ctx->cfg.allocs);
+	if (ctx->unmapped) free(ctx->unmapped);
+	rule_set_free(&ctx->service_rules);
+	rule_set_free(&ctx->bouquet_rules);
+	rule_set_free(&ctx->remove_rules);
+	HMAP_FOREACH(&ctx->bouquets, key, bp,
+		bouquet_entry_free(bp);
+	);
+	hmap_free(&ctx->bouquets);
+	HMAP_FOREACH(&ctx->members, key, m,
+		free(m->bouquets);
+		free(m);
+	);
+	hmap_free(&ctx->members);
 	free(ctx);
 }
 
@@ -464,16 +962,28 @@ struct bouquet_ctx *bouquet_create(const char *optstring)
 
 	ctx->cfg.languages = NULL;
 	ctx->cfg.options = NULL;
+	ctx->cfg.n_options = 0;
 	ctx->cfg.opt_buf = NULL;
-
-	htable_init(&ctx->bouquets, 32, 0);
+	ctx->cfg.allocs = NULL;
+	ctx->cfg.n_allocs = 0;
+	ctx->prepared = 0;
+	ctx->unmapped = NULL;
+	ctx->n_unmapped = 0;
+
+	hmap_init(&ctx->bouquets, 32);
+	hmap_init(&ctx->members, 1024);
+	ctx->next_user_key = USER_BOUQUET_KEY;
+	memset(&ctx->service_rules, 0, sizeof(struct rule_set));
+	memset(&ctx->bouquet_rules, 0, sizeof(struct rule_set));
+	memset(&ctx->remove_rules, 0, sizeof(struct rule_set));
+	ctx->stamp = 0;
 
 	if (bouquet_parse_options(&ctx->cfg, optstring) != 0) {
 		bouquet_free(ctx);
 		return NULL;
 	}
 
-	bouquet_process_options(ctx, STAGE_PRE_SCAN);
+	bouquet_compile_options(ctx);
 
 	return ctx;
 }
@@ -517,6 +1027,17 @@ const char *bouquet_help_msg()
 		"    set this option if your provider broadcasts bouquet names in your native\n"
 		"    language as multilingual.\n"
 		"\n"
+		"rules=FILE,FILE,...\n"
+		"    Read options from rules files, one OPTION=VALUE,VALUE,... per line.\n"
+		"    Lines starting with '#' are comments, 'include FILE' reads another file\n"
+		"    (relative to the including one). A line\n"
+		"        [onid 0x1,0x2]  or  [position 19.2E,13.0E]\n"
+		"    restricts the following options to services and bouquets of these\n"
+		"    original network ids or orbital positions, until the next such line\n"
+		"    or [global], or the end of the file. The options from all sources are\n"
+		"    checked before the scan, how often each one applied is logged after\n"
+		"    the output.\n"
+		"\n"
 		"\n";
 	return msg;
 }
@@ -532,15 +1053,12 @@ static char *name_utf8(const unsigned char *desc_buf, int desc_len)
 	return r;
 }
 
-static void add_service(struct bouquet *bp, int nid, int tid, int sid, int stype)
+static void add_service(struct bouquet_ctx *ctx, struct bouquet *bp, int nid, int tid, int sid, int stype)
 {
-	struct bouquet_service s, *sp;
+	uint64_t key = service_key(nid, tid, sid);
 
-	init_service(&s, nid, tid, sid);
-	if (htable_lookup(&bp->services, &s.hash) == NULL) {
-		sp = malloc(sizeof(struct bouquet_service));
-		init_service(sp, nid, tid, sid);
-		htable_insert(&bp->services, &sp->hash);
+	if (hmap_get(&bp->services, key) == NULL) {
+		bouquet_add_service(ctx, bp, key);
 		debug("== bouquet(%d):%s<--tid=%d,sid=%d,nid=%d,type=%d\n", bp->bouquet_id, (bp->bouquet_name)? bp->bouquet_name : "NULL", tid, sid, nid, stype);
 	}
 }
@@ -577,15 +1095,11 @@ void bouquet_parse_bat(struct bouquet_ctx *ctx, const unsigned char *buf,
 	char lang[4];
 	const char **lp;
 
-	struct bouquet b, *bp;
-	struct htable_entry *p;
+	struct bouquet *bp;
 
-	bouquet_init_key(&b, bouquet_id);
-	if ((p = htable_lookup(&ctx->bouquets, &b.hash)) == NULL) {
-		bp = bouquet_entry_create(bouquet_id, NULL, NULL);
-		htable_insert(&ctx->bouquets, &bp->hash);
-	} else {
-		bp = container_of(p, struct bouquet, hash);
+	if ((bp = hmap_get(&ctx->bouquets, bouquet_id)) == NULL) {
+		bp = bouquet_entry_create(bouquet_id, bouquet_id, NULL, NULL);
+		hmap_put(&ctx->bouquets, bp->key, bp);
 	}
 
 	// bouquet descriptors - look for a bouquet name
@@ -610,8 +1124,8 @@ void bouquet_parse_bat(struct bouquet_ctx *ctx, const unsigned char *buf,
 						lang[3] = '\0';
 						ml_name_len = getBits(desc_buf + 3, 0, 8);
 						desc_buf += 4;
-						for (lp = ctx->cfg.languages; lp != NULL; lp++) {
-							if (pattern_match(*lp, lang) == 0) {
+						for (lp = ctx->cfg.languages; lp && *lp; lp++) {
+							if (glob_match(*lp, lang)) {
 								bp->bouquet_ml_name = name_utf8(desc_buf, ml_name_len);
 								break;
 							}
@@ -633,7 +1147,9 @@ void bouquet_parse_bat(struct bouquet_ctx *ctx, const unsigned char *buf,
 					tid = getBits(desc_buf + 0, 0, 16);
 					nid = getBits(desc_buf + 2, 0, 16);
 					sid = getBits(desc_buf + 4, 0, 16);
-					add_service(bp, nid, tid, sid, -1);
+					if (bp->network_id < 0)
+						bp->network_id = nid;
+					add_service(ctx, bp, nid, tid, sid, -1);
 				}
 				break;
 		}
@@ -651,6 +1167,8 @@ void bouquet_parse_bat(struct bouquet_ctx *ctx, const unsigned char *buf,
 		nid = getBits(buf + 2, 0, 16);
 		descriptors_loop_len = getBits(buf + 4, 4, 12);
 		buf += 6;
+		if (bp->network_id < 0)
+			bp->network_id = nid;
 		// service list descriptors loop (actually only one descriptor)
 		DESCRIPTORS_LOOP(
 			if (desc_tag == 0x41) {
@@ -658,68 +1176,49 @@ void bouquet_parse_bat(struct bouquet_ctx *ctx, const unsigned char *buf,
 				for (;desc_len >= 3; desc_len -= 3, desc_buf += 3) {
 					sid = getBits(desc_buf, 0, 16);
 					service_type = getBits(desc_buf + 2, 0, 8);
-					add_service(bp, nid, tid, sid, service_type);
+					add_service(ctx, bp, nid, tid, sid, service_type);
 				}
 			}
 		);
 	}
 }
 
-struct bouquet_service_pair {
+// a service to output, m is NULL for unsorted ones
+struct bouquet_dump_entry {
 	struct transponder *tp;
 	struct service *sp;
+	struct bouquet_member *m;
 };
 
-static int cmp_bouquet_name(const void *a, const void *b)
-{
-	//return (*(struct bouquet **)a)->bouquet_id - (*(struct bouquet **)b)->bouquet_id;
-	return strcmp(
-		(*(struct bouquet **)a)->bouquet_name,
-		(*(struct bouquet **)b)->bouquet_name
-	);
-}
-
-static int cmp_bouquet_service(const void *a, const void *b)
-{
-//	return ((struct bouquet_service_pair *)a)->sp->service_id - ((struct bouquet_service_pair *)b)->sp->service_id;
-	return strcmp(
-		((struct bouquet_service_pair *)a)->sp->service_name,
-		((struct bouquet_service_pair *)b)->sp->service_name
-	);
-}
-
 #define STRIP_SPACE(var, tmpvar) 	\
 	if ((var)) {					\
 		tmpvar = strip_space(var);	\
-		if ((tmpvar) != (var)) {	\
-			free(var);				\
-			var = strdup(tmpvar);	\
-		}							\
+		if ((tmpvar) != (var))		\
+			memmove(var, tmpvar, strlen(tmpvar) + 1);	\
 	} else {						\
 		var = strdup("");			\
 	}
 
 
-void bouquet_dump(struct bouquet_ctx *ctx, struct list_head *scanned_transponders,
-		int ca_select, int serv_select,
-		void (*dump_service_cb)(struct transponder *, struct service *))
+void bouquet_prepare(struct bouquet_ctx *ctx, struct list_head *scanned_transponders,
+		int ca_select, int serv_select)
 {
 	struct list_head *p1, *p2;
 	struct transponder *tp;
 	struct service *sp;
 	struct bouquet *bp;
-	struct bouquet_service bs, *bsp;
-	struct bouquet_service_pair pair;
-	int n_bouquets, n_mapped, n_unmapped;
+	struct bouquet_member *m;
+	uint64_t key;
 	char *str;
-	struct htable uniq_channels;
 
-	ARRAY(barr, struct bouquet *, 32);
-	ARRAY(sarr, struct bouquet_service_pair, 1000);
 	ARRAY(uarr, struct bouquet_service_pair, 1000);
 
+	if (ctx->prepared)
+		return;
+	ctx->prepared = 1;
+
 	// set bouquet name, strip leading and trailing spaces
-	HTABLE_FOREACH(&ctx->bouquets, bp, struct bouquet, hash,
+	HMAP_FOREACH(&ctx->bouquets, key, bp,
 		if (bp->bouquet_ml_name) {
 			if (bp->bouquet_name)
 				free(bp->bouquet_name);
@@ -729,94 +1228,174 @@ void bouquet_dump(struct bouquet_ctx *ctx, struct list_head *scanned_transponder
 		STRIP_SPACE(bp->bouquet_name, str);
 	);
 
-	// strip leading and trailing spaces
+	ctx->scanned_transponders = scanned_transponders;
+	ctx->serv_select = serv_select;
+	ctx->ca_select = ca_select;
+
+	HMAP_FOREACH(&ctx->bouquets, key, bp,
+		if (bp->network_id >= 0)
+			bp->position = network_position(ctx, bp->network_id);
+	);
+
+	// strip leading and trailing spaces, then the service rules in one pass
+	resolve_targets(ctx);
 	list_for_each(p1, scanned_transponders) {
 		tp = list_entry(p1, struct transponder, list);
 		list_for_each(p2, &tp->services) {
 			sp = list_entry(p2, struct service, list);
 			STRIP_SPACE(sp->service_name, str);
+			if (SERVICE_CHECK(sp))
+				apply_service_rules(ctx, tp, sp);
 		}
 	}
+	apply_bouquet_rules(ctx);
 
-	ctx->scanned_transponders = scanned_transponders;
-	ctx->serv_select = serv_select;
-	ctx->ca_select = ca_select;
-	bouquet_process_options(ctx, STAGE_POST_SCAN);
+	ctx->n_mapped = 0;
 
-	n_bouquets = 0;
-	n_mapped = 0;
-	n_unmapped = 0;
-
-	// map to bouquet services
+	// map to bouquet services, one lookup in the reverse index per service
 	list_for_each(p1, scanned_transponders) {
 		tp = list_entry(p1, struct transponder, list);
 		list_for_each(p2, &tp->services) {
-			struct htable_entry *entry;
 			int mapped;
 
 			sp = list_entry(p2, struct service, list);
 			if (!SERVICE_CHECK(sp))
 				continue;
-			init_service(&bs, tp->original_network_id, tp->transport_stream_id, sp->service_id);
-			mapped = 0;
-			HTABLE_FOREACH(&ctx->bouquets, bp, struct bouquet, hash,
-				if ((entry = htable_lookup(&bp->services, &bs.hash)) != NULL) {
-					bsp = container_of(entry, struct bouquet_service, hash);
-					bsp->tp = tp;
-					bsp->sp = sp;
-					mapped = 1;
-					//debug("-- MAP:%s->%s=\n", sp->service_name, bp->bouquet_name);
-				}
-			);
+			key = service_key(tp->original_network_id, tp->transport_stream_id, sp->service_id);
+			m = hmap_get(&ctx->members, key);
+			mapped = m && m->n_bouquets;
+			if (mapped) {
+				m->tp = tp;
+				m->sp = sp;
+			}
 			if (!mapped) {
 				struct bouquet_service_pair tmp = {tp, sp};
 				ARRAY_APPEND(uarr, tmp);
-				n_unmapped++;
 				//debug("-- UNSORTED:%s\n", sp->service_name);
 			} else
-				n_mapped++;
+				ctx->n_mapped++;
 		}
 	}
 
-	bouquet_process_options(ctx, STAGE_PRE_OUTPUT);
+	apply_remove_rules(ctx);
+
+	ctx->unmapped = uarr.buf;
+	ctx->n_unmapped = uarr.len;
+}
+
+int bouquet_service_membership(struct bouquet_ctx *ctx, struct transponder *tp,
+		struct service *sp, const char **names, int max_names)
+{
+	struct bouquet_member *m;
+	int n;
+
+	m = hmap_get(&ctx->members,
+		service_key(tp->original_network_id, tp->transport_stream_id, sp->service_id));
+	if (!m || m->sp != sp)
+		return 0;
+	for (n = 0; n < m->n_bouquets && n < max_names; n++)
+		names[n] = m->bouquets[n]->bouquet_name;
+	return n;
+}
 
-	HTABLE_FOREACH(&ctx->bouquets, bp, struct bouquet, hash,
+void bouquet_dump(struct bouquet_ctx *ctx, struct list_head *scanned_transponders,
+		int ca_select, int serv_select, int sort_flags,
+		void (*dump_service_cb)(struct transponder *, struct service *))
+{
+	struct bouquet *bp;
+	struct bouquet_member *m;
+	struct bouquet_dump_entry e, *out;
+	struct collate *coll;
+	uint64_t key;
+	int i, j, n_bouquets, n_channels, *first, *pos, *order;
+	int coll_flags = (sort_flags & BOUQUET_SORT_LOCALE)? COLLATE_LOCALE : 0;
+
+	ARRAY(barr, struct bouquet *, 32);
+	ARRAY(sarr, struct bouquet_dump_entry, 1000);
+
+	bouquet_prepare(ctx, scanned_transponders, ca_select, serv_select);
+
+	n_bouquets = 0;
+	coll = collate_create(coll_flags, hmap_len(&ctx->bouquets));
+	HMAP_FOREACH(&ctx->bouquets, key, bp,
 		ARRAY_APPEND(barr, bp);
+		collate_add(coll, bp->bouquet_name, 0);
 		n_bouquets++;
 	);
-	qsort(barr.buf, barr.len, sizeof(struct bouquet *), cmp_bouquet_name);
-
-	htable_init(&uniq_channels, 256, 0);
+	order = malloc((barr.len + 1) * sizeof(int));
+	collate_sort(coll, order);
+	for (i = 0; i < barr.len; i++)
+		barr.buf[order[i]]->dump_index = i;
+	for (i = 0; i < barr.len; i++)
+		barr.buf[i] = NULL;
+	HMAP_FOREACH(&ctx->bouquets, key, bp,
+		barr.buf[bp->dump_index] = bp;
+	);
+	collate_free(coll);
+	free(order);
+
+	// every service once, sorted once
+	HMAP_FOREACH(&ctx->members, key, m,
+		if (m->tp == NULL || m->sp == NULL || m->n_bouquets == 0)
+			continue;
+		e.tp = m->tp;
+		e.sp = m->sp;
+		e.m = m;
+		ARRAY_APPEND(sarr, e);
+	);
+	n_channels = sarr.len;
+	for (i = 0; i < ctx->n_unmapped; i++) {
+		e.tp = ctx->unmapped[i].tp;
+		e.sp = ctx->unmapped[i].sp;
+		e.m = NULL;
+		ARRAY_APPEND(sarr, e);
+	}
+	coll = collate_create(coll_flags, sarr.len);
+	ARRAY_FOREACH(sarr, e,
+		collate_add(coll, e.sp->service_name,
+			(sort_flags & BOUQUET_SORT_LCN)? lcn_rank(e.sp) : 0);
+	);
+	order = malloc((sarr.len + 1) * sizeof(int));
+	collate_sort(coll, order);
+	collate_free(coll);
+
+	// spread them over their bouquets in that order, the unsorted ones
+	// go into the last slot
+	first = calloc(barr.len + 2, sizeof(int));
+	pos = calloc(barr.len + 1, sizeof(int));
+	ARRAY_FOREACH(sarr, e,
+		if (e.m == NULL)
+			first[barr.len + 1]++;
+		for (j = 0; e.m && j < e.m->n_bouquets; j++)
+			first[e.m->bouquets[j]->dump_index + 1]++;
+	);
+	for (i = 0; i <= barr.len; i++) {
+		first[i + 1] += first[i];
+		pos[i] = first[i];
+	}
+	out = malloc((first[barr.len + 1] + 1) * sizeof(struct bouquet_dump_entry));
+	for (i = 0; i < sarr.len; i++) {
+		e = sarr.buf[order[i]];
+		if (e.m == NULL)
+			out[pos[barr.len]++] = e;
+		for (j = 0; e.m && j < e.m->n_bouquets; j++)
+			out[pos[e.m->bouquets[j]->dump_index]++] = e;
+	}
 
 	// output per bouquet
-	ARRAY_FOREACH(barr, bp,
-		ARRAY_RESET(sarr);
-		HTABLE_FOREACH(&bp->services, bsp, struct bouquet_service, hash,
-			struct bouquet_service_pair tmp;
-			if (bsp->tp == NULL || bsp->sp == NULL)
-				continue;
-			tmp.tp = bsp->tp;
-			tmp.sp = bsp->sp;
-			ARRAY_APPEND(sarr, tmp);
-			if (!htable_lookup(&uniq_channels, &bsp->hash))
-				htable_insert(&uniq_channels, &bsp->hash);
-		);
-		if (sarr.len) {
-			qsort(sarr.buf, sarr.len, sizeof(struct bouquet_service_pair), cmp_bouquet_service);
-			fprintf(stdout, ":%s\n", bp->bouquet_name);
-			ARRAY_FOREACH(sarr, pair,
-				dump_service_cb(pair.tp, pair.sp);
-			);
-		}
-	);
+	for (i = 0; i < barr.len; i++) {
+		if (first[i] == first[i + 1])
+			continue;
+		fprintf(stdout, ":%s\n", barr.buf[i]->bouquet_name);
+		for (j = first[i]; j < first[i + 1]; j++)
+			dump_service_cb(out[j].tp, out[j].sp);
+	}
 
 	// unsorted
-	if (uarr.len) {
-		qsort(uarr.buf, uarr.len, sizeof(struct bouquet_service_pair), cmp_bouquet_service);
+	if (ctx->n_unmapped) {
 		fprintf(stdout, ":==UNSORTED==\n");
-		ARRAY_FOREACH(uarr, pair,
-			dump_service_cb(pair.tp, pair.sp);
-		);
+		for (j = first[barr.len]; j < first[barr.len + 1]; j++)
+			dump_service_cb(out[j].tp, out[j].sp);
 	}
 
 	info("\
@@ -827,11 +1406,13 @@ Unmapped services:  %d\n\
 Channels:           %d\n\
 ==============================\n\
 ",
-		n_bouquets, n_mapped, n_unmapped, htable_len(&uniq_channels));
+		n_bouquets, ctx->n_mapped, ctx->n_unmapped, n_channels);
+	bouquet_report_rules(ctx);
 
+	free(first);
+	free(pos);
+	free(out);
+	free(order);
 	ARRAY_CLEAN(barr);
 	ARRAY_CLEAN(sarr);
-	ARRAY_CLEAN(uarr);
-	htable_free(&uniq_channels);
 }
-
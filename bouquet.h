@@ -9,10 +9,27 @@ extern void bouquet_free(struct bouquet_ctx *ctx);
 extern void bouquet_parse_bat(struct bouquet_ctx *ctx, const unsigned char *buf, 
 		int section_length, int bouquet_id, int version_number);
 
+// applies the post-scan options and maps scanned services to bouquets,
+// called implicitly by bouquet_dump()
+extern void bouquet_prepare(struct bouquet_ctx *ctx, struct list_head *scanned_transponders,
+		int ca_select, int serv_select);
+
+#define BOUQUET_NAMES_MAX	64
+
+// fills names of the bouquets the service belongs to, returns their count
+extern int bouquet_service_membership(struct bouquet_ctx *ctx, struct transponder *tp,
+		struct service *sp, const char **names, int max_names);
+
+#define BOUQUET_SORT_LCN		1	/* services by logical channel number, then name */
+#define BOUQUET_SORT_LOCALE		2	/* names in the collation of the locale */
+
 extern void bouquet_dump(struct bouquet_ctx *ctx, struct list_head *scanned_transponders,
-		int ca_select, int serv_select,
+		int ca_select, int serv_select, int sort_flags,
 		void (*dump_service_cb)(struct transponder *, struct service *));
 
+// logs how often each rule applied, bouquet_dump() does it at its end
+extern void bouquet_report_rules(struct bouquet_ctx *ctx);
+
 extern const char *bouquet_help_msg();
 
 #endif
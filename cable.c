@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cable.h"
+
+// weight of a lock in a previous scan and of the files of the region
+#define LEARNED_WEIGHT		16
+#define REGION_WEIGHT		4
+
+// C lines of the dvb-c/ files per country, the rest of the name ignored
+static const struct {
+	const char *region;
+	uint32_t symbol_rate;
+	fe_modulation_t modulation;
+	unsigned int count;
+} builtin[] = {
+	{ "at", 6900000, QAM_64, 28 },
+	{ "at", 6875000, QAM_64, 7 },
+	{ "at", 6900000, QAM_256, 7 },
+	{ "be", 6875000, QAM_256, 12 },
+	{ "be", 6875000, QAM_64, 1 },
+	{ "br", 5217000, QAM_256, 1 },
+	{ "ch", 6900000, QAM_64, 3 },
+	{ "de", 6900000, QAM_64, 28 },
+	{ "de", 6875000, QAM_64, 19 },
+	{ "de", 6900000, QAM_256, 5 },
+	{ "fi", 6900000, QAM_128, 21 },
+	{ "fi", 6875000, QAM_64, 12 },
+	{ "fi", 5900000, QAM_128, 1 },
+	{ "lu", 6900000, QAM_64, 10 },
+	{ "lu", 3450000, QAM_64, 6 },
+	{ "no", 6950000, QAM_64, 12 },
+	{ "se", 6875000, QAM_64, 1 },
+};
+
+static const struct {
+	const char *str;
+	fe_modulation_t modulation;
+} qam_names[] = {
+	{ "QAM16", QAM_16 },
+	{ "QAM32", QAM_32 },
+	{ "QAM64", QAM_64 },
+	{ "QAM128", QAM_128 },
+	{ "QAM256", QAM_256 },
+};
+
+struct cable_entry {
+	uint32_t symbol_rate;
+	fe_modulation_t modulation;
+	unsigned int files;			// all regions
+	unsigned int region;		// the selected one
+	unsigned int learned;
+};
+
+struct cable_priors {
+	struct cable_entry *e;
+	int n;
+	int size;
+};
+
+static struct cable_entry *get_entry(struct cable_priors *p, uint32_t sr, fe_modulation_t m)
+{
+	int i;
+
+	for (i = 0; i < p->n; i++) {
+		if (p->e[i].symbol_rate == sr && p->e[i].modulation == m)
+			return &p->e[i];
+	}
+	if (p->n == p->size) {
+		p->size = p->size ? p->size * 2 : 32;
+		p->e = realloc(p->e, p->size * sizeof(*p->e));
+	}
+	memset(&p->e[p->n], 0, sizeof(*p->e));
+	p->e[p->n].symbol_rate = sr;
+	p->e[p->n].modulation = m;
+	return &p->e[p->n++];
+}
+
+static unsigned int weight(const struct cable_entry *e)
+{
+	return e->files + REGION_WEIGHT * e->region + LEARNED_WEIGHT * e->learned;
+}
+
+struct cable_priors *cable_priors_create(const char *region)
+{
+	struct cable_priors *p = calloc(1, sizeof(*p));
+	struct cable_entry *e;
+	size_t i;
+
+	for (i = 0; i < sizeof(builtin) / sizeof(builtin[0]); i++) {
+		e = get_entry(p, builtin[i].symbol_rate, builtin[i].modulation);
+		e->files += builtin[i].count;
+		if (region && !strcmp(region, builtin[i].region))
+			e->region += builtin[i].count;
+	}
+	return p;
+}
+
+void cable_priors_free(struct cable_priors *p)
+{
+	if (!p)
+		return;
+	free(p->e);
+	free(p);
+}
+
+static const char *qam_str(fe_modulation_t m)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(qam_names) / sizeof(qam_names[0]); i++) {
+		if (qam_names[i].modulation == m)
+			return qam_names[i].str;
+	}
+	return NULL;
+}
+
+/* one "symbol_rate QAMnn locks" per line, '#' starts a comment */
+int cable_priors_load(struct cable_priors *p, const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char buf[128], qam[16];
+	unsigned int sr, n;
+	size_t i;
+
+	if (!f)
+		return -1;
+	while (fgets(buf, sizeof(buf), f)) {
+		if (buf[0] == '#' || sscanf(buf, "%u %15s %u", &sr, qam, &n) != 3)
+			continue;
+		for (i = 0; i < sizeof(qam_names) / sizeof(qam_names[0]); i++) {
+			if (!strcmp(qam, qam_names[i].str))
+				get_entry(p, sr, qam_names[i].modulation)->learned += n;
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+int cable_priors_save(const struct cable_priors *p, const char *path)
+{
+	FILE *f = fopen(path, "w");
+	int i;
+
+	if (!f)
+		return -1;
+	fprintf(f, "# scan-s2 cable locks: symbol_rate modulation count\n");
+	for (i = 0; i < p->n; i++) {
+		if (p->e[i].learned)
+			fprintf(f, "%u %s %u\n", p->e[i].symbol_rate,
+				qam_str(p->e[i].modulation), p->e[i].learned);
+	}
+	return fclose(f);
+}
+
+void cable_priors_learn(struct cable_priors *p, uint32_t symbol_rate, fe_modulation_t modulation)
+{
+	if (symbol_rate && qam_str(modulation))
+		get_entry(p, symbol_rate, modulation)->learned++;
+}
+
+static int by_weight(const void *a, const void *b)
+{
+	const struct cable_prior *x = a, *y = b;
+
+	if (x->weight != y->weight)
+		return (x->weight < y->weight)? 1 : -1;
+	return (x->symbol_rate < y->symbol_rate)? 1 : (x->symbol_rate > y->symbol_rate)? -1 : 0;
+}
+
+static int add_prior(struct cable_prior *c, int n, uint32_t sr, fe_modulation_t m, unsigned int w)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (c[i].symbol_rate == sr && c[i].modulation == m) {
+			c[i].weight += w;
+			return n;
+		}
+	}
+	c[n].symbol_rate = sr;
+	c[n].modulation = m;
+	c[n].weight = w;
+	return n + 1;
+}
+
+int cable_priors_list(const struct cable_priors *p, uint32_t symbol_rate,
+		fe_modulation_t modulation, struct cable_prior *out, int max)
+{
+	struct cable_prior *c = calloc(p->n + 1, sizeof(*c));
+	int i, n = 0;
+
+	for (i = 0; i < p->n; i++) {
+		if ((symbol_rate && p->e[i].symbol_rate != symbol_rate) ||
+			(modulation != QAM_AUTO && p->e[i].modulation != modulation))
+			continue;
+		n = add_prior(c, n, p->e[i].symbol_rate, p->e[i].modulation, weight(&p->e[i]));
+	}
+	// a symbol rate not seen before, with the QAMs in their overall order
+	if (n == 0 && symbol_rate) {
+		for (i = 0; i < p->n; i++) {
+			if (modulation == QAM_AUTO || p->e[i].modulation == modulation)
+				n = add_prior(c, n, symbol_rate, p->e[i].modulation, weight(&p->e[i]));
+		}
+	}
+	qsort(c, n, sizeof(*c), by_weight);
+	if (n > max)
+		n = max;
+	memcpy(out, c, n * sizeof(*c));
+	free(c);
+	return n;
+}
@@ -0,0 +1,40 @@
+#ifndef __CABLE_H__
+#define __CABLE_H__
+
+#include <stdint.h>
+#include <linux/dvb/frontend.h>
+
+/*
+ * Symbol rate and QAM of cable networks, in the order they are worth trying
+ * when a channel doesn't give them. The built-in counts come from the C
+ * lines of the dvb-c/ files, grouped by the country in the file name; a
+ * priors file adds the locks of previous scans.
+ */
+
+#define CABLE_MAX_TRIES		6
+
+struct cable_prior {
+	uint32_t symbol_rate;
+	fe_modulation_t modulation;
+	unsigned int weight;
+};
+
+struct cable_priors;
+
+// region is the country of the dvb-c/ file names, e.g. "de", NULL for none
+extern struct cable_priors *cable_priors_create(const char *region);
+extern void cable_priors_free(struct cable_priors *p);
+
+// locks of previous scans, -1 if the file can't be read
+extern int cable_priors_load(struct cable_priors *p, const char *path);
+extern int cable_priors_save(const struct cable_priors *p, const char *path);
+
+// a lock on these parameters
+extern void cable_priors_learn(struct cable_priors *p, uint32_t symbol_rate,
+		fe_modulation_t modulation);
+
+// the likeliest combinations first; symbol_rate 0 and QAM_AUTO match any
+extern int cable_priors_list(const struct cable_priors *p, uint32_t symbol_rate,
+		fe_modulation_t modulation, struct cable_prior *out, int max);
+
+#endif
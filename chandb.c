@@ -0,0 +1,196 @@
+/*
+ * Reader for the binary channel database, see chandb.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "chandb.h"
+
+static int table_ok(const struct chandb *db, uint32_t off, uint32_t count, uint32_t size)
+{
+	uint64_t end = (uint64_t)off + (uint64_t)count * size;
+
+	return off >= db->hdr->header_size && end <= db->size && (off % 4) == 0;
+}
+
+// the header and the service records of 1.0 files end before the stream fields
+static int has_streams(const struct chandb *db)
+{
+	return db->hdr->version_minor >= 1 &&
+		db->hdr->header_size >= sizeof(struct chandb_header) &&
+		db->hdr->svc_size >= sizeof(struct chandb_service);
+}
+
+int chandb_attach(struct chandb *db, const void *buf, size_t size)
+{
+	const struct chandb_header *h = buf;
+
+	db->base = buf;
+	db->size = size;
+	db->hdr = h;
+	db->mapped = 0;
+
+	// 1.0 is the smallest layout a reader has to accept
+	if (size < CHANDB_HEADER_SIZE_1_0 || memcmp(h->magic, CHANDB_MAGIC, sizeof(h->magic)) != 0 ||
+		h->byte_order != CHANDB_BYTE_ORDER ||
+		h->version_major != CHANDB_VERSION_MAJOR ||
+		h->file_size != size || h->header_size < CHANDB_HEADER_SIZE_1_0 ||
+		h->tp_size < CHANDB_TRANSPONDER_SIZE_1_1 ||
+		h->svc_size < CHANDB_SERVICE_SIZE_1_0)
+		goto invalid;
+
+	if (!table_ok(db, h->strings_off, h->strings_size, 1) ||
+		!table_ok(db, h->tp_off, h->tp_count, h->tp_size) ||
+		!table_ok(db, h->svc_off, h->svc_count, h->svc_size) ||
+		!table_ok(db, h->audio_off, h->audio_count, sizeof(struct chandb_audio)) ||
+		!table_ok(db, h->ca_off, h->ca_count, sizeof(uint16_t)) ||
+		!table_ok(db, h->index_off, h->index_count, sizeof(struct chandb_index)))
+		goto invalid;
+
+	if (has_streams(db) && !table_ok(db, h->stream_off, h->stream_count, sizeof(struct chandb_stream)))
+		goto invalid;
+
+	// every string lookup relies on the table being terminated
+	if (h->strings_size == 0 || db->base[h->strings_off + h->strings_size - 1] != '\0')
+		goto invalid;
+
+	return 0;
+
+invalid:
+	db->hdr = NULL;
+	errno = EINVAL;
+	return -1;
+}
+
+int chandb_open(struct chandb *db, const char *path)
+{
+	struct stat st;
+	void *p;
+	int fd, err;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return -1;
+	if (fstat(fd, &st) < 0) {
+		err = errno;
+		close(fd);
+		errno = err;
+		return -1;
+	}
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return -1;
+	if (chandb_attach(db, p, st.st_size) < 0) {
+		munmap(p, st.st_size);
+		errno = EINVAL;
+		return -1;
+	}
+	db->mapped = 1;
+	return 0;
+}
+
+void chandb_close(struct chandb *db)
+{
+	if (db->mapped)
+		munmap((void *)db->base, db->size);
+	db->base = NULL;
+	db->hdr = NULL;
+	db->size = 0;
+	db->mapped = 0;
+}
+
+static int cmp_key(const struct chandb_index *e, uint16_t onid, uint16_t tsid, uint16_t sid)
+{
+	if (e->onid != onid)
+		return e->onid < onid ? -1 : 1;
+	if (e->tsid != tsid)
+		return e->tsid < tsid ? -1 : 1;
+	if (e->sid != sid)
+		return e->sid < sid ? -1 : 1;
+	return 0;
+}
+
+const struct chandb_service *chandb_lookup(const struct chandb *db,
+		uint16_t onid, uint16_t tsid, uint16_t sid)
+{
+	const struct chandb_index *idx;
+	uint32_t lo, hi, mid;
+	int c;
+
+	if (!db->hdr)
+		return NULL;
+	idx = (const struct chandb_index *)(db->base + db->hdr->index_off);
+	lo = 0;
+	hi = db->hdr->index_count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		c = cmp_key(&idx[mid], onid, tsid, sid);
+		if (c == 0)
+			return chandb_service(db, idx[mid].service);
+		if (c < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return NULL;
+}
+
+const struct chandb_service *chandb_service(const struct chandb *db, uint32_t idx)
+{
+	if (!db->hdr || idx >= db->hdr->svc_count)
+		return NULL;
+	return (const struct chandb_service *)
+		(db->base + db->hdr->svc_off + (size_t)idx * db->hdr->svc_size);
+}
+
+const struct chandb_transponder *chandb_transponder(const struct chandb *db,
+		const struct chandb_service *s)
+{
+	if (!db->hdr || s->transponder >= db->hdr->tp_count)
+		return NULL;
+	return (const struct chandb_transponder *)
+		(db->base + db->hdr->tp_off + (size_t)s->transponder * db->hdr->tp_size);
+}
+
+const struct chandb_audio *chandb_audio(const struct chandb *db,
+		const struct chandb_service *s)
+{
+	if (!db->hdr || (uint64_t)s->audio + s->audio_count > db->hdr->audio_count)
+		return NULL;
+	return (const struct chandb_audio *)(db->base + db->hdr->audio_off) + s->audio;
+}
+
+const uint16_t *chandb_ca(const struct chandb *db, const struct chandb_service *s)
+{
+	if (!db->hdr || (uint64_t)s->ca + s->ca_count > db->hdr->ca_count)
+		return NULL;
+	return (const uint16_t *)(db->base + db->hdr->ca_off) + s->ca;
+}
+
+const struct chandb_stream *chandb_streams(const struct chandb *db,
+		const struct chandb_service *s)
+{
+	if (!db->hdr || !has_streams(db) ||
+		(uint64_t)s->stream + s->stream_count > db->hdr->stream_count)
+		return NULL;
+	return (const struct chandb_stream *)(db->base + db->hdr->stream_off) + s->stream;
+}
+
+const char *chandb_string(const struct chandb *db, uint32_t off)
+{
+	if (!db->hdr || off >= db->hdr->strings_size)
+		return "";
+	return (const char *)db->base + db->hdr->strings_off + off;
+}
+
+int chandb_has_signal(const struct chandb *db)
+{
+	return db->hdr && db->hdr->version_minor >= 2 &&
+		db->hdr->tp_size >= sizeof(struct chandb_transponder);
+}
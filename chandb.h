@@ -0,0 +1,200 @@
+#ifndef __CHANDB_H__
+#define __CHANDB_H__
+
+/*
+ * Binary channel database written by "scan-s2 -o chandb".
+ *
+ * The file is a header followed by five tables, all addressed by byte
+ * offsets from the start of the file so it can be mmap()ed anywhere and used
+ * in place:
+ *
+ *   strings       NUL terminated UTF-8, offset 0 is the empty string
+ *   transponders  struct chandb_transponder[]
+ *   services      struct chandb_service[], each refers to a transponder and
+ *                 to a slice of the audio and CA tables
+ *   audio         struct chandb_audio[]
+ *   ca            uint16_t[] CA system ids
+ *   index         struct chandb_index[] sorted by (onid, tsid, sid)
+ *   streams       struct chandb_stream[], every elementary stream of the
+ *                 PMT (since 1.1)
+ *
+ * Since 1.2 the transponder records end with the signal measured during the
+ * scan, see chandb_has_signal().
+ *
+ * Integers are stored in the byte order of the writing host; byte_order in
+ * the header lets a reader detect a foreign file. Readers must reject files
+ * with a major version they don't know, new fields are only appended to the
+ * records and announced by a minor version bump.
+ *
+ * This header and chandb.c don't depend on the rest of scan-s2 and can be
+ * copied into other projects.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CHANDB_MAGIC			"SCS2CHDB"
+#define CHANDB_BYTE_ORDER		0x01020304
+#define CHANDB_VERSION_MAJOR	1
+#define CHANDB_VERSION_MINOR	2
+
+#define CHANDB_NO_STREAM_ID		0xffffffff
+#define CHANDB_NO_SIGNAL		INT32_MIN
+
+struct chandb_header {
+	char magic[8];
+	uint32_t byte_order;
+	uint16_t version_major;
+	uint16_t version_minor;
+	uint32_t file_size;
+	uint32_t header_size;
+	uint32_t strings_off, strings_size;
+	uint32_t tp_off, tp_count, tp_size;
+	uint32_t svc_off, svc_count, svc_size;
+	uint32_t audio_off, audio_count;
+	uint32_t ca_off, ca_count;
+	uint32_t index_off, index_count;
+	uint32_t stream_off, stream_count;		/* 1.1 */
+};
+
+/* enum values are the ones of linux/dvb/frontend.h */
+struct chandb_transponder {
+	uint32_t frequency;
+	uint32_t symbol_rate;
+	uint32_t stream_id;			/* CHANDB_NO_STREAM_ID if not set */
+	uint32_t pls_code;
+	uint16_t network_id;
+	uint16_t original_network_id;
+	uint16_t transport_stream_id;
+	int16_t orbital_pos;		/* degrees * 10, negative is west */
+	uint8_t delivery_system;
+	uint8_t modulation;
+	uint8_t inversion;
+	uint8_t fec;
+	uint8_t fec_hp;
+	uint8_t fec_lp;
+	uint8_t rolloff;
+	uint8_t bandwidth;
+	uint8_t hierarchy;
+	uint8_t guard_interval;
+	uint8_t transmission_mode;
+	uint8_t polarisation;
+	uint8_t pls_mode;
+	uint8_t reserved[3];
+	int32_t signal;				/* 1.2: 0.001 dBm, CHANDB_NO_SIGNAL if not measured */
+	int32_t cnr;				/* 0.001 dB, mean of the samples, or CHANDB_NO_SIGNAL */
+	int32_t cnr_min;
+	uint32_t error_blocks;		/* uncorrected, as counted by the DVBv5 frontend */
+};
+
+#define CHANDB_SVC_SCRAMBLED	0x01
+
+struct chandb_service {
+	uint32_t name;				/* string offsets */
+	uint32_t provider;
+	uint32_t transponder;		/* index into the transponder table */
+	uint32_t audio;				/* first entry in the audio table */
+	uint32_t ca;				/* first entry in the CA table */
+	int32_t channel_num;
+	uint16_t audio_count;
+	uint16_t ca_count;
+	uint16_t service_id;
+	uint16_t pmt_pid;
+	uint16_t pcr_pid;
+	uint16_t video_pid;
+	uint16_t ac3_pid;
+	uint16_t teletext_pid;
+	uint16_t subtitling_pid;
+	uint8_t type;
+	uint8_t running;
+	uint8_t flags;
+	uint8_t reserved[3];
+	uint32_t stream;			/* 1.1: first entry in the stream table */
+	uint16_t stream_count;
+	uint16_t reserved2;
+};
+
+struct chandb_audio {
+	uint16_t pid;
+	uint16_t reserved;
+	char lang[4];				/* ISO 639-2, NUL terminated */
+};
+
+/* stream kinds */
+#define CHANDB_ES_VIDEO			0
+#define CHANDB_ES_AUDIO			1
+#define CHANDB_ES_AC3			2	/* AC3, E-AC3, DTS in private data */
+#define CHANDB_ES_TELETEXT		3
+#define CHANDB_ES_SUBTITLING	4
+#define CHANDB_ES_OTHER			5
+
+/* codecs, 0 if not known */
+#define CHANDB_CODEC_MPEG2_VIDEO	1
+#define CHANDB_CODEC_MPEG4_VIDEO	2
+#define CHANDB_CODEC_H264			3
+#define CHANDB_CODEC_HEVC			4
+#define CHANDB_CODEC_MPEG_AUDIO		5
+#define CHANDB_CODEC_AAC			6
+#define CHANDB_CODEC_AAC_LATM		7
+#define CHANDB_CODEC_AC3			8
+#define CHANDB_CODEC_EAC3			9
+#define CHANDB_CODEC_DTS			10
+
+struct chandb_stream {
+	uint16_t pid;
+	uint8_t stream_type;		/* of the PMT */
+	uint8_t kind;				/* CHANDB_ES_* */
+	char lang[4];				/* ISO 639-2, NUL terminated */
+	int16_t component_tag;		/* -1 if not signalled */
+	uint8_t codec;				/* CHANDB_CODEC_* */
+	uint8_t subtype;			/* audio_type, subtitling_type or teletext_type */
+	uint16_t page;				/* subtitling composition page, teletext
+								 * magazine << 8 | page */
+	uint16_t reserved;
+};
+
+struct chandb_index {
+	uint16_t onid;
+	uint16_t tsid;
+	uint16_t sid;
+	uint16_t reserved;
+	uint32_t service;			/* index into the service table */
+};
+
+// record sizes before the stream table was added
+#define CHANDB_HEADER_SIZE_1_0		offsetof(struct chandb_header, stream_off)
+#define CHANDB_SERVICE_SIZE_1_0		offsetof(struct chandb_service, stream)
+// and before the signal fields
+#define CHANDB_TRANSPONDER_SIZE_1_1	offsetof(struct chandb_transponder, signal)
+
+struct chandb {
+	const unsigned char *base;
+	size_t size;
+	const struct chandb_header *hdr;
+	int mapped;
+};
+
+// maps and validates the file, returns 0 or -1 with errno set
+extern int chandb_open(struct chandb *db, const char *path);
+// uses a database already in memory
+extern int chandb_attach(struct chandb *db, const void *buf, size_t size);
+extern void chandb_close(struct chandb *db);
+
+// binary search on the (onid, tsid, sid) index, NULL if not found
+extern const struct chandb_service *chandb_lookup(const struct chandb *db,
+		uint16_t onid, uint16_t tsid, uint16_t sid);
+
+extern const struct chandb_service *chandb_service(const struct chandb *db, uint32_t idx);
+extern const struct chandb_transponder *chandb_transponder(const struct chandb *db,
+		const struct chandb_service *s);
+extern const struct chandb_audio *chandb_audio(const struct chandb *db,
+		const struct chandb_service *s);
+extern const uint16_t *chandb_ca(const struct chandb *db, const struct chandb_service *s);
+// NULL for files before 1.1
+extern const struct chandb_stream *chandb_streams(const struct chandb *db,
+		const struct chandb_service *s);
+extern const char *chandb_string(const struct chandb *db, uint32_t off);
+// the transponders have the signal fields (1.2)
+extern int chandb_has_signal(const struct chandb *db);
+
+#endif
@@ -0,0 +1,257 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "collate.h"
+
+struct collate_item {
+	uint64_t prefix;	// first 8 key bytes, big endian, zero padded
+	uint32_t major;
+	uint32_t off;		// key in collate.keys
+	uint32_t len;
+	uint32_t index;
+};
+
+struct collate {
+	int flags;
+	struct collate_item *items;
+	int n_items;
+	int size;
+	char *keys;
+	size_t keys_len;
+	size_t keys_size;
+};
+
+struct collate *collate_create(int flags, int size_hint)
+{
+	struct collate *c = calloc(1, sizeof(struct collate));
+
+	c->flags = flags;
+	c->size = (size_hint > 0)? size_hint : 16;
+	c->items = malloc(c->size * sizeof(struct collate_item));
+	c->keys_size = c->size * 16;
+	c->keys = malloc(c->keys_size);
+	return c;
+}
+
+void collate_free(struct collate *c)
+{
+	if (!c)
+		return;
+	free(c->items);
+	free(c->keys);
+	free(c);
+}
+
+static void reserve(struct collate *c, size_t len)
+{
+	if (c->keys_len + len > c->keys_size) {
+		c->keys_size = (c->keys_len + len) * 2;
+		c->keys = realloc(c->keys, c->keys_size);
+	}
+}
+
+// simple case folding of the scripts found in channel names
+static uint32_t fold(uint32_t cp)
+{
+	if (cp >= 'A' && cp <= 'Z')
+		return cp + 0x20;
+	if (cp < 0xc0)
+		return cp;
+	if (cp <= 0xde && cp != 0xd7)					// Latin-1
+		return cp + 0x20;
+	if (cp >= 0x100 && cp <= 0x137 && !(cp & 1))	// Latin Extended-A
+		return cp + 1;
+	if (cp >= 0x139 && cp <= 0x148 && (cp & 1))
+		return cp + 1;
+	if (cp >= 0x14a && cp <= 0x177 && !(cp & 1))
+		return cp + 1;
+	if (cp == 0x178)
+		return 0xff;
+	if (cp >= 0x179 && cp <= 0x17e && (cp & 1))
+		return cp + 1;
+	if (cp >= 0x391 && cp <= 0x3ab && cp != 0x3a2)	// Greek
+		return cp + 0x20;
+	if (cp >= 0x400 && cp <= 0x40f)					// Cyrillic
+		return cp + 0x50;
+	if (cp >= 0x410 && cp <= 0x42f)
+		return cp + 0x20;
+	return cp;
+}
+
+// decodes one UTF-8 sequence, invalid bytes come back as themselves
+static const unsigned char *utf8_next(const unsigned char *s, uint32_t *cp, int *len)
+{
+	int n, i;
+
+	if (s[0] < 0x80)
+		n = 1, *cp = s[0];
+	else if ((s[0] & 0xe0) == 0xc0)
+		n = 2, *cp = s[0] & 0x1f;
+	else if ((s[0] & 0xf0) == 0xe0)
+		n = 3, *cp = s[0] & 0x0f;
+	else if ((s[0] & 0xf8) == 0xf0)
+		n = 4, *cp = s[0] & 0x07;
+	else
+		n = 0;
+	for (i = 1; i < n; i++) {
+		if ((s[i] & 0xc0) != 0x80) {
+			n = 0;
+			break;
+		}
+		*cp = *cp << 6 | (s[i] & 0x3f);
+	}
+	if (n == 0) {
+		*cp = s[0];
+		*len = -1;		// copy the byte, don't fold it
+		return s + 1;
+	}
+	*len = n;
+	return s + n;
+}
+
+static int utf8_put(unsigned char *d, uint32_t cp)
+{
+	if (cp < 0x80) {
+		d[0] = cp;
+		return 1;
+	}
+	if (cp < 0x800) {
+		d[0] = 0xc0 | cp >> 6;
+		d[1] = 0x80 | (cp & 0x3f);
+		return 2;
+	}
+	if (cp < 0x10000) {
+		d[0] = 0xe0 | cp >> 12;
+		d[1] = 0x80 | (cp >> 6 & 0x3f);
+		d[2] = 0x80 | (cp & 0x3f);
+		return 3;
+	}
+	d[0] = 0xf0 | cp >> 18;
+	d[1] = 0x80 | (cp >> 12 & 0x3f);
+	d[2] = 0x80 | (cp >> 6 & 0x3f);
+	d[3] = 0x80 | (cp & 0x3f);
+	return 4;
+}
+
+static int is_space(uint32_t cp)
+{
+	return cp == ' ' || cp == '\t' || cp == 0xa0;
+}
+
+// normalized name into d (at least 4 * strlen(s) + 1 bytes), returns its length
+static size_t normalize(const char *name, unsigned char *d)
+{
+	const unsigned char *s = (const unsigned char *)name;
+	unsigned char *p = d;
+	uint32_t cp;
+	int len, space = 0;
+
+	while (*s) {
+		s = utf8_next(s, &cp, &len);
+		if (len > 0 && is_space(cp)) {
+			space = (p != d);
+			continue;
+		}
+		if (space)
+			*p++ = ' ';
+		space = 0;
+		if (len < 0)
+			*p++ = cp;
+		else
+			p += utf8_put(p, fold(cp));
+	}
+	*p = '\0';
+	return p - d;
+}
+
+void collate_add(struct collate *c, const char *name, uint32_t major)
+{
+	struct collate_item *it;
+	unsigned char *key;
+	size_t len, xlen;
+	int i;
+
+	if (!name)
+		name = "";
+	if (c->n_items == c->size) {
+		c->size *= 2;
+		c->items = realloc(c->items, c->size * sizeof(struct collate_item));
+	}
+	it = &c->items[c->n_items];
+
+	len = strlen(name);
+	reserve(c, 4 * len + 1);
+	key = (unsigned char *)c->keys + c->keys_len;
+	len = normalize(name, key);
+	if (c->flags & COLLATE_LOCALE) {
+		char *tmp = strdup((char *)key);
+
+		xlen = strxfrm(NULL, tmp, 0);
+		reserve(c, xlen + 1);
+		key = (unsigned char *)c->keys + c->keys_len;
+		strxfrm((char *)key, tmp, xlen + 1);
+		len = xlen;
+		free(tmp);
+	}
+
+	it->prefix = 0;
+	for (i = 0; i < 8; i++)
+		it->prefix = it->prefix << 8 | ((i < (int)len)? key[i] : 0);
+	it->major = major;
+	it->off = c->keys_len;
+	it->len = len;
+	it->index = c->n_items++;
+	c->keys_len += len;
+}
+
+static int item_cmp(const struct collate *c, const struct collate_item *a, const struct collate_item *b)
+{
+	uint32_t n;
+	int r;
+
+	if (a->major != b->major)
+		return (a->major < b->major)? -1 : 1;
+	if (a->prefix != b->prefix)
+		return (a->prefix < b->prefix)? -1 : 1;
+	if (a->len > 8 && b->len > 8) {
+		n = ((a->len < b->len)? a->len : b->len) - 8;
+		if ((r = memcmp(c->keys + a->off + 8, c->keys + b->off + 8, n)) != 0)
+			return r;
+	}
+	if (a->len != b->len)
+		return (a->len < b->len)? -1 : 1;
+	return (a->index < b->index)? -1 : (a->index > b->index);
+}
+
+// bottom-up merge sort, the index tie-break makes it stable anyway
+void collate_sort(struct collate *c, int *order)
+{
+	struct collate_item *src = c->items, *dst, *tmp;
+	int n = c->n_items, width, lo, mid, hi, i, j, k;
+
+	dst = malloc((n + 1) * sizeof(struct collate_item));
+	for (width = 1; width < n; width *= 2) {
+		for (lo = 0; lo < n; lo += 2 * width) {
+			mid = (lo + width < n)? lo + width : n;
+			hi = (lo + 2 * width < n)? lo + 2 * width : n;
+			for (i = lo, j = mid, k = lo; k < hi; k++) {
+				if (i < mid && (j >= hi || item_cmp(c, &src[i], &src[j]) <= 0))
+					dst[k] = src[i++];
+				else
+					dst[k] = src[j++];
+			}
+		}
+		tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+	for (i = 0; i < n; i++)
+		order[i] = src[i].index;
+	// keep the sorted items, the other buffer goes
+	if (src != c->items) {
+		free(c->items);
+		c->items = src;
+		c->size = n + 1;
+	} else
+		free(dst);
+}
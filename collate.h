@@ -0,0 +1,28 @@
+#ifndef __COLLATE_H__
+#define __COLLATE_H__
+
+#include <stdint.h>
+
+/*
+ * Sorting of channel and group names by collation keys. The key of a name
+ * is computed once: white space trimmed and collapsed, letters case-folded
+ * (ASCII, Latin-1, Latin Extended-A, Greek, Cyrillic), optionally passed
+ * through strxfrm(3). The keys live in one buffer, items carry their first
+ * eight bytes as an integer, and a stable merge sort orders the items.
+ */
+
+#define COLLATE_LOCALE		1	/* strxfrm() in the current LC_COLLATE locale */
+
+struct collate;
+
+extern struct collate *collate_create(int flags, int size_hint);
+extern void collate_free(struct collate *c);
+
+// item index n is the number of items added before; items are ordered by
+// major first, then by name, then by index
+extern void collate_add(struct collate *c, const char *name, uint32_t major);
+
+// fills order with the item indices in sorted order
+extern void collate_sort(struct collate *c, int *order);
+
+#endif
@@ -0,0 +1,556 @@
+/*
+ * Channel list diff.
+ *
+ * Both the previous result and the current scan are parsed by the same
+ * code: the current scan is first rendered by the regular writer of the
+ * selected output format, so writer details (name mangling, CA output,
+ * provider prefix) never show up as spurious changes. Services are matched
+ * by (onid, tsid, sid); the zap format carries neither onid nor tsid, there
+ * the frequency takes their place.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "diff.h"
+#include "scan.h"
+
+#define VDR_FIELDS	13
+#define ZAP_FIELDS	6	/* minimum: name:freq:vpid:apid:sid:delsys */
+
+static const char *vdr_field_name [] = {
+	NULL,				/* name;provider, split below */
+	"frequency",
+	"parameters",
+	"source",
+	"symbol_rate",
+	"vpid",
+	"apid",
+	"tpid",
+	"caid",
+	NULL,				/* sid */
+	NULL,				/* onid */
+	NULL,				/* tsid */
+	"rid"
+};
+
+static struct diff_record *new_record(struct diff_list *l)
+{
+	struct diff_record *r;
+
+	if (l->n == l->size) {
+		l->size = l->size ? l->size * 2 : 256;
+		l->rec = realloc(l->rec, l->size * sizeof(*l->rec));
+	}
+	r = &l->rec[l->n];
+	memset(r, 0, sizeof(*r));
+	r->order = l->n++;
+	return r;
+}
+
+static void add_field(struct diff_record *r, const char *name, const char *value,
+		size_t len, int raw)
+{
+	struct diff_field *f;
+
+	r->fields = realloc(r->fields, (r->n_fields + 1) * sizeof(*r->fields));
+	f = &r->fields[r->n_fields++];
+	f->name = strdup(name);
+	f->value = strndup(value, len);
+	f->raw = raw;
+}
+
+static void free_record(struct diff_record *r)
+{
+	int i;
+
+	for (i = 0; i < r->n_fields; i++) {
+		free(r->fields[i].name);
+		free(r->fields[i].value);
+	}
+	free(r->fields);
+}
+
+// splits a line at ':', returns the number of fields
+static int split_line(const char *line, const char *end, const char **fld,
+		int *len, int max)
+{
+	int n = 0;
+	const char *p = line;
+
+	while (n < max) {
+		const char *c = memchr(p, ':', end - p);
+		fld[n] = p;
+		len[n] = (c ? c : end) - p;
+		n++;
+		if (!c)
+			return n;
+		p = c + 1;
+	}
+	return n + 1;	/* too many */
+}
+
+static void parse_vdr_line(struct diff_list *l, const char *line, const char *end)
+{
+	const char *fld[VDR_FIELDS];
+	const char *semi;
+	int len[VDR_FIELDS];
+	struct diff_record *r;
+	int i;
+
+	if (split_line(line, end, fld, len, VDR_FIELDS) != VDR_FIELDS) {
+		warning("diff: skipping malformed line '%.*s'\n", (int)(end - line), line);
+		return;
+	}
+
+	r = new_record(l);
+	r->key[0] = strtoul(fld[10], NULL, 10);
+	r->key[1] = strtoul(fld[11], NULL, 10);
+	r->key[2] = strtoul(fld[9], NULL, 10);
+
+	semi = memchr(fld[0], ';', len[0]);
+	if (semi) {
+		add_field(r, "name", fld[0], semi - fld[0], 0);
+		add_field(r, "provider", semi + 1, fld[0] + len[0] - semi - 1, 0);
+	} else
+		add_field(r, "name", fld[0], len[0], 0);
+
+	for (i = 1; i < VDR_FIELDS; i++) {
+		if (vdr_field_name[i])
+			add_field(r, vdr_field_name[i], fld[i], len[i], 0);
+	}
+}
+
+static void parse_zap_line(struct diff_list *l, const char *line, const char *end)
+{
+	const char *fld[32];
+	int len[32];
+	struct diff_record *r;
+	int n;
+
+	n = split_line(line, end, fld, len, 32);
+	if (n < ZAP_FIELDS || n > 32) {
+		warning("diff: skipping malformed line '%.*s'\n", (int)(end - line), line);
+		return;
+	}
+
+	r = new_record(l);
+	r->key[0] = 0;
+	r->key[1] = strtoul(fld[1], NULL, 10);
+	r->key[2] = strtoul(fld[n - 2], NULL, 10);
+
+	add_field(r, "name", fld[0], len[0], 0);
+	add_field(r, "frequency", fld[1], len[1], 0);
+	/* everything between frequency and the PIDs depends on the delivery system */
+	add_field(r, "parameters", fld[2], n > ZAP_FIELDS ? fld[n - 5] + len[n - 5] - fld[2] : 0, 0);
+	add_field(r, "vpid", fld[n - 4], len[n - 4], 0);
+	add_field(r, "apid", fld[n - 3], len[n - 3], 0);
+	add_field(r, "delivery_system", fld[n - 1], len[n - 1], 0);
+}
+
+static int parse_lines(struct diff_list *l, const char *buf, size_t len, int zap)
+{
+	const char *p = buf, *end = buf + len, *eol;
+
+	l->zap_keys = zap;
+	while (p < end) {
+		eol = memchr(p, '\n', end - p);
+		if (!eol)
+			eol = end;
+		/* ':' starts VDR group separators and channel numbers */
+		if (eol > p && *p != ':' && *p != '#') {
+			const char *e = eol;
+			if (e[-1] == '\r')
+				e--;
+			if (zap)
+				parse_zap_line(l, p, e);
+			else
+				parse_vdr_line(l, p, e);
+		}
+		p = eol + 1;
+	}
+	return 0;
+}
+
+/* JSON: just enough of a parser to flatten our own records */
+
+static const char *skip_ws(const char *p, const char *end)
+{
+	while (p < end && isspace((unsigned char)*p))
+		p++;
+	return p;
+}
+
+static const char *skip_string(const char *p, const char *end)
+{
+	for (p++; p < end; p++) {
+		if (*p == '\\')
+			p++;
+		else if (*p == '"')
+			return p + 1;
+	}
+	return NULL;
+}
+
+// stops at the ',', '}' or ']' following the value
+static const char *skip_value(const char *p, const char *end)
+{
+	int depth = 0;
+
+	while (p < end) {
+		switch (*p) {
+			case '"':
+				if (!(p = skip_string(p, end)))
+					return NULL;
+				break;
+			case '{':
+			case '[':
+				depth++;
+				p++;
+				break;
+			case '}':
+			case ']':
+				if (depth == 0)
+					return p;
+				depth--;
+				p++;
+				break;
+			case ',':
+				if (depth == 0)
+					return p;
+				p++;
+				break;
+			default:
+				if (depth == 0 && isspace((unsigned char)*p))
+					return p;
+				p++;
+				break;
+		}
+	}
+	return depth ? NULL : p;
+}
+
+// copies a JSON value without the whitespace between tokens
+static void add_json_field(struct diff_record *r, const char *name, const char *v, const char *end)
+{
+	char *buf = malloc(end - v + 1), *o = buf;
+	const char *s;
+
+	while (v < end) {
+		if (*v == '"') {
+			s = skip_string(v, end);
+			memcpy(o, v, s - v);
+			o += s - v;
+			v = s;
+		} else if (isspace((unsigned char)*v))
+			v++;
+		else
+			*o++ = *v++;
+	}
+	add_field(r, name, buf, o - buf, 1);
+	free(buf);
+}
+
+static const char *parse_object(struct diff_record *r, const char *prefix,
+		const char *p, const char *end)
+{
+	char name[128];
+	const char *k, *v;
+
+	p = skip_ws(p + 1, end);
+	if (p < end && *p == '}')
+		return p + 1;
+	while (p < end) {
+		if (*p != '"' || !(v = skip_string(p, end)))
+			return NULL;
+		k = p + 1;
+		snprintf(name, sizeof(name), "%s%s%.*s", prefix, *prefix ? "." : "",
+			(int)(v - k - 1), k);
+		v = skip_ws(v, end);
+		if (v >= end || *v != ':')
+			return NULL;
+		v = skip_ws(v + 1, end);
+		if (v < end && *v == '{') {
+			if (!(p = parse_object(r, name, v, end)))
+				return NULL;
+		} else {
+			if (!(p = skip_value(v, end)))
+				return NULL;
+			if (strcmp(name, "onid") == 0)
+				r->key[0] = strtoul(v, NULL, 10);
+			else if (strcmp(name, "tsid") == 0)
+				r->key[1] = strtoul(v, NULL, 10);
+			else if (strcmp(name, "sid") == 0)
+				r->key[2] = strtoul(v, NULL, 10);
+			/* signal levels change on every scan */
+			else if (strncmp(name, "transponder.signal.", 19) != 0)
+				add_json_field(r, name, v, p);
+		}
+		p = skip_ws(p, end);
+		if (p < end && *p == ',')
+			p = skip_ws(p + 1, end);
+		else if (p < end && *p == '}')
+			return p + 1;
+		else
+			return NULL;
+	}
+	return NULL;
+}
+
+// accepts a top level array of records (json) or one record per line (ndjson)
+static int parse_json(struct diff_list *l, const char *buf, size_t len)
+{
+	const char *p = buf, *end = buf + len;
+	struct diff_record *r;
+	int in_array = 0;
+
+	l->zap_keys = 0;
+	while ((p = skip_ws(p, end)) < end) {
+		switch (*p) {
+			case '[':
+				in_array++;
+				p++;
+				continue;
+			case ']':
+				in_array--;
+				p++;
+				continue;
+			case ',':
+				if (!in_array)
+					goto bad;
+				p++;
+				continue;
+			case '{':
+				r = new_record(l);
+				if (!(p = parse_object(r, "", p, end)))
+					goto bad;
+				continue;
+			default:
+				goto bad;
+		}
+	}
+	return 0;
+
+bad:
+	error("diff: malformed JSON at record %d\n", l->n);
+	return -1;
+}
+
+int diff_parse(struct diff_list *l, enum format fmt, const char *buf, size_t len)
+{
+	switch (fmt) {
+		case OUTPUT_VDR:
+		case OUTPUT_VDR_16x:
+			return parse_lines(l, buf, len, 0);
+		case OUTPUT_ZAP:
+			return parse_lines(l, buf, len, 1);
+		case OUTPUT_JSON:
+		case OUTPUT_NDJSON:
+			return parse_json(l, buf, len);
+		default:
+			error("diff: output format has no diff support\n");
+			return -1;
+	}
+}
+
+int diff_load(struct diff_list *l, enum format fmt, const char *path)
+{
+	FILE *f;
+	char *buf = NULL;
+	size_t len = 0, size = 0, n;
+	int ret;
+
+	if (!(f = fopen(path, "r"))) {
+		error("diff: cannot open '%s': %m\n", path);
+		return -1;
+	}
+	do {
+		if (len == size) {
+			size = size ? size * 2 : 65536;
+			buf = realloc(buf, size);
+		}
+		n = fread(buf + len, 1, size - len, f);
+		len += n;
+	} while (n);
+	fclose(f);
+
+	ret = diff_parse(l, fmt, buf, len);
+	free(buf);
+	return ret;
+}
+
+void diff_free(struct diff_list *l)
+{
+	int i;
+
+	for (i = 0; i < l->n; i++)
+		free_record(&l->rec[i]);
+	free(l->rec);
+	memset(l, 0, sizeof(*l));
+}
+
+static int cmp_record(const void *a, const void *b)
+{
+	const struct diff_record *x = a, *y = b;
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		if (x->key[i] != y->key[i])
+			return x->key[i] < y->key[i] ? -1 : 1;
+	}
+	return x->order - y->order;
+}
+
+static int cmp_key(const struct diff_record *x, const struct diff_record *y)
+{
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		if (x->key[i] != y->key[i])
+			return x->key[i] < y->key[i] ? -1 : 1;
+	}
+	return 0;
+}
+
+static void put_str(FILE *f, const char *s)
+{
+	fputc('"', f);
+	for (; *s; s++) {
+		unsigned char c = *s;
+		if (c == '"' || c == '\\')
+			fprintf(f, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(f, "\\u%04x", c);
+		else
+			fputc(c, f);
+	}
+	fputc('"', f);
+}
+
+static void put_value(FILE *f, const struct diff_field *fld)
+{
+	if (!fld)
+		fputs("null", f);
+	else if (fld->raw)
+		fputs(fld->value, f);
+	else
+		put_str(f, fld->value);
+}
+
+static void put_head(FILE *f, const char *op, const struct diff_record *r, int zap_keys)
+{
+	if (zap_keys)
+		fprintf(f, "{\"op\":\"%s\",\"frequency\":%u,\"sid\":%u", op, r->key[1], r->key[2]);
+	else
+		fprintf(f, "{\"op\":\"%s\",\"onid\":%u,\"tsid\":%u,\"sid\":%u",
+			op, r->key[0], r->key[1], r->key[2]);
+}
+
+static void put_record(FILE *f, const char *op, const struct diff_record *r, int zap_keys)
+{
+	int i;
+
+	put_head(f, op, r, zap_keys);
+	fputs(",\"fields\":{", f);
+	for (i = 0; i < r->n_fields; i++) {
+		if (i)
+			fputc(',', f);
+		put_str(f, r->fields[i].name);
+		fputc(':', f);
+		put_value(f, &r->fields[i]);
+	}
+	fputs("}}\n", f);
+}
+
+static const struct diff_field *find_field(const struct diff_record *r, const char *name, int hint)
+{
+	int i;
+
+	/* both sides come from the same writer, fields are usually in step */
+	if (hint < r->n_fields && strcmp(r->fields[hint].name, name) == 0)
+		return &r->fields[hint];
+	for (i = 0; i < r->n_fields; i++) {
+		if (strcmp(r->fields[i].name, name) == 0)
+			return &r->fields[i];
+	}
+	return NULL;
+}
+
+static int same_value(const struct diff_field *a, const struct diff_field *b)
+{
+	return a && b && strcmp(a->value, b->value) == 0;
+}
+
+static int put_change(FILE *f, const char *name, const struct diff_field *o,
+		const struct diff_field *n, int changes, const struct diff_record *r, int zap_keys)
+{
+	if (!changes) {
+		put_head(f, "change", r, zap_keys);
+		fputs(",\"changes\":{", f);
+	} else
+		fputc(',', f);
+	put_str(f, name);
+	fputs(":{\"old\":", f);
+	put_value(f, o);
+	fputs(",\"new\":", f);
+	put_value(f, n);
+	fputc('}', f);
+	return changes + 1;
+}
+
+// returns 1 if the service changed
+static int dump_changes(FILE *f, const struct diff_record *o, const struct diff_record *n, int zap_keys)
+{
+	const struct diff_field *of, *nf;
+	int i, changes = 0;
+
+	for (i = 0; i < o->n_fields; i++) {
+		of = &o->fields[i];
+		nf = find_field(n, of->name, i);
+		if (!same_value(of, nf))
+			changes = put_change(f, of->name, of, nf, changes, n, zap_keys);
+	}
+	for (i = 0; i < n->n_fields; i++) {
+		nf = &n->fields[i];
+		if (!find_field(o, nf->name, i))
+			changes = put_change(f, nf->name, NULL, nf, changes, n, zap_keys);
+	}
+	if (changes)
+		fputs("}}\n", f);
+	return changes != 0;
+}
+
+void diff_dump(FILE *f, struct diff_list *old, struct diff_list *cur)
+{
+	int i = 0, j = 0, c;
+	int added = 0, removed = 0, changed = 0;
+	int zap_keys = old->zap_keys || cur->zap_keys;
+
+	qsort(old->rec, old->n, sizeof(*old->rec), cmp_record);
+	qsort(cur->rec, cur->n, sizeof(*cur->rec), cmp_record);
+
+	while (i < old->n || j < cur->n) {
+		if (i == old->n)
+			c = 1;
+		else if (j == cur->n)
+			c = -1;
+		else
+			c = cmp_key(&old->rec[i], &cur->rec[j]);
+
+		if (c < 0) {
+			put_record(f, "remove", &old->rec[i++], zap_keys);
+			removed++;
+		} else if (c > 0) {
+			put_record(f, "add", &cur->rec[j++], zap_keys);
+			added++;
+		} else {
+			changed += dump_changes(f, &old->rec[i++], &cur->rec[j++], zap_keys);
+		}
+	}
+	fflush(f);
+
+	info("diff: %d added, %d removed, %d changed, %d unchanged\n",
+		added, removed, changed, cur->n - added - changed);
+}
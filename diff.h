@@ -0,0 +1,37 @@
+#ifndef __DIFF_H__
+#define __DIFF_H__
+
+#include <stdint.h>
+
+#include "scan.h"
+
+struct diff_field {
+	char *name;
+	char *value;
+	int raw;			/* value is JSON text, otherwise a plain string */
+};
+
+struct diff_record {
+	uint32_t key[3];	/* onid, tsid, sid - or 0, frequency, sid for zap */
+	int order;
+	int n_fields;
+	struct diff_field *fields;
+};
+
+struct diff_list {
+	struct diff_record *rec;
+	int n;
+	int size;
+	int zap_keys;
+};
+
+// parses a service list written in the given output format
+extern int diff_parse(struct diff_list *l, enum format fmt, const char *buf, size_t len);
+extern int diff_load(struct diff_list *l, enum format fmt, const char *path);
+
+// writes one NDJSON line per added, removed or changed service
+extern void diff_dump(FILE *f, struct diff_list *old, struct diff_list *cur);
+
+extern void diff_free(struct diff_list *l);
+
+#endif
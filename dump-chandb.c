@@ -0,0 +1,320 @@
+/*
+ * Writer for the binary channel database, see chandb.h for the layout.
+ *
+ * Services are collected while the lists are dumped and the file is built
+ * in memory by chandb_dump_footer(), because the index can only be sorted
+ * once all services are known.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chandb.h"
+#include "dump-chandb.h"
+#include "scan.h"
+
+#define ALIGN4(x)	(((x) + 3) & ~3U)
+
+struct growbuf {
+	unsigned char *buf;
+	uint32_t len;
+	uint32_t size;
+};
+
+struct string_slot {
+	uint32_t hash;
+	uint32_t off;
+};
+
+static struct growbuf strings, tps, svcs, audio, ca, streams;
+static struct chandb_index *index_buf;
+static uint32_t index_len, index_size;
+
+static struct string_slot *str_slots;
+static uint32_t str_slots_size, str_count;
+
+static transponder_t **tp_ptrs;
+static uint32_t tp_ptrs_size;
+
+static void *gb_append(struct growbuf *b, uint32_t n)
+{
+	void *p;
+
+	if (b->len + n > b->size) {
+		while (b->len + n > b->size)
+			b->size = b->size ? b->size * 2 : 4096;
+		b->buf = realloc(b->buf, b->size);
+	}
+	p = b->buf + b->len;
+	memset(p, 0, n);
+	b->len += n;
+	return p;
+}
+
+static uint32_t str_hash(const char *s)
+{
+	uint32_t h = 0x811c9dc5;
+
+	while (*s) {
+		h ^= (unsigned char)*s++;
+		h *= 0x01000193;
+	}
+	return h;
+}
+
+static void str_rehash(void)
+{
+	struct string_slot *old = str_slots;
+	uint32_t i, j, old_size = str_slots_size;
+
+	str_slots_size = old_size ? old_size * 2 : 1024;
+	str_slots = calloc(str_slots_size, sizeof(*str_slots));
+	for (i = 0; i < old_size; i++) {
+		if (old[i].off == 0)
+			continue;
+		for (j = old[i].hash & (str_slots_size - 1); str_slots[j].off; j = (j + 1) & (str_slots_size - 1))
+			;
+		str_slots[j] = old[i];
+	}
+	free(old);
+}
+
+// provider names repeat on every service, store each string once
+static uint32_t add_string(const char *s)
+{
+	uint32_t h, i, len;
+
+	if (!s || !*s)
+		return 0;
+	if (str_count * 2 >= str_slots_size)
+		str_rehash();
+	h = str_hash(s);
+	for (i = h & (str_slots_size - 1); str_slots[i].off; i = (i + 1) & (str_slots_size - 1)) {
+		if (str_slots[i].hash == h && strcmp((char *)strings.buf + str_slots[i].off, s) == 0)
+			return str_slots[i].off;
+	}
+	len = strlen(s) + 1;
+	str_slots[i].hash = h;
+	str_slots[i].off = strings.len;
+	memcpy(gb_append(&strings, len), s, len);
+	str_count++;
+	return str_slots[i].off;
+}
+
+static uint32_t add_transponder(transponder_t *t)
+{
+	struct chandb_transponder *d;
+	uint32_t i, n = tps.len / sizeof(*d);
+
+	// services arrive grouped by transponder, look at the latest ones first
+	for (i = n; i > 0; i--) {
+		if (tp_ptrs[i - 1] == t)
+			return i - 1;
+	}
+
+	if (n >= tp_ptrs_size) {
+		tp_ptrs_size = tp_ptrs_size ? tp_ptrs_size * 2 : 64;
+		tp_ptrs = realloc(tp_ptrs, tp_ptrs_size * sizeof(*tp_ptrs));
+	}
+	tp_ptrs[n] = t;
+
+	d = gb_append(&tps, sizeof(*d));
+	d->frequency = t->frequency;
+	d->symbol_rate = t->symbol_rate;
+	d->stream_id = t->stream_id == NO_STREAM_ID_FILTER ? CHANDB_NO_STREAM_ID : (uint32_t)t->stream_id;
+	d->pls_code = t->pls_code;
+	d->network_id = t->network_id;
+	d->original_network_id = t->original_network_id;
+	d->transport_stream_id = t->transport_stream_id;
+	d->orbital_pos = t->we_flag ? t->orbital_pos : -t->orbital_pos;
+	d->delivery_system = t->delivery_system;
+	d->modulation = t->modulation;
+	d->inversion = t->inversion;
+	d->fec = t->fec;
+	d->fec_hp = t->fecHP;
+	d->fec_lp = t->fecLP;
+	d->rolloff = t->rolloff;
+	d->bandwidth = t->bandwidth;
+	d->hierarchy = t->hierarchy;
+	d->guard_interval = t->guard_interval;
+	d->transmission_mode = t->transmission_mode;
+	d->polarisation = t->polarisation;
+	d->pls_mode = t->pls_mode;
+	d->signal = CHANDB_NO_SIGNAL;
+	d->cnr = d->cnr_min = CHANDB_NO_SIGNAL;
+#ifdef DTV_STAT_SIGNAL_STRENGTH
+	if (t->stats_samples && t->strength_scale == FE_SCALE_DECIBEL)
+		d->signal = t->strength;
+	if (t->stats_samples && t->cnr_scale == FE_SCALE_DECIBEL) {
+		d->cnr = t->cnr;
+		d->cnr_min = t->cnr_min;
+	}
+#endif
+	d->error_blocks = t->error_blocks;
+	return n;
+}
+
+void chandb_dump_service_parameter_set (service_t *s, transponder_t *t)
+{
+	struct chandb_service *d;
+	struct chandb_audio *a;
+	struct chandb_stream *st;
+	struct chandb_index *e;
+	uint32_t svc_idx = svcs.len / sizeof(*d);
+	int i;
+
+	if (svc_idx == 0 && strings.len == 0)
+		gb_append(&strings, 1);		/* offset 0: empty string */
+
+	d = gb_append(&svcs, sizeof(*d));
+	d->transponder = add_transponder(t);
+	d->name = add_string(s->service_name);
+	d->provider = add_string(s->provider_name);
+	d->channel_num = s->channel_num;
+	d->service_id = s->service_id;
+	d->pmt_pid = s->pmt_pid;
+	d->pcr_pid = s->pcr_pid;
+	d->video_pid = s->video_pid;
+	d->ac3_pid = s->ac3_pid;
+	d->teletext_pid = s->teletext_pid;
+	d->subtitling_pid = s->subtitling_pid;
+	d->type = s->type;
+	d->running = s->running;
+	d->flags = s->scrambled ? CHANDB_SVC_SCRAMBLED : 0;
+
+	d->audio = audio.len / sizeof(*a);
+	d->audio_count = s->audio_num;
+	for (i = 0; i < s->es_num; i++) {
+		if (s->es[i].kind != ES_AUDIO)
+			continue;
+		a = gb_append(&audio, sizeof(*a));
+		a->pid = s->es[i].pid;
+		memcpy(a->lang, s->es[i].lang, 3);
+	}
+
+	d->ca = ca.len / sizeof(uint16_t);
+	d->ca_count = s->ca_num;
+	for (i = 0; i < s->ca_num; i++)
+		*(uint16_t *)gb_append(&ca, sizeof(uint16_t)) = s->ca_id[i];
+
+	/* the CHANDB_ES_ and CHANDB_CODEC_ values are the ones of scan.h */
+	d->stream = streams.len / sizeof(*st);
+	d->stream_count = s->es_num;
+	for (i = 0; i < s->es_num; i++) {
+		st = gb_append(&streams, sizeof(*st));
+		st->pid = s->es[i].pid;
+		st->stream_type = s->es[i].stream_type;
+		st->kind = s->es[i].kind;
+		memcpy(st->lang, s->es[i].lang, 3);
+		st->component_tag = s->es[i].component_tag;
+		st->codec = s->es[i].codec;
+		st->subtype = s->es[i].subtype;
+		st->page = s->es[i].page;
+	}
+
+	if (index_len == index_size) {
+		index_size = index_size ? index_size * 2 : 1024;
+		index_buf = realloc(index_buf, index_size * sizeof(*index_buf));
+	}
+	e = &index_buf[index_len++];
+	e->onid = t->original_network_id;
+	e->tsid = t->transport_stream_id;
+	e->sid = s->service_id;
+	e->reserved = 0;
+	e->service = svc_idx;
+}
+
+static int cmp_index(const void *a, const void *b)
+{
+	const struct chandb_index *x = a, *y = b;
+
+	if (x->onid != y->onid)
+		return x->onid < y->onid ? -1 : 1;
+	if (x->tsid != y->tsid)
+		return x->tsid < y->tsid ? -1 : 1;
+	if (x->sid != y->sid)
+		return x->sid < y->sid ? -1 : 1;
+	// duplicates keep the scan order
+	return x->service < y->service ? -1 : x->service > y->service;
+}
+
+static void gb_free(struct growbuf *b)
+{
+	free(b->buf);
+	memset(b, 0, sizeof(*b));
+}
+
+void chandb_dump_footer (FILE *f)
+{
+	static const unsigned char pad[4];
+	struct chandb_header h;
+	uint32_t off;
+
+	if (strings.len == 0)
+		gb_append(&strings, 1);
+
+	qsort(index_buf, index_len, sizeof(*index_buf), cmp_index);
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CHANDB_MAGIC, sizeof(h.magic));
+	h.byte_order = CHANDB_BYTE_ORDER;
+	h.version_major = CHANDB_VERSION_MAJOR;
+	h.version_minor = CHANDB_VERSION_MINOR;
+	h.header_size = sizeof(h);
+
+	off = ALIGN4(sizeof(h));
+	h.tp_off = off;
+	h.tp_size = sizeof(struct chandb_transponder);
+	h.tp_count = tps.len / h.tp_size;
+	off = ALIGN4(off + tps.len);
+	h.svc_off = off;
+	h.svc_size = sizeof(struct chandb_service);
+	h.svc_count = svcs.len / h.svc_size;
+	off = ALIGN4(off + svcs.len);
+	h.index_off = off;
+	h.index_count = index_len;
+	off = ALIGN4(off + index_len * sizeof(struct chandb_index));
+	h.audio_off = off;
+	h.audio_count = audio.len / sizeof(struct chandb_audio);
+	off = ALIGN4(off + audio.len);
+	h.ca_off = off;
+	h.ca_count = ca.len / sizeof(uint16_t);
+	off = ALIGN4(off + ca.len);
+	h.stream_off = off;
+	h.stream_count = streams.len / sizeof(struct chandb_stream);
+	off = ALIGN4(off + streams.len);
+	h.strings_off = off;
+	h.strings_size = strings.len;
+	h.file_size = off + strings.len;
+
+	fwrite(&h, 1, sizeof(h), f);
+	fwrite(pad, 1, ALIGN4(sizeof(h)) - sizeof(h), f);
+	fwrite(tps.buf, 1, tps.len, f);
+	fwrite(pad, 1, ALIGN4(tps.len) - tps.len, f);
+	fwrite(svcs.buf, 1, svcs.len, f);
+	fwrite(pad, 1, ALIGN4(svcs.len) - svcs.len, f);
+	fwrite(index_buf, 1, index_len * sizeof(struct chandb_index), f);
+	fwrite(audio.buf, 1, audio.len, f);
+	fwrite(ca.buf, 1, ca.len, f);
+	fwrite(pad, 1, ALIGN4(ca.len) - ca.len, f);
+	fwrite(streams.buf, 1, streams.len, f);
+	fwrite(strings.buf, 1, strings.len, f);
+	fflush(f);
+
+	gb_free(&strings);
+	gb_free(&tps);
+	gb_free(&svcs);
+	gb_free(&audio);
+	gb_free(&ca);
+	gb_free(&streams);
+	free(index_buf);
+	index_buf = NULL;
+	index_len = index_size = 0;
+	free(str_slots);
+	str_slots = NULL;
+	str_slots_size = str_count = 0;
+	free(tp_ptrs);
+	tp_ptrs = NULL;
+	tp_ptrs_size = 0;
+}
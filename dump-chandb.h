@@ -0,0 +1,13 @@
+#ifndef __DUMP_CHANDB_H__
+#define __DUMP_CHANDB_H__
+
+#include <stdint.h>
+
+#include "scan.h"
+
+extern void chandb_dump_service_parameter_set (service_t *s, transponder_t *t);
+
+// builds the index and writes the whole database
+extern void chandb_dump_footer (FILE *f);
+
+#endif
@@ -0,0 +1,566 @@
+/*
+ * JSON / NDJSON output.
+ *
+ * Every service is rendered into a private growable buffer and handed to
+ * stdio with a single fwrite(), so large lineups don't pay for one fprintf()
+ * call per field. In NDJSON mode each service is one line; in JSON mode the
+ * services are wrapped into a top level array.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dump-json.h"
+#include "scan.h"
+
+struct json_buf {
+	char *buf;
+	size_t len;
+	size_t size;
+};
+
+static struct json_buf jb;
+static int json_records = 0;
+
+static const char *inv_name [] = {
+	"OFF",
+	"ON",
+	"AUTO"
+};
+
+static const char *fec_name [] = {
+	"NONE",
+	"1/2",
+	"2/3",
+	"3/4",
+	"4/5",
+	"5/6",
+	"6/7",
+	"7/8",
+	"8/9",
+	"AUTO",
+	"3/5",
+	"9/10",
+	"2/5"
+};
+
+static const char *qam_name [] = {
+	"QPSK",
+	"QAM16",
+	"QAM32",
+	"QAM64",
+	"QAM128",
+	"QAM256",
+	"AUTO",
+	"8VSB",
+	"16VSB",
+	"8PSK",
+	"16APSK",
+	"32APSK",
+	"DQPSK",
+	"QAM4NR"
+};
+
+static const char *rolloff_name [] = {
+	"35",
+	"20",
+	"25",
+	"AUTO"
+};
+
+static const char *bw_name [] = {
+	"8MHz",
+	"7MHz",
+	"6MHz",
+	"AUTO",
+	"5MHz",
+	"10MHz",
+	"1.712MHz"
+};
+
+static const char *mode_name [] = {
+	"2k",
+	"8k",
+	"AUTO",
+	"4k",
+	"1k",
+	"16k",
+	"32k",
+	"C1",
+	"C3780"
+};
+
+static const char *guard_name [] = {
+	"1/32",
+	"1/16",
+	"1/8",
+	"1/4",
+	"AUTO",
+	"1/128",
+	"19/128",
+	"19/256",
+	"PN420",
+	"PN595",
+	"PN945"
+};
+
+static const char *hierarchy_name [] = {
+	"NONE",
+	"1",
+	"2",
+	"4",
+	"AUTO"
+};
+
+static const char *polarisation_name [] = {
+	"H",
+	"V",
+	"L",
+	"R"
+};
+
+static const char *running_name [] = {
+	"undefined",
+	"not running",
+	"starts soon",
+	"pausing",
+	"running",
+	"off-air"
+};
+
+static const char *es_kind_name [] = {
+	"video",
+	"audio",
+	"ac3",
+	"teletext",
+	"subtitling",
+	"other"
+};
+
+static const char *codec_name [] = {
+	NULL,
+	"mpeg2",
+	"mpeg4",
+	"h264",
+	"hevc",
+	"mpeg_audio",
+	"aac",
+	"aac_latm",
+	"ac3",
+	"eac3",
+	"dts"
+};
+
+#define NAME(tab, v)	((unsigned)(v) < sizeof(tab)/sizeof(tab[0]) ? tab[(v)] : "???")
+
+static const char *delsys_name(fe_delivery_system_t d)
+{
+	switch (d) {
+		case SYS_DVBS: return "DVB-S";
+		case SYS_DVBS2: return "DVB-S2";
+		case SYS_DSS: return "DSS";
+		case SYS_DVBT: return "DVB-T";
+		case SYS_DVBT2: return "DVB-T2";
+		case SYS_DVBC_ANNEX_AC: return "DVB-C";
+		case SYS_DVBC_ANNEX_B: return "DVB-C/B";
+		case SYS_ATSC: return "ATSC";
+		default: return "???";
+	}
+}
+
+static void jb_reserve(size_t n)
+{
+	if (jb.len + n <= jb.size)
+		return;
+	while (jb.len + n > jb.size)
+		jb.size = jb.size ? jb.size * 2 : 4096;
+	jb.buf = realloc(jb.buf, jb.size);
+}
+
+static void jb_raw(const char *s, size_t n)
+{
+	jb_reserve(n);
+	memcpy(jb.buf + jb.len, s, n);
+	jb.len += n;
+}
+
+#define jb_lit(s)	jb_raw((s), sizeof(s) - 1)
+
+static void jb_char(char c)
+{
+	jb_reserve(1);
+	jb.buf[jb.len++] = c;
+}
+
+static void jb_uint(unsigned long v)
+{
+	char tmp[24];
+	int i = sizeof(tmp);
+
+	do {
+		tmp[--i] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+	jb_raw(tmp + i, sizeof(tmp) - i);
+}
+
+static void jb_int(long v)
+{
+	if (v < 0) {
+		jb_char('-');
+		jb_uint(-(unsigned long)v);
+	} else
+		jb_uint(v);
+}
+
+// thousandths as a decimal, e.g. dB values of the frontend
+static void jb_milli(long v)
+{
+	char tmp[4];
+
+	if (v < 0) {
+		jb_char('-');
+		v = -v;
+	}
+	jb_uint(v / 1000);
+	snprintf(tmp, sizeof(tmp), "%03ld", v % 1000);
+	jb_char('.');
+	jb_raw(tmp, 3);
+}
+
+static void jb_str(const char *s)
+{
+	static const char hex[] = "0123456789abcdef";
+	const char *run;
+
+	if (!s) {
+		jb_lit("null");
+		return;
+	}
+	jb_char('"');
+	for (run = s; *s; s++) {
+		unsigned char c = *s;
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+		jb_raw(run, s - run);
+		run = s + 1;
+		switch (c) {
+			case '"': jb_lit("\\\""); break;
+			case '\\': jb_lit("\\\\"); break;
+			case '\n': jb_lit("\\n"); break;
+			case '\t': jb_lit("\\t"); break;
+			default:
+				jb_lit("\\u00");
+				jb_char(hex[c >> 4]);
+				jb_char(hex[c & 0x0f]);
+				break;
+		}
+	}
+	jb_raw(run, s - run);
+	jb_char('"');
+}
+
+// emits the separator unless this is the first member of an object/array
+static void jb_key(const char *key)
+{
+	char last = jb.len ? jb.buf[jb.len - 1] : '{';
+
+	if (last != '{' && last != '[')
+		jb_char(',');
+	jb_char('"');
+	jb_raw(key, strlen(key));
+	jb_lit("\":");
+}
+
+static void jb_elem(void)
+{
+	if (jb.buf[jb.len - 1] != '[')
+		jb_char(',');
+}
+
+static void json_transponder(transponder_t *t)
+{
+	int i;
+
+	jb_char('{');
+	jb_key("delivery_system"); jb_str(delsys_name(t->delivery_system));
+	jb_key("frequency"); jb_uint(t->frequency);
+	jb_key("network_id"); jb_int(t->network_id);
+	jb_key("original_network_id"); jb_int(t->original_network_id);
+	jb_key("transport_stream_id"); jb_int(t->transport_stream_id);
+	jb_key("inversion"); jb_str(NAME(inv_name, t->inversion));
+	jb_key("modulation"); jb_str(NAME(qam_name, t->modulation));
+
+	switch (t->delivery_system) {
+		case SYS_DVBS:
+		case SYS_DVBS2:
+		case SYS_DSS:
+			jb_key("symbol_rate"); jb_uint(t->symbol_rate);
+			jb_key("fec"); jb_str(NAME(fec_name, t->fec));
+			jb_key("rolloff"); jb_str(NAME(rolloff_name, t->rolloff));
+			jb_key("polarisation"); jb_str(NAME(polarisation_name, t->polarisation));
+			jb_key("orbital_pos"); jb_int(t->orbital_pos);
+			jb_key("we_flag"); jb_str(t->we_flag ? "E" : "W");
+			break;
+
+		case SYS_DVBC_ANNEX_AC:
+		case SYS_DVBC_ANNEX_B:
+			jb_key("symbol_rate"); jb_uint(t->symbol_rate);
+			jb_key("fec"); jb_str(NAME(fec_name, t->fec));
+			break;
+
+		case SYS_DVBT:
+		case SYS_DVBT2:
+			jb_key("bandwidth"); jb_str(NAME(bw_name, t->bandwidth));
+			jb_key("fec_hp"); jb_str(NAME(fec_name, t->fecHP));
+			jb_key("fec_lp"); jb_str(NAME(fec_name, t->fecLP));
+			jb_key("transmission_mode"); jb_str(NAME(mode_name, t->transmission_mode));
+			jb_key("guard_interval"); jb_str(NAME(guard_name, t->guard_interval));
+			jb_key("hierarchy"); jb_str(NAME(hierarchy_name, t->hierarchy));
+			jb_key("other_frequency_flag"); jb_uint(t->other_frequency_flag);
+			jb_key("other_frequencies"); jb_char('[');
+			for (i = 0; i < t->n_other_f; i++) {
+				jb_elem();
+				jb_uint(t->other_f[i]);
+			}
+			jb_char(']');
+			if (t->n_attempts) {
+				jb_key("failed_frequencies"); jb_char('[');
+				for (i = 0; i < t->n_attempts; i++) {
+					jb_elem(); jb_char('{');
+					jb_key("frequency"); jb_uint(t->attempts[i].frequency);
+					if (t->attempts[i].level < 0) {
+						jb_key("carrier"); jb_lit("false");
+					} else if (t->attempts[i].level > 0) {
+						jb_key("signal"); jb_int(t->attempts[i].level);
+					}
+					jb_char('}');
+				}
+				jb_char(']');
+			}
+			break;
+
+		default:
+			break;
+	}
+
+	if (t->stream_id != NO_STREAM_ID_FILTER) {
+		jb_key("stream_id"); jb_int(t->stream_id);
+		jb_key("pls_mode"); jb_int(t->pls_mode);
+		jb_key("pls_code"); jb_int(t->pls_code);
+	}
+
+	if (t->stats_valid && t->stats_samples == 0) {
+		/* legacy ioctls */
+		jb_key("signal"); jb_char('{');
+		jb_key("strength"); jb_uint(t->signal_strength);
+		jb_key("snr"); jb_uint(t->snr);
+		jb_key("ber"); jb_uint(t->ber);
+		jb_key("unc"); jb_uint(t->ucblocks);
+		jb_char('}');
+	}
+#ifdef DTV_STAT_SIGNAL_STRENGTH
+	else if (t->stats_valid) {
+		jb_key("signal"); jb_char('{');
+		if (t->strength_scale == FE_SCALE_DECIBEL) {
+			jb_key("strength_dbm"); jb_milli(t->strength);
+		} else if (t->strength_scale == FE_SCALE_RELATIVE) {
+			jb_key("strength"); jb_uint(t->signal_strength);
+		}
+		if (t->cnr_scale == FE_SCALE_DECIBEL) {
+			jb_key("cnr_db"); jb_milli(t->cnr);
+			jb_key("cnr_min_db"); jb_milli(t->cnr_min);
+		} else if (t->cnr_scale == FE_SCALE_RELATIVE) {
+			jb_key("snr"); jb_uint(t->snr);
+		}
+		if (t->pre_total_bits) {
+			jb_key("bit_errors"); jb_uint(t->pre_error_bits);
+			jb_key("bits"); jb_uint(t->pre_total_bits);
+		}
+		if (t->error_blocks || t->total_blocks) {
+			jb_key("unc"); jb_uint(t->error_blocks);
+		}
+		if (t->total_blocks) {
+			jb_key("blocks"); jb_uint(t->total_blocks);
+		}
+		jb_key("samples"); jb_int(t->stats_samples);
+		jb_char('}');
+	}
+#endif
+	jb_char('}');
+}
+
+void json_dump_service_parameter_set (FILE *f, service_t *s, transponder_t *t,
+		const char **bouquets, int n_bouquets, int ndjson)
+{
+	const struct service_es *a;
+	int i;
+
+	jb.len = 0;
+	if (!ndjson) {
+		if (json_records)
+			jb_lit(",\n");
+		else
+			jb_lit("[\n");
+	}
+
+	jb_char('{');
+	jb_key("onid"); jb_int(t->original_network_id);
+	jb_key("tsid"); jb_int(t->transport_stream_id);
+	jb_key("sid"); jb_int(s->service_id);
+	jb_key("name"); jb_str(s->service_name);
+	jb_key("provider"); jb_str(s->provider_name);
+	jb_key("type"); jb_uint(s->type);
+	jb_key("running"); jb_str(NAME(running_name, s->running));
+	jb_key("scrambled");
+	if (s->scrambled)
+		jb_lit("true");
+	else
+		jb_lit("false");
+	jb_key("lcn"); jb_int(s->channel_num);
+	jb_key("pmt_pid"); jb_uint(s->pmt_pid);
+	jb_key("pcr_pid"); jb_uint(s->pcr_pid);
+	jb_key("video_pid"); jb_uint(s->video_pid);
+
+	jb_key("audio"); jb_char('[');
+	for (i = 0; i < s->es_num; i++) {
+		a = &s->es[i];
+		if (a->kind != ES_AUDIO)
+			continue;
+		jb_elem();
+		jb_char('{');
+		jb_key("pid"); jb_uint(a->pid);
+		if (a->lang[0]) {
+			jb_key("lang"); jb_str(a->lang);
+		}
+		jb_char('}');
+	}
+	jb_char(']');
+
+	jb_key("ac3_pid"); jb_uint(s->ac3_pid);
+	jb_key("teletext_pid"); jb_uint(s->teletext_pid);
+	jb_key("subtitling_pid"); jb_uint(s->subtitling_pid);
+
+	/* every stream of the PMT, enough for a player to start without it */
+	jb_key("streams"); jb_char('[');
+	for (i = 0; i < s->es_num; i++) {
+		a = &s->es[i];
+		jb_elem();
+		jb_char('{');
+		jb_key("pid"); jb_uint(a->pid);
+		jb_key("type"); jb_uint(a->stream_type);
+		jb_key("kind"); jb_str(NAME(es_kind_name, a->kind));
+		if (a->codec != CODEC_UNKNOWN) {
+			jb_key("codec"); jb_str(NAME(codec_name, a->codec));
+		}
+		if (a->lang[0]) {
+			jb_key("lang"); jb_str(a->lang);
+		}
+		if (a->component_tag >= 0) {
+			jb_key("component_tag"); jb_uint(a->component_tag);
+		}
+		switch (a->kind) {
+		case ES_AUDIO:
+		case ES_AC3:
+			if (a->subtype) {
+				jb_key("audio_type"); jb_uint(a->subtype);
+			}
+			break;
+		case ES_SUBTITLING:
+			jb_key("subtitling_type"); jb_uint(a->subtype);
+			jb_key("composition_page"); jb_uint(a->page);
+			break;
+		case ES_TELETEXT:
+			jb_key("teletext_type"); jb_uint(a->subtype);
+			/* magazine 0 is 8, the page number is BCD */
+			jb_key("page"); jb_uint((((a->page >> 8) & 7)? (a->page >> 8) & 7 : 8) * 100 +
+				((a->page >> 4) & 0xf) * 10 + (a->page & 0xf));
+			break;
+		}
+		jb_char('}');
+	}
+	jb_char(']');
+
+	jb_key("ca_ids"); jb_char('[');
+	for (i = 0; i < s->ca_num; i++) {
+		jb_elem();
+		jb_uint(s->ca_id[i]);
+	}
+	jb_char(']');
+
+	if (n_bouquets >= 0) {
+		jb_key("bouquets"); jb_char('[');
+		for (i = 0; i < n_bouquets; i++) {
+			jb_elem();
+			jb_str(bouquets[i]);
+		}
+		jb_char(']');
+	}
+
+	jb_key("transponder");
+	json_transponder(t);
+	jb_char('}');
+
+	if (ndjson)
+		jb_char('\n');
+
+	fwrite(jb.buf, 1, jb.len, f);
+	json_records++;
+}
+
+void json_dump_footer (FILE *f, int ndjson)
+{
+	if (!ndjson)
+		fputs(json_records ? "\n]\n" : "[]\n", f);
+	fflush(f);
+
+	free(jb.buf);
+	jb.buf = NULL;
+	jb.len = jb.size = 0;
+	json_records = 0;
+}
+
+/* one EIT event per line, written while the scan runs */
+void json_dump_event (FILE *f, const struct eit_event *ev)
+{
+	jb.len = 0;
+	jb_char('{');
+	jb_key("onid"); jb_int(ev->onid);
+	jb_key("tsid"); jb_int(ev->tsid);
+	jb_key("sid"); jb_int(ev->sid);
+	jb_key("event_id"); jb_int(ev->event_id);
+	jb_key("version"); jb_int(ev->version);
+	jb_key("table_id"); jb_uint(ev->table_id);
+	jb_key("start");
+	if (ev->start)
+		jb_int(ev->start);
+	else
+		jb_lit("null");
+	jb_key("duration"); jb_int(ev->duration);
+	jb_key("running"); jb_str(NAME(running_name, ev->running));
+	jb_key("scrambled");
+	if (ev->free_ca)
+		jb_lit("true");
+	else
+		jb_lit("false");
+	if (ev->lang[0]) {
+		jb_key("lang"); jb_str(ev->lang);
+	}
+	jb_key("title"); jb_str(ev->title);
+	if (ev->text) {
+		jb_key("text"); jb_str(ev->text);
+	}
+	if (ev->extended) {
+		jb_key("extended"); jb_str(ev->extended);
+	}
+	if (ev->content >= 0) {
+		jb_key("content"); jb_uint(ev->content);
+	}
+	if (ev->parental_rating >= 0) {
+		jb_key("parental_rating"); jb_uint(ev->parental_rating);
+	}
+	jb_lit("}\n");
+
+	fwrite(jb.buf, 1, jb.len, f);
+}
@@ -0,0 +1,17 @@
+#ifndef __DUMP_JSON_H__
+#define __DUMP_JSON_H__
+
+#include <stdint.h>
+
+#include "scan.h"
+#include "eit.h"
+
+extern void json_dump_service_parameter_set (FILE *f, service_t *s, transponder_t *t,
+		const char **bouquets, int n_bouquets, int ndjson);
+
+extern void json_dump_footer (FILE *f, int ndjson);
+
+// one NDJSON line per event, see -E
+extern void json_dump_event (FILE *f, const struct eit_event *ev);
+
+#endif
@@ -251,13 +251,21 @@ void m3u_dump_service_parameter_set (FILE *f, service_t *s, transponder_t *t, un
 
 		m3u_dvb_parameters (f, t, 1);
 
-		fprintf (f, "pids=0,%i,%i", s->service_id, s->audio_pid[0]);
-		for (i = 1; i < s->audio_num; i++)
-			fprintf (f, ",%i", s->audio_pid[i]);
+		fprintf (f, "pids=0,%i,%i", s->service_id, s->audio_pid);
+		for (i = 0; i < s->es_num; i++) {
+			if (s->es[i].kind == ES_AUDIO && s->es[i].pid != s->audio_pid)
+				fprintf (f, ",%i", s->es[i].pid);
+		}
 		if(s->video_pid > 0)
 			fprintf (f, ",%i", s->video_pid);
 		if(s->teletext_pid > 0)
 			fprintf (f, ",%i", s->teletext_pid);
+		/* the other streams a player may pick */
+		for (i = 0; i < s->es_num; i++) {
+			if ((s->es[i].kind == ES_AC3 || s->es[i].kind == ES_SUBTITLING) &&
+				s->es[i].pid != s->audio_pid)
+				fprintf (f, ",%i", s->es[i].pid);
+		}
 		fprintf (f, "\n");
 	} else {
 		fprintf (f, "#EXTVLCOPT:program=%i\n", s->service_id);
@@ -90,6 +90,38 @@ static char sat_polarisation(transponder_t *t)
 
 extern enum format output_format;
 
+/* the stream types VDR 1.7 keeps in channels.conf, for private data the
+ * tag of the descriptor that identified the codec */
+static int vdr_stream_type(const struct service_es *e)
+{
+	if (e->stream_type != 0x06)
+		return e->stream_type;
+	switch (e->codec) {
+	case CODEC_AC3:		return 0x6a;
+	case CODEC_EAC3:	return 0x7a;
+	case CODEC_DTS:		return 0x7b;
+	case CODEC_AAC:		return 0x7c;
+	}
+	return e->stream_type;
+}
+
+/* pid=lang@type, the type only where VDR can't assume it: AAC for Apids,
+ * anything but AC3 for Dpids */
+static void vdr_dump_stream(FILE *f, const struct service_es *e, const char *lang)
+{
+	int type = 0;
+
+	fprintf (f, "%i", e->pid);
+	if (lang && lang[0])
+		fprintf (f, "=%.4s", lang);
+	if (e->kind == ES_AUDIO && (e->codec == CODEC_AAC || e->codec == CODEC_AAC_LATM))
+		type = vdr_stream_type(e);
+	else if (e->kind == ES_AC3 && e->codec != CODEC_AC3)
+		type = vdr_stream_type(e);
+	if (type && output_format != OUTPUT_VDR_16x)
+		fprintf (f, "@%i", type);
+}
+
 void vdr_dump_dvb_parameters (FILE *f, transponder_t *t, char *orbital_pos_override)
 {
 	switch (t->delivery_system) {
@@ -208,9 +240,10 @@ void vdr_dump_dvb_parameters (FILE *f, transponder_t *t, char *orbital_pos_overr
 
 void vdr_dump_service_parameter_set (FILE *f, service_t *s, transponder_t *t, char *orbital_pos_override, int dump_channum, int dump_provider, int ca_select)
 {
-	int i;
+	const struct service_es *a, *first, *video;
+	int i, n;
 
-	if ((s->video_pid || s->audio_pid[0]) && ((ca_select == -1) || (ca_select < 0) || (ca_select > 0) || ((ca_select == 0) && (s->scrambled == 0)))) {
+	if ((s->video_pid || s->audio_pid) && ((ca_select == -1) || (ca_select < 0) || (ca_select > 0) || ((ca_select == 0) && (s->scrambled == 0)))) {
 		if ((dump_channum == 1) && (s->channel_num > 0))
 			fprintf(f, ":@%i\n", s->channel_num);
 
@@ -222,30 +255,52 @@ void vdr_dump_service_parameter_set (FILE *f, service_t *s, transponder_t *t, ch
 		vdr_dump_dvb_parameters (f, t, orbital_pos_override);
 
 		if ((s->pcr_pid != s->video_pid) && (s->video_pid > 0))
-			fprintf (f, "%i+%i:", s->video_pid, s->pcr_pid);
+			fprintf (f, "%i+%i", s->video_pid, s->pcr_pid);
 		else
-			fprintf (f, "%i:", s->video_pid);
-
-		fprintf (f, "%i", s->audio_pid[0]);
-
-		if (s->audio_lang && s->audio_lang[0][0])
-			fprintf (f, "=%.4s", s->audio_lang[0]);
+			fprintf (f, "%i", s->video_pid);
+		video = service_find_es(s, ES_VIDEO, 0);
+		if (output_format != OUTPUT_VDR_16x && video && video->pid == s->video_pid &&
+			video->codec != CODEC_MPEG2_VIDEO)
+			fprintf (f, "=%i", video->stream_type);
+		fprintf (f, ":");
+
+		first = service_find_es(s, ES_AUDIO, 0);
+		if (first && first->pid == s->audio_pid)
+			vdr_dump_stream (f, first, first->lang);
+		else
+			fprintf (f, "%i", s->audio_pid);
 
-		for (i = 1; i < s->audio_num; i++)
+		for (i = 0; i < s->es_num; i++)
 		{
-			fprintf (f, ",%i", s->audio_pid[i]);
-			if (s->audio_lang && s->audio_lang[i][0])
-				fprintf (f, "=%.4s", s->audio_lang[i]);
+			a = &s->es[i];
+			if (a->kind != ES_AUDIO || a == first)
+				continue;
+			fprintf (f, ",");
+			vdr_dump_stream (f, a, a->lang);
 		}
 
-		if (s->ac3_pid)
+		/* Dolby streams without a language of their own get the one of
+		 * the first audio stream */
+		for (i = 0, n = 0; i < s->es_num; i++)
 		{
-			fprintf (f, ";%i", s->ac3_pid);
-			if (s->audio_lang && s->audio_lang[0][0])
-				fprintf (f, "=%.4s", s->audio_lang[0]);
+			a = &s->es[i];
+			if (a->kind != ES_AC3)
+				continue;
+			fprintf (f, (n++)? "," : ";");
+			vdr_dump_stream (f, a, (a->lang[0] || !first)? a->lang : first->lang);
 		}
 
-		fprintf (f, ":%d:", s->teletext_pid);
+		fprintf (f, ":%d", s->teletext_pid);
+		for (i = 0, n = 0; i < s->es_num && output_format != OUTPUT_VDR_16x; i++)
+		{
+			a = &s->es[i];
+			if (a->kind != ES_SUBTITLING)
+				continue;
+			fprintf (f, (n++)? ",%i" : ";%i", a->pid);
+			if (a->lang[0])
+				fprintf (f, "=%.4s", a->lang);
+		}
+		fprintf (f, ":");
 
 		/* 0 = FTA only (filtered by first IF in that function), set to 0; -1 = All, but output 0 */
 		if(ca_select == -1 || ca_select == 0) { 
@@ -253,7 +308,7 @@ void vdr_dump_service_parameter_set (FILE *f, service_t *s, transponder_t *t, ch
 		}
 		/* -2 = All, output real CAID */
 		else if(ca_select == -2) {
-			fprintf (f, "%X", s->ca_id[0]);
+			fprintf (f, "%X", (s->ca_num)? s->ca_id[0] : 0);
 			for (i = 1; i < s->ca_num; i++) {
 				if (s->ca_id[i] == 0) continue;
 				fprintf (f, ",%X", s->ca_id[i]);
@@ -120,7 +120,7 @@ void zap_dump_service_parameter_set (FILE *f, service_t *s, transponder_t *t, in
 {
 	fprintf (f, "%s:", s->service_name);
 	zap_dump_dvb_parameters (f, t, sat_number);
-	fprintf (f, ":%i:%i:%i", s->video_pid, s->audio_pid[0], s->service_id);
+	fprintf (f, ":%i:%i:%i", s->video_pid, s->audio_pid, s->service_id);
 	fprintf (f, ":%i", t->delivery_system);
 	fprintf (f, "\n");
 }
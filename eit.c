@@ -0,0 +1,320 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "eit.h"
+#include "hmap.h"
+#include "scan.h"
+#include "scans2.h"
+#include "section.h"
+
+#define EIT_SETTLE		2	// seconds without a new sub-table before the TP is done
+#define EIT_HEADER_LEN	14
+#define EIT_CRC_LEN		4
+
+// one table_id of one service; the schedule is split into segments of
+// eight sections, each ends at its own segment_last_section_number
+struct eit_subtable {
+	int version;				// -1 if announced by last_table_id but not seen yet
+	int last_section;
+	uint8_t section_done[32];
+	uint32_t segment_seen;
+	uint8_t segment_last[32];
+	int complete;
+	int gen;					// transponder it was last counted for
+};
+
+struct eit_table {
+	int tables;
+	eit_event_cb cb;
+	void *priv;
+	struct hmap subtables;		// (table_id, onid, tsid, sid) -> struct eit_subtable
+	struct hmap events;			// (onid, tsid, sid, event_id) -> version + 1
+	int gen;
+	int n_touched;
+	int n_complete;
+	time_t last_new;
+};
+
+static uint64_t subtable_key(int table_id, int onid, int tsid, int sid)
+{
+	return (uint64_t)table_id << 48 | (uint64_t)(onid & 0xffff) << 32 |
+		(uint64_t)(tsid & 0xffff) << 16 | (sid & 0xffff);
+}
+
+static uint64_t event_key(int onid, int tsid, int sid, int event_id)
+{
+	return (uint64_t)(onid & 0xffff) << 48 | (uint64_t)(tsid & 0xffff) << 32 |
+		(uint64_t)(sid & 0xffff) << 16 | (event_id & 0xffff);
+}
+
+struct eit_table *eit_table_create(int tables, eit_event_cb cb, void *priv)
+{
+	struct eit_table *t = calloc(1, sizeof(struct eit_table));
+
+	t->tables = tables;
+	t->cb = cb;
+	t->priv = priv;
+	hmap_init(&t->subtables, 1024);
+	hmap_init(&t->events, 16384);
+	return t;
+}
+
+void eit_table_free(struct eit_table *t)
+{
+	struct eit_subtable *st;
+	uint64_t key;
+
+	if (!t)
+		return;
+	HMAP_FOREACH(&t->subtables, key, st,
+		free(st);
+	);
+	hmap_free(&t->subtables);
+	hmap_free(&t->events);
+	free(t);
+}
+
+void eit_begin_tp(struct eit_table *t)
+{
+	t->gen++;
+	t->n_touched = 0;
+	t->n_complete = 0;
+	time(&t->last_new);
+}
+
+static int wanted(const struct eit_table *t, int table_id)
+{
+	if (table_id == TID_EIT_ACTUAL || (table_id >= 0x50 && table_id <= 0x5f))
+		return 1;
+	if (table_id == TID_EIT_OTHER || (table_id >= 0x60 && table_id <= 0x6f))
+		return (t->tables & EIT_OTHER) != 0;
+	return 0;
+}
+
+static int subtable_complete(const struct eit_subtable *st)
+{
+	int seg, i, last;
+
+	if (st->version < 0)
+		return 0;
+	for (seg = 0; seg <= st->last_section / 8; seg++) {
+		if (!(st->segment_seen & (1u << seg)))
+			return 0;
+		last = st->segment_last[seg];
+		if (last > st->last_section)
+			last = st->last_section;
+		for (i = seg * 8; i <= last; i++) {
+			if (!(st->section_done[i / 8] & (1 << (i % 8))))
+				return 0;
+		}
+	}
+	return 1;
+}
+
+// counts the sub-table for the current transponder the first time it turns up there
+static struct eit_subtable *touch(struct eit_table *t, uint64_t key)
+{
+	struct eit_subtable *st;
+
+	if ((st = hmap_get(&t->subtables, key)) == NULL) {
+		st = calloc(1, sizeof(struct eit_subtable));
+		st->version = -1;
+		hmap_put(&t->subtables, key, st);
+	}
+	if (st->gen != t->gen) {
+		st->gen = t->gen;
+		t->n_touched++;
+		if (st->complete)
+			t->n_complete++;
+		time(&t->last_new);
+	}
+	return st;
+}
+
+static void set_complete(struct eit_table *t, struct eit_subtable *st, int complete)
+{
+	if (st->complete == complete)
+		return;
+	st->complete = complete;
+	t->n_complete += (complete)? 1 : -1;
+}
+
+static time_t mjd_time(const unsigned char *p)
+{
+	int mjd = p[0] << 8 | p[1];
+
+	if (mjd == 0xffff)
+		return 0;
+	return (time_t)(mjd - 40587) * 86400 +
+		((p[2] >> 4) * 10 + (p[2] & 0x0f)) * 3600 +
+		((p[3] >> 4) * 10 + (p[3] & 0x0f)) * 60 +
+		(p[4] >> 4) * 10 + (p[4] & 0x0f);
+}
+
+static int bcd_duration(const unsigned char *p)
+{
+	return ((p[0] >> 4) * 10 + (p[0] & 0x0f)) * 3600 +
+		((p[1] >> 4) * 10 + (p[1] & 0x0f)) * 60 +
+		(p[2] >> 4) * 10 + (p[2] & 0x0f);
+}
+
+static char *text_utf8(const unsigned char *buf, int len)
+{
+	char *r;
+	char *dvbtext = malloc(len + 1);
+	memcpy(dvbtext, buf, len);
+	dvbtext[len] = '\0';
+	r = dvbtext2utf8(dvbtext, len + 1);
+	free(dvbtext);
+	return r;
+}
+
+// the items of the extended event descriptors are skipped, only the text is kept
+static void add_extended(char **ext, const char *lang, const unsigned char *desc)
+{
+	const unsigned char *p = desc + 2, *end = desc + 2 + desc[1];
+	char *text;
+	size_t len;
+
+	if (p + 5 > end || (lang[0] && memcmp(p + 1, lang, 3)))
+		return;
+	p += 5 + p[4];
+	if (p + 1 > end || p + 1 + p[0] > end || p[0] == 0)
+		return;
+	text = text_utf8(p + 1, p[0]);
+	if (!text)
+		return;
+	len = (*ext)? strlen(*ext) : 0;
+	*ext = realloc(*ext, len + strlen(text) + 1);
+	strcpy(*ext + len, text);
+	free(text);
+}
+
+static void parse_event(struct eit_table *t, struct eit_event *ev,
+		const unsigned char *buf, int desc_len)
+{
+	const unsigned char *desc = buf + 12, *end = buf + 12 + desc_len;
+	char *title = NULL, *text = NULL, *ext = NULL;
+	const unsigned char *p, *dend;
+
+	ev->event_id = buf[0] << 8 | buf[1];
+	ev->start = mjd_time(buf + 2);
+	ev->duration = bcd_duration(buf + 7);
+	ev->running = buf[10] >> 5;
+	ev->free_ca = (buf[10] >> 4) & 1;
+	ev->lang[0] = '\0';
+	ev->content = -1;
+	ev->parental_rating = -1;
+
+	for (; desc + 2 <= end && desc + 2 + desc[1] <= end; desc += 2 + desc[1]) {
+		p = desc + 2;
+		dend = p + desc[1];
+		switch (desc[0]) {
+		case 0x4d:	// short event
+			if (title || desc[1] < 5)
+				break;
+			memcpy(ev->lang, p, 3);
+			ev->lang[3] = '\0';
+			if (p + 4 + p[3] > dend)
+				break;
+			title = text_utf8(p + 4, p[3]);
+			p += 4 + p[3];
+			if (p + 1 <= dend && p + 1 + p[0] <= dend && p[0])
+				text = text_utf8(p + 1, p[0]);
+			break;
+		case 0x4e:	// extended event, its parts in descriptor_number order
+			add_extended(&ext, ev->lang, desc);
+			break;
+		case 0x54:	// content
+			if (ev->content < 0 && desc[1] >= 2)
+				ev->content = p[0];
+			break;
+		case 0x55:	// parental rating, country code then rating
+			if (ev->parental_rating < 0 && desc[1] >= 4)
+				ev->parental_rating = p[3];
+			break;
+		}
+	}
+	ev->title = title;
+	ev->text = text;
+	ev->extended = ext;
+	t->cb(t->priv, ev);
+	free(title);
+	free(text);
+	free(ext);
+}
+
+int eit_parse_section(struct eit_table *t, const unsigned char *buf)
+{
+	struct eit_subtable *st;
+	struct eit_event ev;
+	const unsigned char *p, *end;
+	uint64_t ekey;
+	void *old;
+	int table_id, section_length, version, section, last_section;
+	int onid, tsid, sid, segment_last, last_table_id, tid, desc_len;
+
+	table_id = buf[0];
+	if (!wanted(t, table_id))
+		return 0;
+	section_length = getBits(buf, 12, 12);
+	if (section_length < EIT_HEADER_LEN - 3 + EIT_CRC_LEN || !(buf[5] & 0x01))
+		return 0;
+	sid = buf[3] << 8 | buf[4];
+	version = (buf[5] >> 1) & 0x1f;
+	section = buf[6];
+	last_section = buf[7];
+	tsid = buf[8] << 8 | buf[9];
+	onid = buf[10] << 8 | buf[11];
+	segment_last = buf[12];
+	last_table_id = buf[13];
+
+	// the schedule announces the other table_ids of the service
+	if (table_id >= 0x50 && last_table_id > table_id && (last_table_id & 0xf0) == (table_id & 0xf0)) {
+		for (tid = (table_id & 0xf0); tid <= last_table_id; tid++)
+			touch(t, subtable_key(tid, onid, tsid, sid));
+	}
+
+	st = touch(t, subtable_key(table_id, onid, tsid, sid));
+	if (st->version != version) {
+		if (st->version >= 0)
+			verbosedebug("EIT 0x%02X 0x%04X/0x%04X/0x%04X: version %d -> %d\n",
+				table_id, onid, tsid, sid, st->version, version);
+		st->version = version;
+		memset(st->section_done, 0, sizeof(st->section_done));
+		st->segment_seen = 0;
+		set_complete(t, st, 0);
+	}
+	st->last_section = last_section;
+	if (section > last_section)
+		return 0;
+	if (!(st->section_done[section / 8] & (1 << (section % 8)))) {
+		st->section_done[section / 8] |= 1 << (section % 8);
+		st->segment_seen |= 1u << (section / 8);
+		st->segment_last[section / 8] = segment_last;
+
+		ev.onid = onid;
+		ev.tsid = tsid;
+		ev.sid = sid;
+		ev.version = version;
+		ev.table_id = table_id;
+		p = buf + EIT_HEADER_LEN;
+		end = buf + 3 + section_length - EIT_CRC_LEN;
+		while (p + 12 <= end) {
+			desc_len = getBits(p + 10, 4, 12);
+			if (p + 12 + desc_len > end)
+				break;
+			ekey = event_key(onid, tsid, sid, p[0] << 8 | p[1]);
+			old = hmap_put(&t->events, ekey, (void *)(uintptr_t)(version + 1));
+			if (old != (void *)(uintptr_t)(version + 1))
+				parse_event(t, &ev, p, desc_len);
+			p += 12 + desc_len;
+		}
+		set_complete(t, st, subtable_complete(st));
+	}
+
+	return t->n_touched > 0 && t->n_complete == t->n_touched &&
+		time(NULL) - t->last_new >= EIT_SETTLE;
+}
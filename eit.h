@@ -0,0 +1,50 @@
+#ifndef __EIT_H__
+#define __EIT_H__
+
+#include <time.h>
+
+/*
+ * Event information collected during the scan. Sections of the EIT PID are
+ * tracked per sub-table (table_id, onid, tsid, sid) and segment, every
+ * event is reported once per (onid, tsid, sid, event_id, version) through
+ * the callback given to eit_table_create().
+ */
+
+#define EIT_ACTUAL		1	/* present/following and schedule of the tuned TS */
+#define EIT_OTHER		2	/* and those of other transport streams */
+
+// strings are UTF-8 and only valid during the callback
+struct eit_event {
+	int onid;
+	int tsid;
+	int sid;
+	int event_id;
+	int version;
+	int table_id;
+	time_t start;			/* UTC, 0 if undefined */
+	int duration;			/* seconds */
+	int running;
+	int free_ca;
+	char lang[4];			/* of the short event, "" if none */
+	const char *title;
+	const char *text;		/* short event text */
+	const char *extended;	/* extended event text of the same language */
+	int content;			/* first content_nibble byte, -1 if none */
+	int parental_rating;	/* first rating, -1 if none */
+};
+
+typedef void (*eit_event_cb)(void *priv, const struct eit_event *ev);
+
+struct eit_table;
+
+extern struct eit_table *eit_table_create(int tables, eit_event_cb cb, void *priv);
+extern void eit_table_free(struct eit_table *t);
+
+// a new transponder, completion is tracked for its sub-tables only
+extern void eit_begin_tp(struct eit_table *t);
+
+// a section of the EIT PID, CRC checked; returns 1 once every sub-table
+// seen on this transponder is complete and no new one turned up for a while
+extern int eit_parse_section(struct eit_table *t, const unsigned char *buf);
+
+#endif
@@ -0,0 +1,205 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "hmap.h"
+
+#define HMAP_MINSIZE	16
+
+#define LSB		0x0101010101010101ULL
+#define MSB		0x8080808080808080ULL
+
+// murmur3 finalizer, every key bit affects every hash bit
+static uint32_t hash_u64(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return (uint32_t)k;
+}
+
+static inline uint8_t h2(uint32_t hash)
+{
+	return hash >> 25;
+}
+
+// control bytes pos .. pos+7, the byte at pos in the lowest bits
+static inline uint64_t load_group(const uint8_t *ctrl, uint32_t pos)
+{
+	uint64_t g;
+
+	memcpy(&g, ctrl + pos, sizeof(g));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	g = __builtin_bswap64(g);
+#endif
+	return g;
+}
+
+// MSB of every byte equal to b, may flag bytes above a real match too
+static inline uint64_t match_byte(uint64_t g, uint8_t b)
+{
+	uint64_t x = g ^ (LSB * b);
+
+	return (x - LSB) & ~x & MSB;
+}
+
+static inline uint64_t match_empty(uint64_t g)
+{
+	return g & MSB;
+}
+
+static inline int first_byte(uint64_t m)
+{
+	return __builtin_ctzll(m) >> 3;
+}
+
+static void set_ctrl(struct hmap *h, uint32_t i, uint8_t c)
+{
+	h->ctrl[i] = c;
+	if (i < HMAP_GROUP)
+		h->ctrl[h->mask + 1 + i] = c;
+}
+
+static void alloc_slots(struct hmap *h, uint32_t cap)
+{
+	h->mask = cap - 1;
+	h->count = 0;
+	h->ctrl = malloc(cap + HMAP_GROUP);
+	memset(h->ctrl, HMAP_EMPTY, cap + HMAP_GROUP);
+	h->slots = malloc(cap * sizeof(struct hmap_slot));
+}
+
+void hmap_init(struct hmap *h, uint32_t size)
+{
+	uint32_t cap = HMAP_MINSIZE;
+
+	// keep the load factor below 3/4
+	while (cap / 4 * 3 < size)
+		cap <<= 1;
+	alloc_slots(h, cap);
+}
+
+void hmap_free(struct hmap *h)
+{
+	free(h->ctrl);
+	free(h->slots);
+	h->ctrl = NULL;
+	h->slots = NULL;
+	h->mask = 0;
+	h->count = 0;
+}
+
+// slot index of key or -1
+static int64_t find(const struct hmap *h, uint64_t key, uint32_t hash)
+{
+	uint32_t pos = hash & h->mask;
+	uint8_t tag = h2(hash);
+	uint64_t g, m;
+	uint32_t i;
+
+	for (;;) {
+		g = load_group(h->ctrl, pos);
+		for (m = match_byte(g, tag); m; m &= m - 1) {
+			i = (pos + first_byte(m)) & h->mask;
+			if (h->slots[i].key == key)
+				return i;
+		}
+		// linear probing: the key can't be past an empty slot
+		if (match_empty(g))
+			return -1;
+		pos = (pos + HMAP_GROUP) & h->mask;
+	}
+}
+
+// the slot is known to be new, no lookup
+static void insert_new(struct hmap *h, uint64_t key, void *val, uint32_t hash)
+{
+	uint32_t pos = hash & h->mask;
+	uint64_t m;
+	uint32_t i;
+
+	while (!(m = match_empty(load_group(h->ctrl, pos))))
+		pos = (pos + HMAP_GROUP) & h->mask;
+	i = (pos + first_byte(m)) & h->mask;
+	set_ctrl(h, i, h2(hash));
+	h->slots[i].key = key;
+	h->slots[i].val = val;
+	h->slots[i].hash = hash;
+	h->count++;
+}
+
+static void grow(struct hmap *h)
+{
+	uint8_t *old_ctrl = h->ctrl;
+	struct hmap_slot *old_slots = h->slots;
+	uint32_t i, old_cap = h->mask + 1;
+
+	alloc_slots(h, old_cap * 2);
+	for (i = 0; i < old_cap; i++) {
+		if (!(old_ctrl[i] & HMAP_EMPTY))
+			insert_new(h, old_slots[i].key, old_slots[i].val, old_slots[i].hash);
+	}
+	free(old_ctrl);
+	free(old_slots);
+}
+
+void *hmap_get(const struct hmap *h, uint64_t key)
+{
+	int64_t i;
+
+	if (!h->ctrl)
+		return NULL;
+	i = find(h, key, hash_u64(key));
+	return (i < 0)? NULL : h->slots[i].val;
+}
+
+void *hmap_put(struct hmap *h, uint64_t key, void *val)
+{
+	uint32_t hash = hash_u64(key);
+	int64_t i;
+	void *old;
+
+	if (!h->ctrl)
+		hmap_init(h, 0);
+	if ((i = find(h, key, hash)) >= 0) {
+		old = h->slots[i].val;
+		h->slots[i].val = val;
+		return old;
+	}
+	if ((h->count + 1) * 4 > (h->mask + 1) * 3)
+		grow(h);
+	insert_new(h, key, val, hash);
+	return NULL;
+}
+
+void *hmap_remove(struct hmap *h, uint64_t key)
+{
+	uint32_t i, j, home;
+	int64_t found;
+	void *val;
+
+	if (!h->ctrl || (found = find(h, key, hash_u64(key))) < 0)
+		return NULL;
+	i = found;
+	val = h->slots[i].val;
+	set_ctrl(h, i, HMAP_EMPTY);
+	h->count--;
+
+	// backward shift: pull up entries whose probe sequence crossed slot i
+	for (j = (i + 1) & h->mask; !(h->ctrl[j] & HMAP_EMPTY); j = (j + 1) & h->mask) {
+		home = h->slots[j].hash & h->mask;
+		if (((j - home) & h->mask) < ((j - i) & h->mask))
+			continue;	// home lies between i and j, stays
+		h->slots[i] = h->slots[j];
+		set_ctrl(h, i, h->ctrl[j]);
+		set_ctrl(h, j, HMAP_EMPTY);
+		i = j;
+	}
+	return val;
+}
+
+uint32_t hmap_len(const struct hmap *h)
+{
+	return h->count;
+}
@@ -0,0 +1,56 @@
+#ifndef __HMAP_H__
+#define __HMAP_H__
+
+#include <stdint.h>
+
+/*
+ * Open addressing hash map from 64 bit integer keys to non-NULL pointers.
+ *
+ * Slots are probed linearly, eight control bytes at a time: a control byte
+ * holds 7 bits of the slot's hash or HMAP_EMPTY, so most mismatches are
+ * rejected without touching the slot itself. Removal shifts the following
+ * entries back instead of leaving tombstones.
+ */
+
+#define HMAP_EMPTY	0x80
+#define HMAP_GROUP	8
+
+struct hmap_slot {
+	uint64_t key;
+	void *val;
+	uint32_t hash;
+};
+
+struct hmap {
+	uint8_t *ctrl;		// mask + 1 + HMAP_GROUP bytes, the tail mirrors the head
+	struct hmap_slot *slots;
+	uint32_t mask;
+	uint32_t count;
+};
+
+// the map must not be modified inside the action, break and continue work
+#define HMAP_FOREACH(hmap_ptr, keyvar, valvar, action)		\
+do {														\
+	uint32_t __i;											\
+	for (__i = 0; (hmap_ptr)->ctrl && __i <= (hmap_ptr)->mask; __i++) {	\
+		if ((hmap_ptr)->ctrl[__i] & HMAP_EMPTY)				\
+			continue;										\
+		keyvar = (hmap_ptr)->slots[__i].key;				\
+		valvar = (hmap_ptr)->slots[__i].val;				\
+		(void)(keyvar);										\
+		{action}											\
+	}														\
+} while (0)
+
+// size is the expected number of entries, the map grows as needed
+extern void hmap_init(struct hmap *h, uint32_t size);
+extern void hmap_free(struct hmap *h);
+// returns the value or NULL
+extern void *hmap_get(const struct hmap *h, uint64_t key);
+// inserts or replaces, returns the replaced value or NULL
+extern void *hmap_put(struct hmap *h, uint64_t key, void *val);
+// returns the removed value or NULL
+extern void *hmap_remove(struct hmap *h, uint64_t key);
+extern uint32_t hmap_len(const struct hmap *h);
+
+#endif
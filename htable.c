@@ -146,37 +146,111 @@ int htable_len(struct htable *h)
 }
 
 #ifdef HASH_TEST
+/*
+ * Compares this table with hmap.c on service keys.
+ *
+ * Reads "sid:nid:tid" lines or the BAT lines of a scan-s2 -b -vvvvv log
+ * ("== bouquet(...)<--tid=..,sid=..,nid=..") from stdin:
+ *   make hash-bench && scan-s2 -b -vvvvv ... 2>&1 | ./hash-bench 256
+ */
 #include <stdio.h>
+#include <time.h>
+
+#include "hmap.h"
+
+#define ROUNDS	20
+
+struct entry {
+	unsigned char key[6];
+	struct htable_entry hash;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void set_key(unsigned char *key, uint64_t k)
+{
+	int i;
+	for (i = 0; i < 6; i++)
+		key[i] = k >> (8 * i) & 0xff;
+}
+
+static int read_keys(uint64_t **keys)
+{
+	char line[512], *p;
+	int nid, tid, sid, n = 0, size = 0;
+
+	while (fgets(line, sizeof(line), stdin)) {
+		if ((p = strstr(line, "<--tid=")) != NULL) {
+			if (sscanf(p, "<--tid=%d,sid=%d,nid=%d", &tid, &sid, &nid) != 3)
+				continue;
+		} else if (sscanf(line, "%d:%d:%d", &sid, &nid, &tid) != 3)
+			continue;
+		if (n == size) {
+			size = size ? size * 2 : 1024;
+			*keys = realloc(*keys, size * sizeof(uint64_t));
+		}
+		(*keys)[n++] = (uint64_t)(nid & 0xffff) << 32 | (uint64_t)(tid & 0xffff) << 16 | (sid & 0xffff);
+	}
+	return n;
+}
 
 int main (int argc, char **argv)
 {
-	struct entry {
-		unsigned char key[6];
-		struct htable_entry hash;
-	};
-	int nid, tid, sid, i, count, max_probes, n_probes, n_buckets, n_dup = 0;
-	struct entry e, *ep;
+	int i, r, n, count, max_probes, n_probes, n_buckets, n_dup = 0, found;
+	uint64_t *keys = NULL, k;
+	struct entry e, *ep, **entries;
 	struct htable ht;
 	struct htable_entry *p;
+	struct hmap hm;
+	void *v;
+	double t0, t_ins[2], t_get[2], t_iter[2];
 
-	htable_init(&ht, atoi(argv[1]), 0);
-	while (fscanf(stdin, "%d:%d:%d", &sid, &nid, &tid) == 3) {
-		e.key[0] = sid & 0xff;
-		e.key[1] = sid>>8 & 0xff;
-		e.key[2] = tid & 0xff;
-		e.key[3] = tid>>8 & 0xff;
-		e.key[4] = nid & 0xff;
-		e.key[5] = nid>>8 & 0xff;
+	n = read_keys(&keys);
+	if (n == 0) {
+		fprintf(stderr, "no keys on stdin\n");
+		return 1;
+	}
+	entries = calloc(n, sizeof(*entries));
+
+	// chained table, entries allocated one by one as in bouquet.c used to
+	htable_init(&ht, (argc > 1)? atoi(argv[1]) : 256, argc > 2);
+	t0 = now();
+	for (i = 0; i < n; i++) {
+		set_key(e.key, keys[i]);
 		htable_entry_init(&e.hash, e.key, 6);
 		if (htable_lookup(&ht, &e.hash) == NULL) {
 			ep = malloc(sizeof(struct entry));
 			memcpy(ep, &e, sizeof(e));
 			htable_entry_init(&ep->hash, ep->key, 6);
 			htable_insert(&ht, &ep->hash);
+			entries[i] = ep;
 		} else {
 			n_dup++;
 		}
 	}
+	t_ins[0] = now() - t0;
+	found = 0;
+	t0 = now();
+	for (r = 0; r < ROUNDS; r++) {
+		for (i = 0; i < n; i++) {
+			set_key(e.key, keys[i]);
+			htable_entry_init(&e.hash, e.key, 6);
+			found += htable_lookup(&ht, &e.hash) != NULL;
+		}
+	}
+	t_get[0] = now() - t0;
+	t0 = now();
+	for (r = 0; r < ROUNDS; r++) {
+		HTABLE_FOREACH(&ht, ep, struct entry, hash,
+			found += ep->key[0];
+		);
+	}
+	t_iter[0] = now() - t0;
 
 	max_probes = 0; n_probes = 0; n_buckets = 0;
 	for (i = 0; i < ht.size; i++) {
@@ -188,10 +262,46 @@ int main (int argc, char **argv)
 		n_probes += count;
 		if (count > max_probes)
 			max_probes = count;
-		printf("%d %d\n", i, count);
 	}
-	fprintf(stderr, "dup: %d\nmax: %d\navg: %.2f\n", n_dup, max_probes, (double)n_probes / n_buckets);
 
+	// open addressing, keys inline
+	hmap_init(&hm, 0);
+	t0 = now();
+	for (i = 0; i < n; i++) {
+		if (hmap_get(&hm, keys[i]) == NULL)
+			hmap_put(&hm, keys[i], &keys[i]);
+	}
+	t_ins[1] = now() - t0;
+	t0 = now();
+	for (r = 0; r < ROUNDS; r++) {
+		for (i = 0; i < n; i++)
+			found += hmap_get(&hm, keys[i]) != NULL;
+	}
+	t_get[1] = now() - t0;
+	t0 = now();
+	for (r = 0; r < ROUNDS; r++) {
+		HMAP_FOREACH(&hm, k, v,
+			found += k & 0xff;
+		);
+	}
+	t_iter[1] = now() - t0;
+	(void)v;
+
+	printf("keys: %d, unique: %d, htable buckets: %d\n", n, n - n_dup, ht.size);
+	printf("htable chains: max %d, avg %.2f\n", max_probes, (double)n_probes / n_buckets);
+	printf("%-8s %12s %12s %12s\n", "", "insert ns", "lookup ns", "iterate ns");
+	printf("%-8s %12.1f %12.1f %12.1f\n", "htable",
+		t_ins[0] * 1e9 / n, t_get[0] * 1e9 / ((double)n * ROUNDS), t_iter[0] * 1e9 / ((double)(n - n_dup) * ROUNDS));
+	printf("%-8s %12.1f %12.1f %12.1f\n", "hmap",
+		t_ins[1] * 1e9 / n, t_get[1] * 1e9 / ((double)n * ROUNDS), t_iter[1] * 1e9 / ((double)(n - n_dup) * ROUNDS));
+	fprintf(stderr, "(%d)\n", found & 1);
+
+	for (i = 0; i < n; i++)
+		free(entries[i]);
+	free(entries);
+	htable_free(&ht);
+	hmap_free(&hm);
+	free(keys);
 	return 0;
 }
 #endif
@@ -0,0 +1,294 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "lcn.h"
+#include "hmap.h"
+#include "section.h"
+
+// private data specifiers
+#define PDS_BSKYB		0x00000002
+#define PDS_EACEM		0x00000028
+#define PDS_NORDIG		0x00000029
+#define PDS_UK_DTT		0x0000233a
+#define PDS_FREESAT		0x46534154
+
+struct lcn_entry {
+	int lcn;
+	int bouquet_id;		// -1 from the NIT
+	int region;			// -1 for all regions
+	int visible;
+};
+
+// the numbers one service got, from every network, bouquet and region
+struct lcn_service {
+	struct lcn_entry *entries;
+	int n_entries;
+	int size;
+};
+
+struct lcn_table {
+	struct hmap services;	// (onid, tsid, sid) -> struct lcn_service
+};
+
+static uint64_t lcn_key(int onid, int tsid, int sid)
+{
+	return (uint64_t)(onid & 0xffff) << 32 | (uint64_t)(tsid & 0xffff) << 16 | (sid & 0xffff);
+}
+
+struct lcn_table *lcn_table_create(void)
+{
+	struct lcn_table *t = malloc(sizeof(struct lcn_table));
+
+	hmap_init(&t->services, 1024);
+	return t;
+}
+
+void lcn_table_free(struct lcn_table *t)
+{
+	struct lcn_service *ls;
+	uint64_t key;
+
+	if (!t)
+		return;
+	HMAP_FOREACH(&t->services, key, ls,
+		free(ls->entries);
+		free(ls);
+	);
+	hmap_free(&t->services);
+	free(t);
+}
+
+// tables are seen on many transponders, a repeated record replaces the old one
+static void lcn_add(struct lcn_table *t, int onid, int tsid, int sid,
+		int bouquet_id, int region, int lcn, int visible)
+{
+	uint64_t key = lcn_key(onid, tsid, sid);
+	struct lcn_service *ls;
+	struct lcn_entry *e;
+	int i;
+
+	if (lcn == 0)
+		return;
+	if ((ls = hmap_get(&t->services, key)) == NULL) {
+		ls = calloc(1, sizeof(struct lcn_service));
+		hmap_put(&t->services, key, ls);
+	}
+	for (i = 0; i < ls->n_entries; i++) {
+		e = &ls->entries[i];
+		if (e->bouquet_id == bouquet_id && e->region == region) {
+			e->lcn = lcn;
+			e->visible = visible;
+			return;
+		}
+	}
+	if (ls->n_entries == ls->size) {
+		ls->size = (ls->size)? ls->size * 2 : 2;
+		ls->entries = realloc(ls->entries, ls->size * sizeof(struct lcn_entry));
+	}
+	e = &ls->entries[ls->n_entries++];
+	e->lcn = lcn;
+	e->bouquet_id = bouquet_id;
+	e->region = region;
+	e->visible = visible;
+	debug("LCN %d%s for 0x%04X/0x%04X/0x%04X, bouquet %d, region %d\n", lcn,
+		(visible)? "" : " (hidden)", onid, tsid, sid, bouquet_id, region);
+}
+
+void lcn_parse_nit_descriptor(struct lcn_table *t, const unsigned char *buf,
+		int onid, int tsid, uint32_t pds)
+{
+	const unsigned char *p = buf + 2, *end = buf + 2 + buf[1];
+	const unsigned char *list_end;
+	int sid, lcn, list_id;
+
+	switch (buf[0]) {
+	case 0x83:
+		// EACEM and UK DTT have 10 bit numbers, NorDig v1 14 bit
+		if (pds != 0 && pds != PDS_EACEM && pds != PDS_NORDIG && pds != PDS_UK_DTT)
+			break;
+		for (; p + 4 <= end; p += 4) {
+			sid = p[0] << 8 | p[1];
+			if (pds == PDS_NORDIG)
+				lcn = (p[2] & 0x3f) << 8 | p[3];
+			else
+				lcn = (p[2] & 0x03) << 8 | p[3];
+			lcn_add(t, onid, tsid, sid, -1, -1, lcn, p[2] >> 7);
+		}
+		break;
+
+	case 0x87:
+		// NorDig v2: channel lists with name and country, 14 bit numbers
+		if (pds != 0 && pds != PDS_NORDIG)
+			break;
+		while (p + 2 <= end) {
+			list_id = p[0];
+			p += 2 + p[1];
+			if (p + 4 > end)
+				break;
+			list_end = p + 4 + p[3];
+			if (list_end > end)
+				break;
+			for (p += 4; p + 4 <= list_end; p += 4) {
+				sid = p[0] << 8 | p[1];
+				lcn = (p[2] & 0x3f) << 8 | p[3];
+				lcn_add(t, onid, tsid, sid, -1, list_id, lcn, p[2] >> 7);
+			}
+			p = list_end;
+		}
+		break;
+	}
+}
+
+// a descriptor of the BAT transport stream loop
+static void parse_bat_descriptor(struct lcn_table *t, const unsigned char *buf,
+		int onid, int tsid, int bouquet_id, uint32_t pds)
+{
+	const unsigned char *p = buf + 2, *end = buf + 2 + buf[1];
+	const unsigned char *list_end;
+	int sid, lcn, region;
+
+	switch (buf[0]) {
+	case 0xb1:
+		// Sky: region, then (sid, type, channel id, lcn, sky id) records
+		if ((pds != 0 && pds != PDS_BSKYB) || p + 2 > end)
+			break;
+		region = (p[1] == 0xff)? -1 : p[1];
+		for (p += 2; p + 9 <= end; p += 9) {
+			sid = p[0] << 8 | p[1];
+			lcn = p[5] << 8 | p[6];
+			if (lcn != 0xffff)
+				lcn_add(t, onid, tsid, sid, bouquet_id, region, lcn, 1);
+		}
+		break;
+
+	case 0xd3:
+		// Freesat: (sid, channel id, (lcn, region)...) records
+		if (pds != 0 && pds != PDS_FREESAT)
+			break;
+		while (p + 5 <= end) {
+			sid = p[0] << 8 | p[1];
+			list_end = p + 5 + p[4];
+			if (list_end > end)
+				break;
+			for (p += 5; p + 4 <= list_end; p += 4) {
+				lcn = (p[0] & 0x0f) << 8 | p[1];
+				region = p[2] << 8 | p[3];
+				lcn_add(t, onid, tsid, sid, bouquet_id,
+					(region == 0xffff)? -1 : region, lcn, 1);
+			}
+			p = list_end;
+		}
+		break;
+	}
+}
+
+void lcn_parse_bat(struct lcn_table *t, const unsigned char *buf,
+		int section_length, int bouquet_id)
+{
+	const unsigned char *end = buf + section_length;
+	const unsigned char *desc, *desc_end;
+	int onid, tsid, len;
+	uint32_t pds;
+
+	// bouquet descriptors, nothing per service there
+	len = getBits(buf, 4, 12);
+	buf += 2 + len;
+	if (buf + 2 > end)
+		return;
+	buf += 2;
+
+	// transport stream loop
+	while (buf + 6 <= end) {
+		tsid = getBits(buf, 0, 16);
+		onid = getBits(buf + 2, 0, 16);
+		len = getBits(buf + 4, 4, 12);
+		desc = buf + 6;
+		desc_end = desc + len;
+		if (desc_end > end)
+			break;
+		pds = 0;
+		for (; desc + 2 <= desc_end && desc + 2 + desc[1] <= desc_end; desc += 2 + desc[1]) {
+			if (desc[0] == 0x5f && desc[1] >= 4)
+				pds = getBits(desc + 2, 0, 32);
+			else
+				parse_bat_descriptor(t, desc, onid, tsid, bouquet_id, pds);
+		}
+		buf = desc_end;
+	}
+}
+
+// lower is better: the selected bouquet and region, all regions, visible,
+// then the NIT before bouquets and lower ids for a stable choice
+static int better(const struct lcn_entry *a, const struct lcn_entry *b,
+		const struct lcn_select *sel)
+{
+	int ka[5], kb[5], i;
+
+	ka[0] = !(sel->bouquet_id >= 0 && a->bouquet_id == sel->bouquet_id);
+	kb[0] = !(sel->bouquet_id >= 0 && b->bouquet_id == sel->bouquet_id);
+	ka[1] = (sel->region >= 0 && a->region == sel->region)? 0 : (a->region < 0)? 1 : 2;
+	kb[1] = (sel->region >= 0 && b->region == sel->region)? 0 : (b->region < 0)? 1 : 2;
+	ka[2] = !a->visible;
+	kb[2] = !b->visible;
+	ka[3] = a->bouquet_id;
+	kb[3] = b->bouquet_id;
+	ka[4] = a->region;
+	kb[4] = b->region;
+	for (i = 0; i < 5; i++) {
+		if (ka[i] != kb[i])
+			return ka[i] < kb[i];
+	}
+	return a->lcn < b->lcn;
+}
+
+static const struct lcn_entry *choose(const struct lcn_service *ls, const struct lcn_select *sel)
+{
+	const struct lcn_entry *e, *best = NULL;
+	int i;
+
+	for (i = 0; i < ls->n_entries; i++) {
+		e = &ls->entries[i];
+		if (sel->bouquet_id >= 0 && e->bouquet_id >= 0 && e->bouquet_id != sel->bouquet_id)
+			continue;
+		if (sel->region >= 0 && e->region >= 0 && e->region != sel->region)
+			continue;
+		if (!best || better(e, best, sel))
+			best = e;
+	}
+	return best;
+}
+
+void lcn_apply(struct lcn_table *t, struct list_head *transponders,
+		const struct lcn_select *sel)
+{
+	struct list_head *p1, *p2;
+	struct transponder *tp;
+	struct service *s;
+	struct lcn_service *ls;
+	const struct lcn_entry *e;
+	int n = 0, n_lcn = 0;
+
+	list_for_each(p1, transponders) {
+		tp = list_entry(p1, struct transponder, list);
+		list_for_each(p2, &tp->services) {
+			s = list_entry(p2, struct service, list);
+			n++;
+			ls = hmap_get(&t->services,
+				lcn_key(tp->original_network_id, tp->transport_stream_id, s->service_id));
+			if (!ls || (e = choose(ls, sel)) == NULL)
+				continue;
+			s->channel_num = e->lcn;
+			s->lcn_hidden = !e->visible;
+			n_lcn++;
+		}
+	}
+	info("logical channel numbers for %d of %d services\n", n_lcn, n);
+}
+
+uint32_t lcn_rank(const struct service *s)
+{
+	if (s->channel_num <= 0)
+		return 2u << 24;
+	return (uint32_t)s->lcn_hidden << 24 | (s->channel_num & 0xffffff);
+}
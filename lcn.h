@@ -0,0 +1,40 @@
+#ifndef __LCN_H__
+#define __LCN_H__
+
+#include "list.h"
+#include "scan.h"
+
+/*
+ * Logical channel numbers. The records of the NIT (EACEM/NorDig 0x83,
+ * NorDig v2 0x87) and the BAT (Sky 0xB1, Freesat 0xD3) are collected per
+ * (onid, tsid, sid) while scanning; lcn_apply() picks one number per
+ * service into service.channel_num after the scan.
+ */
+
+struct lcn_table;
+
+// -1 for any; region is the Sky/Freesat region or the NorDig channel list
+struct lcn_select {
+	int bouquet_id;
+	int region;
+};
+
+extern struct lcn_table *lcn_table_create(void);
+extern void lcn_table_free(struct lcn_table *t);
+
+// a descriptor of the NIT transport stream loop; pds is the private data
+// specifier in effect, 0 for none
+extern void lcn_parse_nit_descriptor(struct lcn_table *t, const unsigned char *buf,
+		int onid, int tsid, uint32_t pds);
+
+// buf and section_length as for bouquet_parse_bat()
+extern void lcn_parse_bat(struct lcn_table *t, const unsigned char *buf,
+		int section_length, int bouquet_id);
+
+extern void lcn_apply(struct lcn_table *t, struct list_head *transponders,
+		const struct lcn_select *sel);
+
+// sort key for LCN order: numbered visible services, hidden ones, the rest
+extern uint32_t lcn_rank(const struct service *s);
+
+#endif
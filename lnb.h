@@ -1,3 +1,6 @@
+#ifndef __LNB_H__
+#define __LNB_H__
+
 
 struct lnb_types_st {
 	char	*name;
@@ -22,3 +25,5 @@ lnb_enum(int curno);
 int
 lnb_decode(char *str, struct lnb_types_st *lnbp);
 
+
+#endif
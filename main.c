@@ -0,0 +1,898 @@
+/*
+*  scan-s2 command line client of the scan engine in scan.c (libscans2).
+*
+*  Turns the options into a struct scans2_config, runs the scan and writes
+*  the result in the selected output format.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <glob.h>
+#include <locale.h>
+
+#include "list.h"
+#include "dump-zap.h"
+#include "dump-vdr.h"
+#include "dump-m3u.h"
+#include "dump-json.h"
+#include "dump-chandb.h"
+#include "diff.h"
+#include "monitor.h"
+#include "scan.h"
+#include "scans2.h"
+#include "lnb.h"
+#include "bouquet.h"
+#include "collate.h"
+
+static struct scans2_config cfg;
+static struct scans2 *scan;
+
+static int vdr_dump_provider;
+static int vdr_dump_channum;
+static int ca_select = -1;
+static int serv_select = 7;
+static int unique_anon_services;
+static char rotor_pos_name[16] = "";
+static char override_orbital_pos[16] = "";
+static char url[256] = "";
+enum format output_format = OUTPUT_VDR;
+static int output_format_set = 0;
+static int use_bouquets = 0;
+static int collate_flags = 0;
+static struct bouquet_ctx *bouquets = NULL;
+static const char *diff_file;
+static FILE *dump_out;
+static const char *monitor_target;
+static const char *eit_file;
+static FILE *eit_out;
+static const char *initial_out;
+
+static void dump_dvb_parameters (FILE *f, struct transponder *t);
+
+static int sat_number (struct transponder *t)
+{
+	(void) t;
+
+	return cfg.switch_pos + cfg.uncommitted_switch_pos*4;
+}
+
+static void dump_service(struct transponder *t, struct service *s)
+{
+	switch (output_format)
+	{
+	case OUTPUT_VDR:
+		vdr_dump_service_parameter_set(dump_out, s, t, override_orbital_pos, vdr_dump_channum || cfg.lcn, vdr_dump_provider, ca_select);
+		break;
+
+	case OUTPUT_VDR_16x:
+		if(t->delivery_system != SYS_DVBS2) {
+			vdr_dump_service_parameter_set(dump_out, s, t, override_orbital_pos, vdr_dump_channum || cfg.lcn, vdr_dump_provider, ca_select);
+		}
+		break;
+
+	case OUTPUT_ZAP:
+		zap_dump_service_parameter_set (dump_out, s, t, sat_number(t));
+		break;
+
+	case OUTPUT_M3U:
+		m3u_dump_service_parameter_set (dump_out, s, t, url);
+		break;
+
+	case OUTPUT_JSON:
+	case OUTPUT_NDJSON:
+		if (use_bouquets) {
+			const char *names[BOUQUET_NAMES_MAX];
+			int n = bouquet_service_membership(bouquets, t, s, names, BOUQUET_NAMES_MAX);
+			json_dump_service_parameter_set (dump_out, s, t, names, n, output_format == OUTPUT_NDJSON);
+		} else
+			json_dump_service_parameter_set (dump_out, s, t, NULL, -1, output_format == OUTPUT_NDJSON);
+		break;
+
+	case OUTPUT_CHANDB:
+		chandb_dump_service_parameter_set (s, t);
+		break;
+
+	default:
+		break;
+	}
+}
+
+/* a service of the flat outputs in LCN order */
+struct dump_entry {
+	struct transponder *t;
+	struct service *s;
+};
+
+static void dump_lists (void)
+{
+	struct list_head *p1, *p2;
+	struct transponder *t;
+	struct service *s;
+	int n = 0, i;
+	char sn[20];
+	int anon_services = 0;
+	int is_json = output_format == OUTPUT_JSON || output_format == OUTPUT_NDJSON;
+	int is_binary = output_format == OUTPUT_CHANDB;
+	/* diff mode renders the scan and compares it instead of printing it */
+	char *diff_buf = NULL;
+	size_t diff_len = 0;
+	int flat = !use_bouquets || is_json || diff_file;
+	/* with -L the flat outputs are collected and sorted once */
+	struct dump_entry *sorted = NULL;
+	struct collate *coll = NULL;
+	int n_sorted = 0, *order;
+
+	list_for_each(p1, scans2_transponders(scan)) {
+		t = list_entry(p1, struct transponder, list);
+		list_for_each(p2, &t->services) {
+			n++;
+		}
+	}
+	info("dumping lists (%d services)\n", n);
+
+	dump_out = diff_file ? open_memstream(&diff_buf, &diff_len) : stdout;
+
+	/* JSON lists every service once and carries its bouquets along */
+	if (use_bouquets && flat)
+		bouquet_prepare(bouquets, scans2_transponders(scan), ca_select, serv_select);
+
+	list_for_each(p1, scans2_transponders(scan)) {
+		t = list_entry(p1, struct transponder, list);
+		list_for_each(p2, &t->services) {
+			s = list_entry(p2, struct service, list);
+
+			if (!s->service_name) {
+				/* not in SDT */
+				if (unique_anon_services)
+					snprintf(sn, sizeof(sn), "[%03x-%04x]",
+					anon_services, s->service_id);
+				else
+					snprintf(sn, sizeof(sn), "[%04x]",
+					s->service_id);
+				s->service_name = strdup(sn);
+				anon_services++;
+			}
+			/* ':' is field separator in szap and vdr service lists */
+			if (!is_json && !is_binary) {
+				for (i = 0; s->service_name[i]; i++) {
+					if (s->service_name[i] == ':')
+						s->service_name[i] = ' ';
+				}
+				for (i = 0; s->provider_name && s->provider_name[i]; i++) {
+					if (s->provider_name[i] == ':')
+						s->provider_name[i] = ' ';
+				}
+			}
+			if (s->video_pid && !(serv_select & 1)) {
+				warning("no TV services\n");
+				continue; /* no TV services */
+			}
+			if (!s->video_pid && s->audio_num && !(serv_select & 2)) {
+				warning("no radio services\n");
+				continue; /* no radio services */
+			}
+			if (!s->video_pid && !s->audio_num && !(serv_select & 4)) {
+				warning("no data/other services\n");
+				continue; /* no data/other services */
+			}
+
+			if (s->scrambled && ca_select==0)
+				continue; /* FTA only */
+
+			if(s->audio_pid == 0 && s->ac3_pid != 0)
+				s->audio_pid = s->ac3_pid;
+
+			if (flat && cfg.lcn) {
+				if (!sorted) {
+					sorted = malloc(n * sizeof(struct dump_entry));
+					coll = collate_create(collate_flags, n);
+				}
+				sorted[n_sorted].t = t;
+				sorted[n_sorted].s = s;
+				collate_add(coll, s->service_name, lcn_rank(s));
+				n_sorted++;
+			} else if (flat)
+				dump_service(t, s);
+		}
+	}
+
+	if (sorted) {
+		order = malloc((n_sorted + 1) * sizeof(int));
+		collate_sort(coll, order);
+		for (i = 0; i < n_sorted; i++)
+			dump_service(sorted[order[i]].t, sorted[order[i]].s);
+		collate_free(coll);
+		free(order);
+		free(sorted);
+	}
+
+	if (!flat)
+		bouquet_dump(bouquets, scans2_transponders(scan), ca_select, serv_select,
+			((cfg.lcn)? BOUQUET_SORT_LCN : 0) |
+			((collate_flags & COLLATE_LOCALE)? BOUQUET_SORT_LOCALE : 0),
+			dump_service);
+	else if (use_bouquets)
+		bouquet_report_rules(bouquets);
+
+	if (is_json)
+		json_dump_footer(dump_out, output_format == OUTPUT_NDJSON);
+	if (is_binary)
+		chandb_dump_footer(dump_out);
+
+	if (diff_file) {
+		struct diff_list prev, cur;
+
+		fclose(dump_out);
+		memset(&prev, 0, sizeof(prev));
+		memset(&cur, 0, sizeof(cur));
+		if (diff_load(&prev, output_format, diff_file) == 0 &&
+			diff_parse(&cur, output_format, diff_buf, diff_len) == 0)
+			diff_dump(stdout, &prev, &cur);
+		diff_free(&prev);
+		diff_free(&cur);
+		free(diff_buf);
+	}
+
+	info("Done.\n");
+}
+
+static void show_existing_tuning_data_files(void)
+{
+#ifndef DATADIR
+#define DATADIR "/usr/local/share"
+#endif
+	static const char* prefixlist[] = { DATADIR "/dvb", "/etc/dvb",
+		DATADIR "/doc/packages/dvb", 0 };
+	unsigned int i;
+	const char **prefix;
+	fprintf(stderr, "initial tuning data files:\n");
+	for (prefix = prefixlist; *prefix; prefix++) {
+		glob_t globbuf;
+		char* globspec = malloc (strlen(*prefix)+9);
+		strcpy (globspec, *prefix); strcat (globspec, "/dvb-?/*");
+		if (! glob (globspec, 0, 0, &globbuf)) {
+			for (i=0; i < globbuf.gl_pathc; i++)
+				fprintf(stderr, " file: %s\n", globbuf.gl_pathv[i]);
+		}
+		free (globspec);
+		globfree (&globbuf);
+	}
+}
+
+static void handle_sigint(int sig)
+{
+	(void)sig;
+	if (monitor_target) {
+		monitor_close();
+		exit(0);
+	}
+	/* a partial scan would show up as removed services */
+	if (diff_file) {
+		error("interrupted by SIGINT, no diff for a partial result\n");
+		exit(2);
+	}
+	error("interrupted by SIGINT, dumping partial result...\n");
+	dump_lists();
+	exit(2);
+}
+
+static const char *table_name(int table_id)
+{
+	switch (table_id) {
+		case TID_PAT: return "PAT";
+		case TID_PMT: return "PMT";
+		case TID_NIT_ACTUAL: return "NIT";
+		case TID_SDT_ACTUAL: return "SDT";
+		default: return "???";
+	}
+}
+
+static void monitor_table_updated(void *priv, struct transponder *t,
+		struct scans2_table *table, enum scans2_table_phase phase)
+{
+	(void)priv;
+
+	switch (phase) {
+	case SCANS2_TABLE_CHANGING:
+		table->user = monitor_snapshot(t,
+			table->table_id == TID_PMT ? table->table_id_ext : -1);
+		break;
+
+	case SCANS2_TABLE_UPDATED:
+		if (table->old_version != table->version)
+			monitor_table_event(table_name(table->table_id), table->pid,
+				table->table_id_ext, table->old_version, table->version);
+		monitor_diff(table->user, t);
+		table->user = NULL;
+		break;
+
+	case SCANS2_TABLE_DROPPED:
+		monitor_snap_free(table->user);
+		table->user = NULL;
+		break;
+	}
+}
+
+static struct transponder *monitor_tp(void)
+{
+	struct list_head *l = scans2_transponders(scan);
+
+	return list_empty(l) ? NULL : list_entry(l->next, struct transponder, list);
+}
+
+static void monitor_progress(void *priv, int done, int total)
+{
+	(void)priv;
+
+	/* the initial scan of the tuned transponder is complete */
+	if (done == total)
+		monitor_dump_all(monitor_tp());
+}
+
+static int monitor_idle(void *priv)
+{
+	(void)priv;
+
+	monitor_poll(monitor_tp());
+	return 0;
+}
+
+static void eit_event(void *priv, const struct eit_event *ev)
+{
+	(void)priv;
+
+	json_dump_event(eit_out, ev);
+}
+
+static const char *usage = "\n"
+"usage: %s [options...] [-c | initial-tuning-data-file]\n"
+"	atsc/dvbscan doesn't do frequency scans, hence it needs initial\n"
+"	tuning data for at least one transponder/channel, or a sweep (-W).\n"
+"	-c	scan on currently tuned transponder only\n"
+"	-v 	verbose (repeat for more)\n"
+"	-q 	quiet (repeat for less)\n"
+"	-a N	use DVB /dev/dvb/adapterN/\n"
+"	-f N	use DVB /dev/dvb/adapter?/frontendN\n"
+"	-d N	use DVB /dev/dvb/adapter?/demuxN\n"
+"	-s N	use DiSEqC switch position N (DVB-S only)\n"
+"	-S N    use DiSEqC uncommitted switch position N (DVB-S only)\n"
+"	-r sat  move DiSEqC rotor to satellite location, e.g. '13.0E' or '1.0W'\n"
+"	-R N    move DiSEqC rotor to position number N\n"
+"	-i N	spectral inversion setting (0: off, 1: on, 2: auto [default])\n"
+"	-n	evaluate NIT messages for full network scan (slow!)\n"
+"	-5	multiply all filter timeouts by factor 5\n"
+"		for non-DVB-compliant section repitition rates\n"
+"	-O pos	Orbital position override 'S4W', 'S19.2E' - good for VDR output\n"
+"	-k cnt	Skip count: skip the first cnt \n"
+"		messages of each message type (default 0)\n"
+"	-I cnt	Scan iterations count (default 10).\n"
+"		Larger number will make scan longer on every channel\n"
+"	-M	Scan every PLP (DVB-T2/C2) and input stream (DVB-S2 multistream)\n"
+"		the NIT lists, each one as a transponder of its own; those on\n"
+"		other frequencies need -n\n"
+"	-H url	Generation M3U playlist for SATIP, use as 'http://host:port' or 'rtsp://host:port'\n"
+"	-o fmt	output format: 'm3u', 'vdr' (default), 'vdr16x' for VDR version 1.6.x, 'zap',\n"
+"		'json' (one array), 'ndjson' (one service per line) or\n"
+"		'chandb' (binary database for mmap(), see chandb.h)\n"
+"	-x N	Conditional Access, (default -1)\n"
+"		N=-2  gets all channels (FTA and encrypted),\n"
+"		      output received CAID :CAID:\n"
+"		N=-1  gets all channels (FTA and encrypted),\n"
+"		      output CA is set to :0:\n"
+"		N=0   gets only FTA channels\n"
+"		N=xxx  sets ca field in vdr output to :xxx:\n"
+"	-t N  Service select, Combined bitfield parameter.\n"
+"		1 = TV, 2 = Radio, 4 = Other, (default 7)\n"
+"	-p	for vdr output format: dump provider name\n"
+"	-e N  VDR version, default 2 for VDR-1.2.x\n"
+"		ANYTHING ELSE GIVES NONZERO NIT and TID\n"
+"		Vdr version 1.3.x and up implies -p.\n"
+"	-l lnb-type (DVB-S Only) (use -l help to print types) or \n"
+"	-l low[,high[,switch]] in Mhz\n"
+"	-u UK DVB-T Freeview channel numbering for VDR\n"
+"	-L sel	Logical channel numbers from NIT (EACEM/NorDig) and BAT (Sky,\n"
+"		Freesat), output sorted by them. sel is 'any' or\n"
+"		BOUQUET[:REGION], e.g. 4101:1 for a Sky bouquet and region or\n"
+"		:5 for NorDig channel list 5.\n"
+"	-C	Sort names in the collation order of the locale (LC_COLLATE)\n"
+"		instead of by their case-folded bytes.\n\n"
+"	-P do not use ATSC PSIP tables for scanning\n"
+"	    (but only PAT and PMT) (applies for ATSC only)\n"
+"	-A N	check for ATSC 1=Terrestrial [default], 2=Cable or 3=both\n"
+"	    VCT, until the MGT of the mux tells which ones it has\n"
+"	-V	ATSC: read the PMT of every program to verify the VCT, by default\n"
+"	    only programs without a service location descriptor need it\n"
+"	-U	Uniquely name unknown services\n"
+"	-D s	Disable specified scan mode (by default all modes are enabled)\n"
+"		s=S1  Disable DVB-S scan\n"
+"		s=S2  Disable DVB-S2 scan (good for owners of cards that do not\n"
+"		      support DVB-S2 systems)\n"
+"		Transponders of a system the frontend doesn't report, or out of\n"
+"		its frequency or symbol rate range, are left out anyway.\n"
+"	-X	Disable AUTOs for initial transponders (esp. for hardware which\n"
+"		not support it). Instead try each value of any free parameters.\n"
+"	-B opts	Parse BAT and create channel groups for VDR output\n"
+"		(JSON output lists the groups of every service).\n"
+"		Use -B help for options.\n"
+"	-b	The same as -B, default options.\n"
+"	-F file	Compare the scan with a previous result in the selected output\n"
+"		format (vdr, zap, json or ndjson) and print only added, removed\n"
+"		and changed services, one JSON object per line.\n"
+"	-m dst	Monitor mode (with -c): keep watching PAT, PMT, SDT and NIT of the\n"
+"		tuned transponder and report changes as JSON lines on stdout\n"
+"		(dst '-') or to the clients of the Unix socket dst.\n"
+"	-E file	Collect the EIT (present/following and schedule) of every\n"
+"		transponder while it is tuned, one JSON event per line to file\n"
+"		('-' for stdout). Adds up to a minute per transponder.\n"
+"	-G	With -E, also the EIT of other transport streams.\n"
+"	-Q N	Sample the signal statistics every N seconds while the tables\n"
+"		are read instead of once after the lock; the json outputs show\n"
+"		the mean and the minimum CNR.\n"
+"	-W spec	Scan a raster of channels, with or without an initial file:\n"
+"		SYS:START-END:STEP[:MODULATION[:SYMBOL_RATE]], SYS is T, T2, C or\n"
+"		A, frequencies in Hz, e.g. T:474000000-858000000:8000000 or\n"
+"		C:114000000-858000000:8000000:QAM256:6900000. Implies -w.\n"
+"	-w	Carrier pass: first tune every DVB-C/T and ATSC channel only until\n"
+"		a carrier shows up and fully scan just those that have one.\n"
+"	-J N,..	More frontends of the adapter for the carrier pass and for\n"
+"		probing the other frequencies of a DVB-T TS that fails to lock.\n"
+"	-g file	Write the transponders that locked as an initial tuning file.\n"
+"	-Y cc	DVB-C: try the symbol rates and QAMs of the dvb-c/ files of\n"
+"		country cc (e.g. de, fi) first when a channel leaves them out.\n"
+"	-K file	DVB-C: the locks of previous scans, read before and updated\n"
+"		after the scan, weigh in on that order.\n";
+
+
+/* N[,N...] frontend numbers */
+static int parse_frontends(const char *arg, struct scans2_config *c)
+{
+	char *end;
+	long fe;
+
+	c->n_carrier_frontends = 0;
+	do {
+		fe = strtol(arg, &end, 0);
+		if (end == arg || fe < 0 || c->n_carrier_frontends == SCANS2_MAX_FRONTENDS)
+			return -1;
+		c->carrier_frontends[c->n_carrier_frontends++] = fe;
+		arg = end + 1;
+	} while (*end == ',');
+	return (*end == '\0')? 0 : -1;
+}
+
+/* BOUQUET[:REGION], either may be empty */
+static int parse_lcn_select(const char *arg, struct lcn_select *sel)
+{
+	char *end;
+
+	sel->bouquet_id = -1;
+	sel->region = -1;
+	if (*arg && *arg != ':') {
+		sel->bouquet_id = strtol(arg, &end, 0);
+		if (end == arg || sel->bouquet_id < 0 || sel->bouquet_id > 0xffff)
+			return -1;
+		arg = end;
+	}
+	if (*arg == ':') {
+		sel->region = strtol(arg + 1, &end, 0);
+		if (end == arg + 1 || sel->region < 0 || sel->region > 0xffff)
+			return -1;
+		arg = end;
+	}
+	return (*arg == '\0')? 0 : -1;
+}
+
+void bad_usage(char *pname, int problem)
+{
+	int i;
+	struct lnb_types_st *lnbp;
+	char **cp;
+
+	switch (problem) 
+	{
+	default:
+	case 0:
+		fprintf (stderr, usage, pname);
+		break;
+
+	case 1:
+		i = 0;
+		fprintf(stderr, "-l <lnb-type> or -l low[,high[,switch]] in Mhz\n"
+			"where <lnb-type> is:\n");
+		while(NULL != (lnbp = lnb_enum(i))) {
+			fprintf (stderr, "%s\n", lnbp->name);
+			for (cp = lnbp->desc; *cp ; cp++) {
+				fprintf (stderr, "   %s\n", *cp);
+			}
+			i++;
+		}
+		break;
+
+	case 2:
+		show_existing_tuning_data_files();
+		fprintf (stderr, usage, pname);
+		break;
+	}
+}
+
+int main (int argc, char **argv)
+{
+	struct scans2_callbacks cb;
+	int opt;
+	const char *initial = NULL;
+
+	if (argc <= 1) {
+		bad_usage(argv[0], 2);
+		return -1;
+	}
+
+	info("API major %d, minor %d\n", DVB_API_VERSION, DVB_API_VERSION_MINOR);
+
+	/* start with default lnb type */
+	scans2_config_init(&cfg);
+	while ((opt = getopt(argc, argv, "5cnMXpa:f:d:O:k:I:S:s:r:R:H:o:D:x:t:i:l:vquPA:UbB:F:m:L:CE:GVQ:W:wJ:g:Y:K:")) != -1) {
+		switch (opt) 
+		{
+		case 'a':
+			cfg.adapter = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'b':
+		case 'B':
+			if (opt == 'B' && optarg && strcmp(optarg, "help") == 0) {
+				fprintf(stderr, "%s", bouquet_help_msg());
+				return -1;
+			}
+			if (!use_bouquets) {
+				bouquets = bouquet_create((opt == 'B')? optarg : "");
+				if (!bouquets)
+					return -1;
+				use_bouquets = 1;
+			}
+			break;
+
+		case 'c':
+			cfg.current_tp_only = 1;
+			if (!output_format_set)
+				output_format = OUTPUT_VDR;
+			break;
+
+		case 'n':
+			cfg.get_other_nits = 1;
+			break;
+
+		case 'X':
+			cfg.noauto = 1;
+			break;
+
+		case 'M':
+			cfg.scan_mplp = 1;
+			break;
+
+		case 'd':
+			cfg.demux = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'f':
+			cfg.frontend = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'k':
+			cfg.skip_count = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'I':
+			cfg.scan_iterations = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'p':
+			vdr_dump_provider = 1;
+			break;
+
+		case 's':
+			cfg.switch_pos = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'S':
+			cfg.uncommitted_switch_pos = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'r':
+			strncpy(rotor_pos_name,optarg,sizeof(rotor_pos_name)-1);
+			break;
+
+		case 'R':
+			cfg.rotor_pos = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'O':
+			strncpy(override_orbital_pos, optarg, sizeof(override_orbital_pos)-1);
+			break;
+
+		case 'o':
+			if      (strcmp(optarg, "zap") == 0) output_format = OUTPUT_ZAP;
+			else if (strcmp(optarg, "vdr") == 0) output_format = OUTPUT_VDR;
+			else if (strcmp(optarg, "vdr16x") == 0) output_format = OUTPUT_VDR_16x;
+			else if (strcmp(optarg, "m3u") == 0) output_format = OUTPUT_M3U;
+			else if (strcmp(optarg, "json") == 0) output_format = OUTPUT_JSON;
+			else if (strcmp(optarg, "ndjson") == 0) output_format = OUTPUT_NDJSON;
+			else if (strcmp(optarg, "chandb") == 0) output_format = OUTPUT_CHANDB;
+			else {
+				bad_usage(argv[0], 0);
+				return -1;
+			}
+			output_format_set = 1;
+			break;
+
+		case 'H':
+			if(!strncmp(optarg, "http://", 7) || !strncmp(optarg, "rtsp://", 7))
+				strncpy(url, optarg, sizeof(url)-1);
+			else {
+				bad_usage(argv[0], 0);
+				return -1;
+			}
+			break;
+
+		case 'D':
+			if      (strcmp(optarg, "S1") == 0) cfg.disable_s1 = TRUE;
+			else if (strcmp(optarg, "S2") == 0) cfg.disable_s2 = TRUE;
+			else {
+				bad_usage(argv[0], 0);
+				return -1;
+			}
+			output_format_set = 1;
+			break;
+
+		case '5':
+			cfg.long_timeout = 1;
+			break;
+
+		case 'x':
+			ca_select = strtoul(optarg, NULL, 0);
+			break;
+
+		case 't':
+			serv_select = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'i':
+			cfg.spectral_inversion = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'l':
+			if (lnb_decode(optarg, &cfg.lnb_type) < 0) {
+				bad_usage(argv[0], 1);
+				return -1;
+			}
+			break;
+
+		case 'v':
+			verbosity++;
+			break;
+
+		case 'q':
+			if (--verbosity < 0)
+				verbosity = 0;
+			break;
+
+		case 'u':
+			vdr_dump_channum = 1;
+			break;
+
+		case 'L':
+			cfg.lcn = 1;
+			if (strcmp(optarg, "any") != 0 && parse_lcn_select(optarg, &cfg.lcn_select) < 0) {
+				bad_usage(argv[0], 0);
+				return -1;
+			}
+			break;
+
+		case 'C':
+			setlocale(LC_COLLATE, "");
+			collate_flags |= COLLATE_LOCALE;
+			break;
+
+		case 'P':
+			cfg.no_atsc_psip = 1;
+			break;
+
+		case 'A':
+			cfg.atsc_type = strtoul(optarg,NULL,0);
+			if (cfg.atsc_type == 0 || cfg.atsc_type > 3) {
+				bad_usage(argv[0], 1);
+				return -1;
+			}
+			break;
+
+		case 'V':
+			cfg.atsc_verify_pmt = 1;
+			break;
+
+		case 'U':
+			unique_anon_services = 1;
+			break;
+
+		case 'F':
+			diff_file = optarg;
+			break;
+
+		case 'm':
+			monitor_target = optarg;
+			break;
+
+		case 'E':
+			eit_file = optarg;
+			cfg.eit |= EIT_ACTUAL;
+			break;
+
+		case 'G':
+			cfg.eit |= EIT_OTHER;
+			break;
+
+		case 'Q':
+			cfg.stats_interval = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'W':
+			if (scans2_parse_sweep(&cfg.sweep, optarg) < 0) {
+				fprintf(stderr, "Invalid sweep '%s'.\n", optarg);
+				return -1;
+			}
+			break;
+
+		case 'w':
+			cfg.carrier_pass = 1;
+			break;
+
+		case 'J':
+			if (parse_frontends(optarg, &cfg) < 0) {
+				fprintf(stderr, "Invalid frontend list '%s'.\n", optarg);
+				return -1;
+			}
+			break;
+
+		case 'g':
+			initial_out = optarg;
+			break;
+
+		case 'Y':
+			cfg.cable_region = optarg;
+			break;
+
+		case 'K':
+			cfg.cable_priors = optarg;
+			break;
+
+		default:
+			bad_usage(argv[0], 0);
+			return -1;
+		};
+	}
+
+	if (use_bouquets && !(output_format == OUTPUT_VDR || output_format == OUTPUT_VDR_16x ||
+			output_format == OUTPUT_JSON || output_format == OUTPUT_NDJSON)) {
+		fprintf(stderr, "Bouquets require a VDR or JSON output format.\n");
+		return -1;
+	}
+
+	if (diff_file && (output_format == OUTPUT_M3U || output_format == OUTPUT_CHANDB)) {
+		fprintf(stderr, "Diff mode requires a VDR, zap or JSON output format.\n");
+		return -1;
+	}
+
+	if (monitor_target && (!cfg.current_tp_only || diff_file)) {
+		fprintf(stderr, "Monitor mode requires -c and can't be combined with -F.\n");
+		return -1;
+	}
+
+	if (cfg.eit && (!eit_file || monitor_target)) {
+		fprintf(stderr, "EIT capture requires -E and can't be combined with -m.\n");
+		return -1;
+	}
+
+	if (cfg.current_tp_only && (cfg.sweep.delivery_system != SYS_UNDEFINED || cfg.carrier_pass)) {
+		fprintf(stderr, "A sweep or carrier pass can't be combined with -c.\n");
+		return -1;
+	}
+
+	if (optind < argc)
+		initial = argv[optind];
+	if ((!initial && !cfg.current_tp_only && cfg.sweep.delivery_system == SYS_UNDEFINED) ||
+		(initial && cfg.current_tp_only) ||
+		(cfg.spectral_inversion > 2)) {
+			bad_usage(argv[0], 0);
+			return -1;
+	}
+
+	cfg.lnb_type.low_val *= 1000;	/* convert to kiloherz */
+	cfg.lnb_type.high_val *= 1000;	/* convert to kiloherz */
+	cfg.lnb_type.switch_val *= 1000;	/* convert to kiloherz */
+	if (cfg.switch_pos >= 4) {
+		fprintf (stderr, "switch position needs to be < 4!\n");
+		return -1;
+	}
+	if (cfg.uncommitted_switch_pos >= 16) {
+		fprintf (stderr, "uncommitted_switch position needs to be < 16!\n");
+		return -1;
+	}
+
+	cfg.rotor_pos_name = rotor_pos_name;
+	cfg.channel_numbers = vdr_dump_channum;
+	cfg.bouquets = bouquets;
+	cfg.monitor = monitor_target != NULL;
+
+	memset(&cb, 0, sizeof(cb));
+	cb.dump_dvb_parameters = dump_dvb_parameters;
+	if (monitor_target) {
+		cb.table_updated = monitor_table_updated;
+		cb.progress = monitor_progress;
+		cb.idle = monitor_idle;
+		if (monitor_open(monitor_target) < 0)
+			return 1;
+	}
+	if (eit_file) {
+		eit_out = (strcmp(eit_file, "-") == 0)? stdout : fopen(eit_file, "w");
+		if (!eit_out) {
+			error("failed to open '%s': %m\n", eit_file);
+			return 1;
+		}
+		cb.eit_event = eit_event;
+	}
+
+	if (initial)
+		info("scanning %s\n", initial);
+
+	scan = scans2_create(&cfg, &cb, NULL);
+	if (!scan)
+		fatal("out of memory\n");
+
+	signal(SIGINT, handle_sigint);
+
+	if (scans2_run(scan, initial) < 0)
+		return 1;
+
+	dump_lists ();
+	if (eit_out && eit_out != stdout)
+		fclose(eit_out);
+
+	if (initial_out) {
+		FILE *f = fopen(initial_out, "w");
+		if (!f)
+			error("failed to open '%s': %m\n", initial_out);
+		else {
+			scans2_write_initial(scan, f);
+			fclose(f);
+		}
+	}
+
+	if (bouquets)
+		bouquet_free(bouquets);
+	scans2_free(scan);
+
+	return 0;
+}
+
+static void dump_dvb_parameters (FILE *f, struct transponder *t)
+{
+	switch (output_format)
+	{
+	case OUTPUT_VDR:
+	case OUTPUT_VDR_16x:
+	case OUTPUT_M3U:
+	case OUTPUT_JSON:
+	case OUTPUT_NDJSON:
+	case OUTPUT_CHANDB:
+		vdr_dump_dvb_parameters(f, t, override_orbital_pos);
+		break;
+
+	case OUTPUT_ZAP:
+		zap_dump_dvb_parameters(f, t, sat_number(t));
+		break;
+
+	default:
+		break;
+	}
+}
@@ -0,0 +1,369 @@
+/*
+ * Compiled shell patterns, see match.h.
+ *
+ * A pattern is split into its literal prefix, which goes into the trie,
+ * and a program for the rest:
+ *   OP_LIT n bytes	n literal bytes
+ *   OP_ANY		'?'
+ *   OP_CLASS bitmap	'[...]', 32 byte bitmap
+ *   OP_STAR		'*', consecutive stars collapsed
+ *   OP_END
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "match.h"
+
+enum {
+	OP_END,
+	OP_LIT,
+	OP_ANY,
+	OP_CLASS,
+	OP_STAR
+};
+
+struct glob {
+	int id;
+	unsigned char *prog;
+	struct glob *next;
+};
+
+struct trie_node {
+	unsigned char c;
+	struct trie_node *child;
+	struct trie_node *sibling;
+	struct glob *globs;		// patterns whose literal prefix ends here
+};
+
+struct matcher {
+	struct trie_node root;
+};
+
+struct prog_buf {
+	unsigned char *buf;
+	int len;
+	int size;
+};
+
+static void emit(struct prog_buf *p, const void *data, int len)
+{
+	if (p->len + len > p->size) {
+		p->size = (p->size + len) * 2;
+		p->buf = realloc(p->buf, p->size);
+	}
+	memcpy(p->buf + p->len, data, len);
+	p->len += len;
+}
+
+static void emit_op(struct prog_buf *p, unsigned char op)
+{
+	emit(p, &op, 1);
+}
+
+// appends a literal byte, extending the previous OP_LIT if possible
+static void emit_lit(struct prog_buf *p, int *lit_at, unsigned char c)
+{
+	unsigned char hdr[2] = { OP_LIT, 0 };
+
+	if (*lit_at < 0 || p->buf[*lit_at + 1] == 255) {
+		*lit_at = p->len;
+		emit(p, hdr, 2);
+	}
+	p->buf[*lit_at + 1]++;
+	emit(p, &c, 1);
+}
+
+static void set_bit(unsigned char *map, int c)
+{
+	map[c >> 3] |= 1 << (c & 7);
+}
+
+static int class_bit(const char *name, int len, int c)
+{
+	static const struct {
+		const char *name;
+		int (*fn)(int);
+	} classes[] = {
+		{ "alnum", isalnum }, { "alpha", isalpha }, { "blank", isblank },
+		{ "cntrl", iscntrl }, { "digit", isdigit }, { "graph", isgraph },
+		{ "lower", islower }, { "print", isprint }, { "punct", ispunct },
+		{ "space", isspace }, { "upper", isupper }, { "xdigit", isxdigit },
+	};
+	unsigned int i;
+
+	for (i = 0; i < sizeof(classes) / sizeof(classes[0]); i++) {
+		if ((int)strlen(classes[i].name) == len && memcmp(classes[i].name, name, len) == 0)
+			return classes[i].fn(c) != 0;
+	}
+	return -1;
+}
+
+#define CLASS_INVALID	((const char *)-1)
+
+// parses the bracket expression at p (just after '['), returns the
+// position after the closing ']', NULL if there is none ('[' is literal
+// then) or CLASS_INVALID where fnmatch() fails the whole pattern
+static const char *compile_class(const char *p, unsigned char *map)
+{
+	int negate = 0, first = 1, lo, hi, c, complex = 0;
+	const char *e;
+
+	memset(map, 0, 32);
+	if (*p == '!' || *p == '^') {
+		negate = 1;
+		p++;
+	}
+	for (;;) {
+		if (*p == '\0')
+			return complex ? CLASS_INVALID : NULL;
+		if (*p == ']' && !first)
+			break;
+		first = 0;
+		for (e = p + 2; p[0] == '[' && p[1] == ':' && isalpha((unsigned char)*e); e++)
+			;
+		if (p[0] == '[' && p[1] == ':' && e[0] == ':' && e[1] == ']') {
+			for (c = 1; c < 256; c++) {
+				int r = class_bit(p + 2, e - p - 2, c);
+				if (r < 0)
+					return CLASS_INVALID;
+				if (r)
+					set_bit(map, c);
+			}
+			p = e + 2;
+			complex = 1;
+			continue;
+		}
+		if (*p == '\\') {
+			if (!*++p)
+				return CLASS_INVALID;
+		}
+		lo = (unsigned char)*p++;
+		hi = lo;
+		if (p[0] == '-' && p[1] != ']') {
+			if (*++p == '\0')
+				return CLASS_INVALID;
+			if (*p == '\\' && !*++p)
+				return CLASS_INVALID;
+			hi = (unsigned char)*p++;
+		}
+		for (c = lo; c <= hi; c++)
+			set_bit(map, c);
+	}
+	if (negate) {
+		for (c = 0; c < 32; c++)
+			map[c] = ~map[c];
+	}
+	map[0] &= ~1;		// never the terminating NUL
+	return p + 1;
+}
+
+// returns NULL for patterns fnmatch() rejects, they match nothing
+static unsigned char *compile(const char *pattern, int *prog_len)
+{
+	struct prog_buf p = { NULL, 0, 0 };
+	unsigned char map[32];
+	const char *next;
+	int lit_at = -1;
+
+	while (*pattern) {
+		switch (*pattern) {
+		case '*':
+			while (*pattern == '*')
+				pattern++;
+			emit_op(&p, OP_STAR);
+			lit_at = -1;
+			continue;
+		case '?':
+			emit_op(&p, OP_ANY);
+			lit_at = -1;
+			break;
+		case '[':
+			if ((next = compile_class(pattern + 1, map)) == CLASS_INVALID) {
+				free(p.buf);
+				return NULL;
+			}
+			if (next != NULL) {
+				emit_op(&p, OP_CLASS);
+				emit(&p, map, sizeof(map));
+				lit_at = -1;
+				pattern = next;
+				continue;
+			}
+			emit_lit(&p, &lit_at, '[');
+			break;
+		case '\\':
+			if (!*++pattern) {
+				free(p.buf);
+				return NULL;
+			}
+			/* fall through */
+		default:
+			emit_lit(&p, &lit_at, *pattern);
+			break;
+		}
+		pattern++;
+	}
+	emit_op(&p, OP_END);
+	if (prog_len)
+		*prog_len = p.len;
+	return p.buf;
+}
+
+// one backtracking point is enough: a later '*' can absorb whatever an
+// earlier one would have had to
+static int run(const unsigned char *prog, const char *str)
+{
+	const unsigned char *p = prog, *star_p = NULL;
+	const unsigned char *s = (const unsigned char *)str, *star_s = NULL;
+
+	for (;;) {
+		switch (*p) {
+		case OP_END:
+			if (*s == '\0')
+				return 1;
+			break;
+		case OP_LIT:
+			if (strncmp((const char *)s, (const char *)p + 2, p[1]) == 0) {
+				s += p[1];
+				p += 2 + p[1];
+				continue;
+			}
+			break;
+		case OP_ANY:
+			if (*s) {
+				s++;
+				p++;
+				continue;
+			}
+			break;
+		case OP_CLASS:
+			if (p[1 + (*s >> 3)] & (1 << (*s & 7))) {
+				s++;
+				p += 33;
+				continue;
+			}
+			break;
+		case OP_STAR:
+			star_p = ++p;
+			star_s = s;
+			continue;
+		}
+		// mismatch: let the last star take one more byte
+		if (!star_p || *star_s == '\0')
+			return 0;
+		s = ++star_s;
+		p = star_p;
+	}
+}
+
+struct matcher *matcher_create(void)
+{
+	return calloc(1, sizeof(struct matcher));
+}
+
+static void free_node(struct trie_node *n, int self)
+{
+	struct trie_node *c, *next;
+	struct glob *g, *gn;
+
+	for (c = n->child; c; c = next) {
+		next = c->sibling;
+		free_node(c, 1);
+	}
+	for (g = n->globs; g; g = gn) {
+		gn = g->next;
+		free(g->prog);
+		free(g);
+	}
+	if (self)
+		free(n);
+}
+
+void matcher_free(struct matcher *m)
+{
+	if (!m)
+		return;
+	free_node(&m->root, 0);
+	free(m);
+}
+
+static struct trie_node *child(struct trie_node *n, unsigned char c, int create)
+{
+	struct trie_node *ch;
+
+	for (ch = n->child; ch; ch = ch->sibling) {
+		if (ch->c == c)
+			return ch;
+	}
+	if (!create)
+		return NULL;
+	ch = calloc(1, sizeof(struct trie_node));
+	ch->c = c;
+	ch->sibling = n->child;
+	n->child = ch;
+	return ch;
+}
+
+void matcher_add(struct matcher *m, const char *pattern, int id)
+{
+	struct trie_node *n = &m->root;
+	unsigned char *prog;
+	struct glob *g;
+	int i, len, prog_len;
+
+	if ((prog = compile(pattern, &prog_len)) == NULL)
+		return;
+	// the leading literal goes into the trie, the program keeps the rest
+	if (prog[0] == OP_LIT) {
+		len = prog[1];
+		for (i = 0; i < len; i++)
+			n = child(n, prog[2 + i], 1);
+		memmove(prog, prog + 2 + len, prog_len - 2 - len);
+	}
+
+	g = malloc(sizeof(struct glob));
+	g->id = id;
+	g->prog = prog;
+	g->next = n->globs;
+	n->globs = g;
+}
+
+int matcher_match(struct matcher *m, const char *s, uint32_t *hits, uint32_t stamp)
+{
+	struct trie_node *n = &m->root;
+	struct glob *g;
+	int count = 0;
+
+	for (;;) {
+		for (g = n->globs; g; g = g->next) {
+			if (run(g->prog, s)) {
+				hits[g->id] = stamp;
+				count++;
+			}
+		}
+		if (*s == '\0' || (n = child(n, *s, 0)) == NULL)
+			break;
+		s++;
+	}
+	return count;
+}
+
+int glob_match(const char *pattern, const char *s)
+{
+	unsigned char *prog = compile(pattern, NULL);
+	int r = prog && run(prog, s);
+
+	free(prog);
+	return r;
+}
+
+int glob_valid(const char *pattern)
+{
+	unsigned char *prog = compile(pattern, NULL);
+	int r = prog != NULL;
+
+	free(prog);
+	return r;
+}
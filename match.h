@@ -0,0 +1,32 @@
+#ifndef __MATCH_H__
+#define __MATCH_H__
+
+#include <stdint.h>
+
+/*
+ * A set of shell patterns (fnmatch(3) without flags, byte-wise as in the
+ * C locale) compiled for matching many strings against all of them at
+ * once. The literal prefixes of the patterns form a trie, so a string
+ * only meets the patterns whose prefix it starts with; the rest of each
+ * pattern is a small compiled program.
+ */
+
+struct matcher;
+
+extern struct matcher *matcher_create(void);
+extern void matcher_free(struct matcher *m);
+
+// id is the caller's, e.g. a rule index; several patterns may share one
+extern void matcher_add(struct matcher *m, const char *pattern, int id);
+
+// marks the ids of all matching patterns with hits[id] = stamp,
+// returns the number of matching patterns
+extern int matcher_match(struct matcher *m, const char *s, uint32_t *hits, uint32_t stamp);
+
+// single pattern, same result as fnmatch(pattern, s, 0) == 0
+extern int glob_match(const char *pattern, const char *s);
+
+// 0 for patterns fnmatch() rejects (they never match), 1 otherwise
+extern int glob_valid(const char *pattern);
+
+#endif
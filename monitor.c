@@ -0,0 +1,275 @@
+/*
+ * Monitor mode event output.
+ *
+ * Events are NDJSON lines, written to stdout or to every client of a Unix
+ * stream socket. A client that connects later first gets the current
+ * services as "add" events followed by "ready", so it doesn't have to wait
+ * for the next change to learn the lineup. Clients that can't keep up are
+ * dropped rather than allowed to stall the section filters.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "monitor.h"
+#include "dump-json.h"
+#include "scan.h"
+
+#define MONITOR_CLIENTS_MAX	16
+
+struct snap_entry {
+	int service_id;
+	char *json;
+};
+
+struct monitor_snap {
+	int service_id;				/* -1: all services */
+	int n;
+	struct snap_entry *e;
+};
+
+static int listen_fd = -1;
+static int clients[MONITOR_CLIENTS_MAX];
+static int n_clients;
+static int ready;
+static char *sock_path;
+
+int monitor_open(const char *target)
+{
+	struct sockaddr_un addr;
+
+	if (strcmp(target, "-") == 0)
+		return 0;
+
+	if (strlen(target) >= sizeof(addr.sun_path)) {
+		error("monitor socket path too long: %s\n", target);
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, target);
+
+	if ((listen_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		errorn("socket");
+		return -1;
+	}
+	unlink(target);		/* stale socket of a previous run */
+	if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+		listen(listen_fd, 4) < 0) {
+		errorn("bind/listen");
+		close(listen_fd);
+		listen_fd = -1;
+		return -1;
+	}
+	fcntl(listen_fd, F_SETFL, O_NONBLOCK);
+	sock_path = strdup(target);
+	info("monitor: listening on %s\n", target);
+	return 0;
+}
+
+void monitor_close(void)
+{
+	int i;
+
+	for (i = 0; i < n_clients; i++)
+		close(clients[i]);
+	n_clients = 0;
+	if (listen_fd >= 0) {
+		close(listen_fd);
+		listen_fd = -1;
+		unlink(sock_path);
+		free(sock_path);
+		sock_path = NULL;
+	}
+}
+
+static void drop_client(int i)
+{
+	close(clients[i]);
+	clients[i] = clients[--n_clients];
+}
+
+// fd -1 sends to everybody
+static void emit(int fd, const char *line, size_t len)
+{
+	int i;
+
+	if (listen_fd < 0) {
+		fwrite(line, 1, len, stdout);
+		fflush(stdout);
+		return;
+	}
+	for (i = n_clients - 1; i >= 0; i--) {
+		if (fd >= 0 && clients[i] != fd)
+			continue;
+		if (send(clients[i], line, len, MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t)len) {
+			warning("monitor: dropping client %d\n", clients[i]);
+			drop_client(i);
+		}
+	}
+}
+
+static char *render_service(service_t *s, transponder_t *t)
+{
+	char *buf = NULL;
+	size_t len = 0;
+	FILE *f = open_memstream(&buf, &len);
+
+	json_dump_service_parameter_set(f, s, t, NULL, -1, 1);
+	fclose(f);
+	if (len && buf[len - 1] == '\n')
+		buf[len - 1] = '\0';
+	return buf;
+}
+
+static void emit_service(int fd, const char *op, const char *json)
+{
+	char *line = NULL;
+	size_t len = 0;
+	FILE *f = open_memstream(&line, &len);
+
+	fprintf(f, "{\"event\":\"%s\",\"service\":%s}\n", op, json);
+	fclose(f);
+	emit(fd, line, len);
+	free(line);
+}
+
+static void emit_removed(int service_id, transponder_t *t)
+{
+	char line[128];
+	int len;
+
+	len = snprintf(line, sizeof(line),
+		"{\"event\":\"remove\",\"onid\":%d,\"tsid\":%d,\"sid\":%d}\n",
+		t->original_network_id, t->transport_stream_id, service_id);
+	emit(-1, line, len);
+}
+
+static void dump_all(int fd, transponder_t *t)
+{
+	struct list_head *pos;
+	service_t *s;
+	char *json, line[64];
+	int n = 0, len;
+
+	list_for_each(pos, &t->services) {
+		s = list_entry(pos, service_t, list);
+		json = render_service(s, t);
+		emit_service(fd, "add", json);
+		free(json);
+		n++;
+	}
+	len = snprintf(line, sizeof(line), "{\"event\":\"ready\",\"services\":%d}\n", n);
+	emit(fd, line, len);
+}
+
+void monitor_dump_all(transponder_t *t)
+{
+	dump_all(-1, t);
+	ready = 1;
+}
+
+void monitor_poll(transponder_t *t)
+{
+	int fd;
+
+	if (listen_fd < 0)
+		return;
+	while ((fd = accept(listen_fd, NULL, NULL)) >= 0) {
+		if (n_clients == MONITOR_CLIENTS_MAX) {
+			warning("monitor: too many clients\n");
+			close(fd);
+			continue;
+		}
+		clients[n_clients++] = fd;
+		info("monitor: client %d connected\n", fd);
+		if (ready)
+			dump_all(fd, t);
+	}
+}
+
+void monitor_table_event(const char *table, int pid, int table_id_ext,
+		int old_version, int new_version)
+{
+	char line[160];
+	int len;
+
+	len = snprintf(line, sizeof(line),
+		"{\"event\":\"table\",\"table\":\"%s\",\"pid\":%d,\"table_id_ext\":%d,"
+		"\"old_version\":%d,\"version\":%d}\n",
+		table, pid, table_id_ext, old_version, new_version);
+	emit(-1, line, len);
+}
+
+struct monitor_snap *monitor_snapshot(transponder_t *t, int service_id)
+{
+	struct monitor_snap *snap = calloc(1, sizeof(*snap));
+	struct list_head *pos;
+	service_t *s;
+	int n = 0;
+
+	snap->service_id = service_id;
+	list_for_each(pos, &t->services)
+		n++;
+	snap->e = calloc(n ? n : 1, sizeof(*snap->e));
+
+	list_for_each(pos, &t->services) {
+		s = list_entry(pos, service_t, list);
+		if (service_id >= 0 && s->service_id != service_id)
+			continue;
+		snap->e[snap->n].service_id = s->service_id;
+		snap->e[snap->n].json = render_service(s, t);
+		snap->n++;
+	}
+	return snap;
+}
+
+void monitor_diff(struct monitor_snap *snap, transponder_t *t)
+{
+	struct list_head *pos;
+	service_t *s;
+	char *json;
+	int i;
+
+	list_for_each(pos, &t->services) {
+		s = list_entry(pos, service_t, list);
+		if (snap->service_id >= 0 && s->service_id != snap->service_id)
+			continue;
+		for (i = 0; i < snap->n; i++) {
+			if (snap->e[i].json && snap->e[i].service_id == s->service_id)
+				break;
+		}
+		json = render_service(s, t);
+		if (i == snap->n)
+			emit_service(-1, "add", json);
+		else {
+			if (strcmp(json, snap->e[i].json) != 0)
+				emit_service(-1, "change", json);
+			free(snap->e[i].json);
+			snap->e[i].json = NULL;
+		}
+		free(json);
+	}
+
+	/* whatever wasn't matched is gone */
+	for (i = 0; i < snap->n; i++) {
+		if (snap->e[i].json)
+			emit_removed(snap->e[i].service_id, t);
+	}
+	monitor_snap_free(snap);
+}
+
+void monitor_snap_free(struct monitor_snap *snap)
+{
+	int i;
+
+	for (i = 0; i < snap->n; i++)
+		free(snap->e[i].json);
+	free(snap->e);
+	free(snap);
+}
@@ -0,0 +1,29 @@
+#ifndef __MONITOR_H__
+#define __MONITOR_H__
+
+#include <stdint.h>
+
+#include "scan.h"
+
+struct monitor_snap;
+
+// target is "-" for stdout or the path of a Unix socket to listen on
+extern int monitor_open(const char *target);
+extern void monitor_close(void);
+
+// accepts pending clients and sends each of them the current services
+extern void monitor_poll(transponder_t *t);
+
+// every service as "add" event, ends the initial scan
+extern void monitor_dump_all(transponder_t *t);
+
+extern void monitor_table_event(const char *table, int pid, int table_id_ext,
+		int old_version, int new_version);
+
+// state of one service (service_id >= 0) or all of them before a table is re-parsed
+extern struct monitor_snap *monitor_snapshot(transponder_t *t, int service_id);
+// emits add/remove/change events against the snapshot and frees it
+extern void monitor_diff(struct monitor_snap *snap, transponder_t *t);
+extern void monitor_snap_free(struct monitor_snap *snap);
+
+#endif
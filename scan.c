@@ -35,74 +35,20 @@
 #include <assert.h>
 #include <glob.h>
 #include <ctype.h>
+#include <pthread.h>
 
 #include "list.h"
 #include "diseqc.h"
-#include "dump-zap.h"
-#include "dump-vdr.h"
-#include "dump-m3u.h"
 #include "scan.h"
+#include "scans2.h"
 #include "lnb.h"
 #include "bouquet.h"
+#include "cable.h"
 
 #include "atsc_psip_section.h"
 
 #define CRC_LEN		4
 
-enum pid {
-	PID_PAT			= 0x0000,
-	PID_CAT			= 0x0001,
-	PID_TSDT		= 0x0002,
-	PID_NIT_ST		= 0x0010,
-	PID_SDT_BAT_ST	= 0x0011,
-	PID_EIT_STCIT	= 0x0012,
-	PID_RST_ST		= 0x0013,
-	PID_TDT_TOT_ST	= 0x0014,
-	PID_NET_SYNC	= 0x0015,
-	PID_RNT			= 0x0016,
-	PID_INBAND_SIG	= 0x001C,
-	PID_MEASUREMENT	= 0x001D,
-	PID_DIT			= 0x001E,
-	PID_SIT			= 0x001F,
-};
-
-enum table_id {
-	TID_PAT			= 0x00,		// Program association table
-	TID_CAT			= 0x01,		// Conditional access table
-	TID_PMT			= 0x02,		// Program map table
-	TID_SDT			= 0x03,		// Stream description table
-	// 0x04 .. 0x3F - Reserved
-	TID_NIT_ACTUAL	= 0x40,		// Network information table - actual network
-	TID_NIT_OTHER	= 0x41,		// Network information table - other network
-	TID_SDT_ACTUAL	= 0x42,		// Service description table - actual stream
-	// 0x43 .. 0x45 - Reserved
-	TID_SDT_OTHER	= 0x46,		// Service description table - other stream
-	// 0x47 .. 0x49 - Reserved
-	TID_BAT			= 0x4A,		// Bouquet association table
-	// 0x4B .. 0x4D - Reserved
-	TID_EIT_ACTUAL	= 0x4E,		// Event information table - actual stream - present/following
-	TID_EIT_OTHER	= 0x4F,		// Event information table - other stream - present/following
-	// 0x50 .. 0x5F					// Event information table - actual stream - schedule
-	// 0x60 .. 0x6F					// Event information table - other stream - schedule
-	TID_TDT			= 0x70,		// Time date table
-	TID_RST			= 0x71,		// Running status table
-	TID_ST			= 0x72,		// Stuffing table
-	TID_TOT			= 0x73,		// Time offset table
-	TID_AIT			= 0x74,		// Application information table
-	TID_CT			= 0x75,		// Container table
-	TID_RCT			= 0x76,		// Related content table
-	TID_CIT			= 0x77,		// Content identifier table
-	TID_MPE_FEC		= 0x78,		// MPE-FEC table
-	TID_RNT			= 0x79,		// Resolution notification table
-	// 0x7A .. 0x7D - Reserved
-	TID_DIT			= 0x7E,		// Discountinuity information table
-	TID_SIT			= 0x7F,		// Selection information table
-	// 0x80 .. 0xFE - User defined
-	TID_ATSC_CVT1	= 0xC8,
-	TID_ATSC_CVT2	= 0xC9,
-	// 0xFF - Reserved
-};
-
 enum table_type {
 	PAT,
 	PMT,
@@ -110,50 +56,19 @@ enum table_type {
 	NIT
 };
 
-static char demux_devname[80];
-
 // Configuration parameters
 int verbosity = 2;
 
-static int scan_iterations = 10;
-static int skip_count = 0;
-static int long_timeout;
-static int current_tp_only;
-static int get_other_nits;
-static int noauto=0;
-static int vdr_dump_provider;
-static int vdr_dump_channum;
-static int no_ATSC_PSIP;
-static int ATSC_type=1;
-static int ca_select = -1;
-static int serv_select = 7;
-static struct lnb_types_st lnb_type;
-static int unique_anon_services;
-static fe_spectral_inversion_t spectral_inversion = INVERSION_AUTO;
-static int switch_pos = 0;
-static int uncommitted_switch_pos = 0;
-static int rotor_pos = 0;
-static int curr_rotor_pos = 0;
-static char rotor_pos_name[16] = "";
-static char override_orbital_pos[16] = "";
-static char url[256] = "";
-enum format output_format = OUTPUT_VDR;
-static int output_format_set = 0;
-static int disable_s1 = FALSE;
-static int disable_s2 = FALSE;
-static int fix_dvbt2_delivery_system = SYS_DVBT;
-static char mplp_id[256][1];
-static int lock_mplp_id = 0;
-static int scan_mplp_enable = 0;
-static int use_bouquets = 0;
-
-static rotorslot_t rotor[49];
+#define MAX_RUNNING 128
+#define CARRIER_WAIT_MS	400		/* per channel in the carrier pass of a sweep */
 
 struct section_buf {
 	struct list_head list;
 	const char *dmx_devname;
 	unsigned int run_once  : 1;
 	unsigned int segmented : 1;	/* segmented by table_id_ext */
+	unsigned int pmt_group : 1;	/* in a struct pmt_filter */
+	unsigned int eit       : 1;	/* all EIT tables, handed to sc->eit */
 	int fd;
 	enum pid pid;
 	enum table_id table_id;
@@ -168,14 +83,117 @@ struct section_buf {
 									* segmented tables (like NIT-other)
 									*/
 	int skip_count;
+	unsigned int monitor      : 1;	/* persistent filter of the monitor mode */
+	unsigned int monitor_seen : 1;	/* table was complete (or timed out) once */
+	unsigned int monitor_changing : 1;	/* new version announced to table_updated */
+	int monitor_version;		/* filter out this version, -1 if none yet */
+	struct scans2_table table;
+};
+
+/*
+*  All PMTs on one PID share a filter without the table_id_ext match, the
+*  sections are handed to the services in userspace. Most muxes carry each
+*  PMT on a PID of its own, but on DVB-C and ATSC many share one and would
+*  otherwise take a demux filter each.
+*/
+struct pmt_program {
+	int service_id;
+	int done;
+};
+
+struct pmt_filter {
+	struct section_buf sb;
+	struct list_head list;		/* in scans2.pmt_filters */
+	struct pmt_program *programs;
+	int n_programs;
+	int n_done;
+	int size;
 };
 
-static LIST_HEAD(scanned_transponders);
-static LIST_HEAD(new_transponders);
-static struct transponder *current_tp;
-static struct bouquet_ctx *bouquets = NULL;
+struct scans2 {
+	struct scans2_config cfg;
+	struct scans2_callbacks cb;
+	void *priv;
+
+	char frontend_devname[80];
+	char demux_devname[80];
+	int curr_rotor_pos;
+	rotorslot_t rotor[49];
+	int fix_dvbt2_delivery_system;
+	struct transponder *tw;
+
+	/* what the frontend is locked to: another PLP or stream on it only
+	 * needs a new DTV_STREAM_ID, see same_rf() */
+	int rf_locked;
+	fe_delivery_system_t rf_delivery_system;
+	uint32_t rf_frequency;
+	enum polarisation rf_polarisation;
+	int rf_orbital_pos;
+
+	/* what the frontend can do, see probe_frontend() */
+	int caps_known;
+	uint32_t delsys;			/* bit (1 << fe_delivery_system_t) */
+	struct dvb_frontend_info fe_info;
+	int tunes_avoided;
+
+	int frontend_fd;			/* while a transponder is scanned, for read_stats() */
+	time_t stats_next;
+
+	struct list_head scanned_transponders;
+	struct list_head new_transponders;
+	struct transponder *current_tp;
+
+	struct list_head running_filters;
+	struct list_head waiting_filters;
+	struct list_head pmt_filters;	/* of the transponder being scanned */
+	int defer_pmt;				/* ATSC: PAT only notes the PMT PIDs, see scan_tp_atsc() */
+	struct section_buf *atsc_vct[2];	/* TVCT and CVCT filter for the MGT, or NULL */
+	int n_running;
+	struct pollfd poll_fds[MAX_RUNNING];
+	struct section_buf* poll_section_bufs[MAX_RUNNING];
+
+	struct lcn_table *lcn;		/* with cfg.lcn or cfg.channel_numbers */
+	struct cable_priors *cable;
+	struct eit_table *eit;		/* with cfg.eit and an eit_event callback */
+
+	struct section_buf monitor_pat, monitor_sdt, monitor_nit;
+	int monitor_ready;
+	int stop;
+};
+
+/* the scan driven by this thread, see scans2_run() */
+static __thread struct scans2 *sc;
+
+// transponder parameters for log messages
+static void dump_dvb_parameters (FILE *f, struct transponder *t)
+{
+	if (sc->cb.dump_dvb_parameters)
+		sc->cb.dump_dvb_parameters(f, t);
+	else
+		fprintf(f, "%d", t->frequency);
+}
+
+static void report_progress(int done, int total)
+{
+	if (sc->cb.progress)
+		sc->cb.progress(sc->priv, done, total);
+}
+
+static void report_services(struct transponder *t)
+{
+	struct list_head *pos;
+
+	if (!sc->cb.service_found)
+		return;
+	list_for_each(pos, &t->services)
+		sc->cb.service_found(sc->priv, t, list_entry(pos, struct service, list));
+}
 
-static void dump_dvb_parameters (FILE *f, struct transponder *p);
+static void check_idle(void)
+{
+	if (sc->cb.idle && sc->cb.idle(sc->priv))
+		sc->stop = 1;
+}
 
 static void setup_filter (struct section_buf* s, const char *dmx_devname,
 						  enum pid pid, enum table_id tid, int tid_ext,
@@ -184,14 +202,6 @@ static void add_filter (struct section_buf *s);
 
 int rotor_nn(int orbital_pos, int we_flag);
 
-static void init_mplp_id(void)
-{
-	int i;
-
-	for(i = 0; i < 256; i++)
-		mplp_id[i][0] = -1;
-}
-
 /* According to the DVB standards, the combination of network_id and
 * transport_stream_id should be unique, but in real life the satellite
 * operators and broadcasters don't care enough to coordinate
@@ -210,7 +220,7 @@ static struct transponder *alloc_transponder(uint32_t frequency)
 
 	INIT_LIST_HEAD(&tp->list);
 	INIT_LIST_HEAD(&tp->services);
-	list_add_tail(&tp->list, &new_transponders);
+	list_add_tail(&tp->list, &sc->new_transponders);
 	return tp;
 }
 
@@ -243,16 +253,16 @@ static struct transponder *find_transponder_by_freq(uint32_t frequency)
 	struct list_head *pos;
 	struct transponder *tp;
 
-	list_for_each(pos, &scanned_transponders) {
+	list_for_each(pos, &sc->scanned_transponders) {
 		tp = list_entry(pos, struct transponder, list);
-		if (current_tp_only)
+		if (sc->cfg.current_tp_only)
 			return tp;
 
 		if (is_same_frequency(tp->frequency, frequency))
 			return tp;
 	}
 
-	list_for_each(pos, &new_transponders) {
+	list_for_each(pos, &sc->new_transponders) {
 		tp = list_entry(pos, struct transponder, list);
 
 		if (is_same_frequency(tp->frequency, frequency))
@@ -262,21 +272,38 @@ static struct transponder *find_transponder_by_freq(uint32_t frequency)
 	return NULL;
 }
 
+/* a frequency a DVB-T TS of the scan failed to lock on */
+static int tried_frequency(uint32_t frequency)
+{
+	struct list_head *pos;
+	struct transponder *tp;
+	int i;
+
+	list_for_each(pos, &sc->scanned_transponders) {
+		tp = list_entry(pos, struct transponder, list);
+		for (i = 0; i < tp->n_attempts; i++) {
+			if (is_same_frequency(tp->attempts[i].frequency, frequency))
+				return 1;
+		}
+	}
+	return 0;
+}
+
 static struct transponder *find_transponder(uint32_t frequency, enum polarisation pol)
 {
 	struct list_head *pos;
 	struct transponder *tp;
 
-	list_for_each(pos, &scanned_transponders) {
+	list_for_each(pos, &sc->scanned_transponders) {
 		tp = list_entry(pos, struct transponder, list);
-		if (current_tp_only)
+		if (sc->cfg.current_tp_only)
 			return tp;
 
 		if (is_same_frequency(tp->frequency, frequency) && tp->polarisation == pol)
 			return tp;
 	}
 
-	list_for_each(pos, &new_transponders) {
+	list_for_each(pos, &sc->new_transponders) {
 		tp = list_entry(pos, struct transponder, list);
 
 		if (is_same_frequency(tp->frequency, frequency) && tp->polarisation == pol)
@@ -291,7 +318,7 @@ static void remove_duplicate_transponder(struct transponder *t)
 	struct list_head *pos;
 	struct transponder *tp;
 
-	list_for_each(pos, &new_transponders) {
+	list_for_each(pos, &sc->new_transponders) {
 		tp = list_entry(pos, struct transponder, list);
 
 		if (is_same_transponder(tp, t) && tp != t) {
@@ -301,6 +328,182 @@ static void remove_duplicate_transponder(struct transponder *t)
 	}
 }
 
+static int is_satellite(fe_delivery_system_t d)
+{
+	return d == SYS_DVBS || d == SYS_DVBS2 || d == SYS_DSS || d == SYS_TURBO || d == SYS_ISDBS;
+}
+
+static const char *delsys_str(fe_delivery_system_t d)
+{
+	switch (d) {
+	case SYS_DVBC_ANNEX_AC:	return "DVB-C";
+	case SYS_DVBC_ANNEX_B:	return "DVB-C/B";
+	case SYS_DVBT:			return "DVB-T";
+	case SYS_DVBT2:			return "DVB-T2";
+	case SYS_DSS:			return "DSS";
+	case SYS_DVBS:			return "DVB-S";
+	case SYS_DVBS2:			return "DVB-S2";
+	case SYS_TURBO:			return "TURBO";
+	case SYS_ISDBT:			return "ISDB-T";
+	case SYS_ISDBS:			return "ISDB-S";
+	case SYS_ISDBC:			return "ISDB-C";
+	case SYS_ATSC:			return "ATSC";
+	case SYS_ATSCMH:		return "ATSC-MH";
+	case SYS_DTMB:			return "DTMB";
+	case SYS_CMMB:			return "CMMB";
+	case SYS_DAB:			return "DAB";
+	default:				return "?";
+	}
+}
+
+/*
+*  FE_GET_INFO and DTV_ENUM_DELSYS once before the scan, so that transponders
+*  the frontend can't tune to never reach new_transponders. Older kernels
+*  without DTV_ENUM_DELSYS get the systems from the frontend type. Without
+*  FE_GET_INFO nothing is filtered.
+*/
+static void probe_frontend(int frontend_fd)
+{
+	struct dvb_frontend_info *fi = &sc->fe_info;
+	char systems[128];
+	size_t len = 0;
+	int i;
+
+	if (ioctl(frontend_fd, FE_GET_INFO, fi) == -1) {
+		warning("FE_GET_INFO failed: %m\n");
+		return;
+	}
+	sc->delsys = 0;
+#ifdef DTV_ENUM_DELSYS
+	{
+		struct dtv_property p = { .cmd = DTV_ENUM_DELSYS };
+		struct dtv_properties cmdseq = { .num = 1, .props = &p };
+
+		if (ioctl(frontend_fd, FE_GET_PROPERTY, &cmdseq) == 0) {
+			for (i = 0; i < (int)p.u.buffer.len && i < 32; i++) {
+				if (p.u.buffer.data[i] < 32)
+					sc->delsys |= 1u << p.u.buffer.data[i];
+			}
+		}
+	}
+#endif
+	if (sc->delsys == 0) {
+		switch (fi->type) {
+		case FE_QPSK:
+			sc->delsys = 1u << SYS_DVBS;
+			if (fi->caps & FE_CAN_2G_MODULATION)
+				sc->delsys |= 1u << SYS_DVBS2;
+			break;
+		case FE_QAM:
+			sc->delsys = 1u << SYS_DVBC_ANNEX_AC;
+			break;
+		case FE_OFDM:
+			sc->delsys = 1u << SYS_DVBT;
+			if (fi->caps & FE_CAN_2G_MODULATION)
+				sc->delsys |= 1u << SYS_DVBT2;
+			break;
+		case FE_ATSC:
+			sc->delsys = 1u << SYS_ATSC | 1u << SYS_DVBC_ANNEX_B;
+			break;
+		}
+	}
+	sc->caps_known = 1;
+
+	systems[0] = '\0';
+	for (i = 0; i < 32; i++) {
+		if ((sc->delsys & (1u << i)) && len < sizeof(systems))
+			len += snprintf(systems + len, sizeof(systems) - len, " %s", delsys_str(i));
+	}
+	info("frontend '%s':%s\n", fi->name, systems);
+	verbose("frequency %u..%u %s, symbol rate %u..%u, caps 0x%08X\n",
+		fi->frequency_min, fi->frequency_max, (fi->type == FE_QPSK)? "kHz" : "Hz",
+		fi->symbol_rate_min, fi->symbol_rate_max, fi->caps);
+	if (!sc->cfg.noauto && !(fi->caps & FE_CAN_FEC_AUTO) && !(fi->caps & FE_CAN_QAM_AUTO))
+		info("the frontend can't detect FEC and modulation by itself, consider -X\n");
+}
+
+/*
+*  Whether the frontend found by probe_frontend() can tune to t. A DVB-T or
+*  DVB-S transponder goes to the second generation system when only that is
+*  there, as those demodulators do the first one as well.
+*/
+static int frontend_can(struct transponder *t)
+{
+	const struct dvb_frontend_info *fi = &sc->fe_info;
+	fe_delivery_system_t d = t->delivery_system;
+
+	if (!sc->caps_known || d == SYS_UNDEFINED)
+		return 1;
+
+	if (!(sc->delsys & (1u << d))) {
+		if (d == SYS_DVBT && (sc->delsys & (1u << SYS_DVBT2)))
+			t->delivery_system = SYS_DVBT2;
+		else if (d == SYS_DVBS && (sc->delsys & (1u << SYS_DVBS2)))
+			t->delivery_system = SYS_DVBS2;
+		else {
+			verbose("%u: the frontend has no %s\n", t->frequency, delsys_str(d));
+			return 0;
+		}
+	}
+
+	/* satellite frequencies are those of the LNB output, not checked */
+	if (!is_satellite(d) && fi->type != FE_QPSK && fi->frequency_max &&
+		(t->frequency < fi->frequency_min || t->frequency > fi->frequency_max)) {
+		verbose("%u: out of the frequency range of the frontend\n", t->frequency);
+		return 0;
+	}
+	if ((is_satellite(d) || d == SYS_DVBC_ANNEX_AC) && t->symbol_rate && fi->symbol_rate_max &&
+		(t->symbol_rate < fi->symbol_rate_min || t->symbol_rate > fi->symbol_rate_max)) {
+		verbose("%u: symbol rate %u out of the range of the frontend\n",
+			t->frequency, t->symbol_rate);
+		return 0;
+	}
+	return 1;
+}
+
+/* the same job as t, queued before it */
+static int is_queued(struct transponder *t)
+{
+	struct list_head *pos;
+	struct transponder *tp;
+
+	list_for_each(pos, &sc->new_transponders) {
+		tp = list_entry(pos, struct transponder, list);
+		if (tp == t)
+			break;
+		if (is_same_transponder(tp, t) &&
+			tp->delivery_system == t->delivery_system &&
+			tp->symbol_rate == t->symbol_rate && tp->inversion == t->inversion &&
+			tp->modulation == t->modulation && tp->rolloff == t->rolloff &&
+			tp->fec == t->fec && tp->fecHP == t->fecHP && tp->fecLP == t->fecLP &&
+			tp->bandwidth == t->bandwidth && tp->hierarchy == t->hierarchy &&
+			tp->guard_interval == t->guard_interval &&
+			tp->transmission_mode == t->transmission_mode &&
+			tp->pls_mode == t->pls_mode && tp->pls_code == t->pls_code)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+*  Drops t from new_transponders if the frontend can't tune to it, or if it
+*  is the same job as one before it, e.g. the DVB-S one of a satellite TS
+*  from the NIT on a frontend with only DVB-S2.
+*/
+static int keep_transponder(struct transponder *t)
+{
+	if (frontend_can(t)) {
+		if (!sc->caps_known || !is_queued(t))
+			return 1;
+		verbose("%u: queued already\n", t->frequency);
+	}
+	sc->tunes_avoided++;
+	list_del(&t->list);
+	free(t->other_f);
+	free(t);
+	return 0;
+}
+
 static void copy_transponder(struct transponder *d, struct transponder *s, int isOverride)
 {
 	d->network_id = s->network_id;
@@ -336,6 +539,10 @@ static void copy_transponder(struct transponder *d, struct transponder *s, int i
 	if(isOverride || d->transmission_mode == TRANSMISSION_MODE_AUTO) {
 		d->transmission_mode = s->transmission_mode;
 	}
+	if(isOverride || (d->pls_mode == 0 && d->pls_code == 0)) {
+		d->pls_mode = s->pls_mode;
+		d->pls_code = s->pls_code;
+	}
 	d->polarisation = s->polarisation;
 	d->orbital_pos = s->orbital_pos;
 	d->delivery_system = s->delivery_system;
@@ -380,95 +587,147 @@ static struct service *find_service(struct transponder *tp, int service_id)
 }
 
 
-static void parse_ca_identifier_descriptor (const unsigned char *buf, struct service *s)
+static struct service_es *add_es(struct service *s, int pid, int stream_type, int kind)
 {
-	unsigned char len = buf [1];
-	unsigned int i;
+	struct service_es *e;
 
-	buf += 2;
+	if (s->es_num == s->es_size) {
+		s->es_size = (s->es_size)? s->es_size * 2 : 4;
+		s->es = realloc(s->es, s->es_size * sizeof(struct service_es));
+	}
+	e = &s->es[s->es_num++];
+	memset(e, 0, sizeof(*e));
+	e->pid = pid;
+	e->stream_type = stream_type;
+	e->kind = kind;
+	e->component_tag = -1;
+	if (kind == ES_AUDIO && s->audio_num++ == 0)
+		s->audio_pid = pid;
+	return e;
+}
 
-	if (len > sizeof(s->ca_id)) {
-		len = sizeof(s->ca_id);
-		warning("too many CA system ids\n");
+static void add_ca_id(struct service *s, int id)
+{
+	if (s->ca_num == s->ca_size) {
+		s->ca_size = (s->ca_size)? s->ca_size * 2 : 2;
+		s->ca_id = realloc(s->ca_id, s->ca_size * sizeof(uint16_t));
 	}
+	s->ca_id[s->ca_num++] = id;
+}
 
+/* before a new version of the PMT is parsed */
+static void clear_streams(struct service *s)
+{
+	s->pcr_pid = 0;
+	s->video_pid = 0;
+	s->audio_pid = 0;
+	s->ac3_pid = 0;
+	s->teletext_pid = 0;
+	s->subtitling_pid = 0;
+	s->audio_num = 0;
+	s->es_num = 0;
 	s->ca_num = 0;
-	memcpy(s->ca_id, buf, len);
+}
+
+static void free_service(struct service *s)
+{
+	free(s->provider_name);
+	free(s->service_name);
+	free(s->es);
+	free(s->ca_id);
+	free(s);
+}
+
+const struct service_es *service_find_es(const struct service *s, int kind, int n)
+{
+	int i;
+
+	for (i = 0; i < s->es_num; i++) {
+		if (s->es[i].kind == kind && n-- == 0)
+			return &s->es[i];
+	}
+	return NULL;
+}
+
+static void parse_ca_identifier_descriptor (const unsigned char *buf, struct service *s)
+{
+	unsigned char len = buf [1];
+	int i;
 
-	for (i = 0; i < len / sizeof(s->ca_id[0]); i++) {
-		int id = ((s->ca_id[i] & 0x00FF) << 8) + ((s->ca_id[i] & 0xFF00) >> 8);
-		s->ca_id[i] = id;
-		info("  CA ID 0x%04X\n", s->ca_id[i]);
+	buf += 2;
 
-		s->ca_num++;
+	s->ca_num = 0;
+	for (i = 0; i + 2 <= len; i += 2) {
+		add_ca_id(s, buf[i] << 8 | buf[i + 1]);
+		info("  CA ID 0x%04X\n", s->ca_id[s->ca_num - 1]);
 	}
 }
 
 
+/* the ES loop descriptors are parsed after add_es(), they belong to the
+ * last stream; in the program info loop there is none yet */
 static void parse_iso639_language_descriptor (const unsigned char *buf, struct service *s)
 {
 	unsigned char len = buf [1];
+	struct service_es *e;
 
 	buf += 2;
 
-	if (len >= 4) {
+	if (len >= 4 && s->es_num) {
+		e = &s->es[s->es_num - 1];
 		debug("    LANG=%.3s %d\n", buf, buf[3]);
-		memcpy(s->audio_lang[s->audio_num], buf, 3);
-		s->audio_lang[s->audio_num][3] = '\0';
-#if 0
-		/* seems like the audio_type is wrong all over the place */
-		//if (buf[3] == 0) -> normal
-		if (buf[3] == 1)
-			s->audio_lang[s->audio_num][3] = '!'; /* clean effects (no language) */
-		else if (buf[3] == 2)
-			s->audio_lang[s->audio_num][3] = '?'; /* for the hearing impaired */
-		else if (buf[3] == 3)
-			s->audio_lang[s->audio_num][3] = '+'; /* visually impaired commentary */
-#endif
+		memcpy(e->lang, buf, 3);
+		e->lang[3] = '\0';
+		e->subtype = buf[3];
 	}
 }
 
-static void parse_network_name_descriptor (const unsigned char *buf, void *dummy)
+/* teletext and subtitling descriptors: language, type and page of the
+ * first entry */
+static void parse_teletext_descriptor (const unsigned char *buf, struct service *s)
 {
-	(void)dummy;
-
-	unsigned char len = buf [1];
+	struct service_es *e;
 
-	info("Network Name '%.*s'\n", len, buf + 2);
+	if (buf[1] < 5 || !s->es_num)
+		return;
+	e = &s->es[s->es_num - 1];
+	if (!e->lang[0]) {
+		memcpy(e->lang, buf + 2, 3);
+		e->lang[3] = '\0';
+	}
+	e->subtype = buf[5] >> 3;
+	e->page = (buf[5] & 0x07) << 8 | buf[6];
 }
 
-static void parse_terrestrial_uk_channel_number (const unsigned char *buf, void *dummy)
+static void parse_subtitling_descriptor (const unsigned char *buf, struct service *s)
 {
-	(void)dummy;
-
-	int i, n, channel_num, service_id;
-	struct list_head *p1, *p2;
-	struct transponder *t;
-	struct service *s;
+	struct service_es *e;
 
-	// 32 bits per record
-	n = buf[1] / 4;
-	if (n < 1)
+	if (buf[1] < 8 || !s->es_num)
 		return;
-
-	// desc id, desc len, (service id, service number)
-	buf += 2;
-	for (i = 0; i < n; i++) {
-		service_id = (buf[0]<<8)|(buf[1]&0xff);
-		channel_num = ((buf[2]&0x03)<<8)|(buf[3]&0xff);
-		debug("Service ID 0x%X has channel number %d ", service_id, channel_num);
-		list_for_each(p1, &scanned_transponders) {
-			t = list_entry(p1, struct transponder, list);
-			list_for_each(p2, &t->services) {
-				s = list_entry(p2, struct service, list);
-				if (s->service_id == service_id)
-					s->channel_num = channel_num;
-			}
-		}
-		buf += 4;
+	e = &s->es[s->es_num - 1];
+	if (!e->lang[0]) {
+		memcpy(e->lang, buf + 2, 3);
+		e->lang[3] = '\0';
 	}
+	e->subtype = buf[5];
+	e->page = buf[6] << 8 | buf[7];
+}
+
+static void parse_stream_identifier_descriptor (const unsigned char *buf, struct service *s)
+{
+	if (buf[1] >= 1 && s->es_num)
+		s->es[s->es_num - 1].component_tag = buf[2];
 }
 
+static void parse_network_name_descriptor (const unsigned char *buf, void *dummy)
+{
+	(void)dummy;
+
+	unsigned char len = buf [1];
+
+	info("Network Name '%.*s'\n", len, buf + 2);
+}
 
 static long bcd32_to_cpu (const int b0, const int b1, const int b2, const int b3)
 {
@@ -504,7 +763,7 @@ static void parse_cable_delivery_system_descriptor (const unsigned char *buf, st
 		t->modulation = QAM_AUTO;
 	else
 		t->modulation = qam_tab[buf[8] & 0x0f];
-	t->inversion = spectral_inversion;
+	t->inversion = sc->cfg.spectral_inversion;
 
 	if (verbosity >= 5) {
 		debug("%#04x/%#04x ", t->network_id, t->transport_stream_id);
@@ -517,14 +776,38 @@ static void parse_cable_delivery_system_descriptor (const unsigned char *buf, st
 	}
 }
 
+/*
+*  The PLS gold code of the TS and, for a multistream carrier, its input
+*  stream. Each input stream listed becomes a transponder of its own.
+*/
 static void parse_s2_satellite_delivery_system_descriptor (const unsigned char *buf, struct transponder *t)
 {
+	const unsigned char *p = buf + 3, *end = buf + 2 + buf[1];
+
 	if (!t) {
-		warning("satellite_delivery_system_descriptor outside transport stream definition (ignored)\n");
+		warning("S2_satellite_delivery_system_descriptor outside transport stream definition (ignored)\n");
 		return;
 	}
 
 	t->delivery_system = SYS_DVBS2;
+	if (buf[1] < 1)
+		return;
+
+	if (buf[2] & 0x80) {	/* scrambling_sequence_selector */
+		if (p + 3 > end)
+			return;
+		t->pls_mode = 1;
+		t->pls_code = getBits(p, 6, 18);
+		p += 3;
+	}
+	if (buf[2] & 0x40) {	/* multiple_input_stream_flag */
+		if (p + 1 > end)
+			return;
+		t->stream_id = p[0];
+		t->stream_listed = 1;
+	}
+	debug("S2 ISI %d, PLS gold %d\n", (buf[2] & 0x40)? t->stream_id : -1,
+		(buf[2] & 0x80)? t->pls_code : -1);
 }
 
 static void parse_satellite_delivery_system_descriptor (const unsigned char *buf, struct transponder *t)
@@ -550,7 +833,7 @@ static void parse_satellite_delivery_system_descriptor (const unsigned char *buf
 		}
 	} 
 	else {
-		if (noauto) t->rolloff = ROLLOFF_35;
+		if (sc->cfg.noauto) t->rolloff = ROLLOFF_35;
 	}
 
 	t->frequency = 10 * bcd32_to_cpu (buf[2], buf[3], buf[4], buf[5]);
@@ -572,7 +855,7 @@ static void parse_satellite_delivery_system_descriptor (const unsigned char *buf
 
 	t->symbol_rate = 10 * bcd32_to_cpu (buf[9], buf[10], buf[11], buf[12] & 0xf0);
 
-	t->inversion = spectral_inversion;	
+	t->inversion = sc->cfg.spectral_inversion;	
 
 	t->polarisation = (buf[8] >> 5) & 0x03;
 	t->orbital_pos = bcd32_to_cpu (0x00, 0x00, buf[6], buf[7]);
@@ -608,12 +891,12 @@ static void parse_terrestrial_delivery_system_descriptor (const unsigned char *b
 		return;
 	}
 
-	t->delivery_system = fix_dvbt2_delivery_system;
+	t->delivery_system = sc->fix_dvbt2_delivery_system;
 
 	t->frequency = (buf[2] << 24) | (buf[3] << 16);
 	t->frequency |= (buf[4] << 8) | buf[5];
 	t->frequency *= 10;
-	t->inversion = spectral_inversion;
+	t->inversion = sc->cfg.spectral_inversion;
 
 	t->bandwidth = BANDWIDTH_8_MHZ + ((buf[6] >> 5) & 0x3);
 	t->modulation = m_tab[(buf[7] >> 6) & 0x3];
@@ -646,6 +929,105 @@ static void parse_terrestrial_delivery_system_descriptor (const unsigned char *b
 	}
 }
 
+/*
+*  One PLP of a T2 system: the PLP becomes the stream_id, the cells give
+*  the centre and transposer frequencies. The first frequency is taken
+*  unless the TS already has one, the others go to other_f.
+*/
+static void parse_t2_delivery_system_descriptor (const unsigned char *buf, struct transponder *t)
+{
+	static const fe_bandwidth_t bw_tab [16] = {
+		BANDWIDTH_8_MHZ, BANDWIDTH_7_MHZ, BANDWIDTH_6_MHZ, BANDWIDTH_5_MHZ,
+		BANDWIDTH_10_MHZ, BANDWIDTH_1_712_MHZ, BANDWIDTH_AUTO, BANDWIDTH_AUTO,
+		BANDWIDTH_AUTO, BANDWIDTH_AUTO, BANDWIDTH_AUTO, BANDWIDTH_AUTO,
+		BANDWIDTH_AUTO, BANDWIDTH_AUTO, BANDWIDTH_AUTO, BANDWIDTH_AUTO
+	};
+	static const fe_guard_interval_t gi_tab [8] = {
+		GUARD_INTERVAL_1_32, GUARD_INTERVAL_1_16, GUARD_INTERVAL_1_8, GUARD_INTERVAL_1_4,
+		GUARD_INTERVAL_1_128, GUARD_INTERVAL_19_128, GUARD_INTERVAL_19_256, GUARD_INTERVAL_AUTO
+	};
+	static const fe_transmit_mode_t tm_tab [8] = {
+		TRANSMISSION_MODE_2K, TRANSMISSION_MODE_8K, TRANSMISSION_MODE_4K, TRANSMISSION_MODE_1K,
+		TRANSMISSION_MODE_16K, TRANSMISSION_MODE_32K, TRANSMISSION_MODE_AUTO, TRANSMISSION_MODE_AUTO
+	};
+	const unsigned char *p, *end = buf + 2 + buf[1];
+	uint32_t f[64];
+	int n_f = 0, tfs, len, k;
+
+	if (!t) {
+		warning("T2_delivery_system_descriptor outside transport stream definition (ignored)\n");
+		return;
+	}
+	if (buf[1] < 4)
+		return;
+
+	t->delivery_system = SYS_DVBT2;
+	t->stream_id = buf[3];
+	t->stream_listed = 1;
+	debug("T2 PLP %d, T2_system_id 0x%04X\n", buf[3], buf[4] << 8 | buf[5]);
+	if (buf[1] < 6)
+		return;
+
+	t->bandwidth = bw_tab[(buf[6] >> 2) & 0x0f];
+	t->guard_interval = gi_tab[buf[7] >> 5];
+	t->transmission_mode = tm_tab[(buf[7] >> 2) & 0x7];
+	t->other_frequency_flag = (buf[7] >> 1) & 0x1;
+	tfs = buf[7] & 0x1;
+
+	for (p = buf + 8; p + 2 <= end; ) {
+		debug("  cell 0x%04X\n", p[0] << 8 | p[1]);
+		p += 2;
+		if (tfs) {
+			if (p + 1 > end)
+				break;
+			len = p[0];
+			for (k = 0; k + 4 <= len && p + 1 + k + 4 <= end && n_f < 64; k += 4)
+				f[n_f++] = getBits(p + 1 + k, 0, 32) * 10;
+			p += 1 + len;
+		} else {
+			if (p + 4 > end)
+				break;
+			if (n_f < 64)
+				f[n_f++] = getBits(p, 0, 32) * 10;
+			p += 4;
+		}
+		if (p + 1 > end)
+			break;
+		/* subcells: cell_id_extension, transposer_frequency */
+		len = p[0];
+		for (k = 0; k + 5 <= len && p + 1 + k + 5 <= end && n_f < 64; k += 5)
+			f[n_f++] = getBits(p + 1 + k + 1, 0, 32) * 10;
+		p += 1 + len;
+	}
+
+	if (n_f == 0)
+		return;
+	if (!t->frequency)
+		t->frequency = f[0];
+	if (!t->other_f && n_f > 1) {
+		t->other_f = calloc(n_f - 1, sizeof(*t->other_f));
+		memcpy(t->other_f, f + 1, (n_f - 1) * sizeof(*t->other_f));
+		t->n_other_f = n_f - 1;
+	}
+}
+
+/* the kernel has no C2 delivery system, the PLP is tuned on the current one */
+static void parse_c2_delivery_system_descriptor (const unsigned char *buf, struct transponder *t)
+{
+	if (!t) {
+		warning("C2_delivery_system_descriptor outside transport stream definition (ignored)\n");
+		return;
+	}
+	if (buf[1] < 7)
+		return;
+
+	t->delivery_system = sc->current_tp->delivery_system;
+	t->stream_id = buf[3];
+	t->stream_listed = 1;
+	t->frequency = getBits(buf + 5, 0, 32);
+	debug("C2 PLP %d, data slice %d, %u Hz\n", buf[3], buf[4], t->frequency);
+}
+
 static void parse_frequency_list_descriptor (const unsigned char *buf, struct transponder *t)
 {
 	int n, i;
@@ -952,7 +1334,7 @@ static void parse_service_descriptor (const unsigned char *buf, struct service *
 		free(dvbtext);
 
 	info("0x%04X 0x%04X: pmt_pid 0x%04X %s -- %s (%s%s)\n",
-		current_tp->transport_stream_id,
+		sc->current_tp->transport_stream_id,
 		s->service_id,
 		s->pmt_pid,
 		s->provider_name, s->service_name,
@@ -981,16 +1363,62 @@ static void parse_ca_descriptor (const unsigned char *buf, struct service *s)
 			found++;
 
 	if (!found) {
-		if (s->ca_num + 1 >= CA_SYSTEM_ID_MAX)
-			warning("TOO MANY CA SYSTEM IDs.\n");
-		else {
-			info("  CA ID     : PID 0x%04X\n", CA_system_ID);
-			s->ca_id[s->ca_num]=CA_system_ID;
-			s->ca_num++;
-		}
+		info("  CA ID     : PID 0x%04X\n", CA_system_ID);
+		add_ca_id(s, CA_system_ID);
 	} 	
 } 
 
+static int find_descriptor(uint8_t tag, const unsigned char *buf,
+						   int descriptors_loop_len,
+						   const unsigned char **desc, int *desc_len);
+
+/* stream types of the PMT; private data (0x06) is told apart by the first
+ * descriptor of the list found in the ES info, the order matters: teletext
+ * subtitles come with both the teletext and the subtitling descriptor */
+struct es_type {
+	uint8_t stream_type;
+	uint8_t descriptor;
+	uint8_t kind;
+	uint8_t codec;
+	const char *name;
+};
+
+static const struct es_type es_types[] = {
+	{ 0x01, 0,    ES_VIDEO,       CODEC_MPEG2_VIDEO, "VIDEO" },
+	{ 0x02, 0,    ES_VIDEO,       CODEC_MPEG2_VIDEO, "VIDEO" },
+	{ 0x10, 0,    ES_VIDEO,       CODEC_MPEG4_VIDEO, "MPEG4" },
+	{ 0x1b, 0,    ES_VIDEO,       CODEC_H264,        "H.264" },
+	{ 0x24, 0,    ES_VIDEO,       CODEC_HEVC,        "HEVC" },
+	{ 0x03, 0,    ES_AUDIO,       CODEC_MPEG_AUDIO,  "AUDIO" },
+	{ 0x04, 0,    ES_AUDIO,       CODEC_MPEG_AUDIO,  "AUDIO" },
+	{ 0x0f, 0,    ES_AUDIO,       CODEC_AAC,         "AAC" },
+	{ 0x11, 0,    ES_AUDIO,       CODEC_AAC_LATM,    "AAC LATM" },
+	{ 0x81, 0,    ES_AUDIO,       CODEC_AC3,         "AUDIO" },	/* ATSC A/53B Annex B */
+	{ 0x87, 0,    ES_AUDIO,       CODEC_EAC3,        "E-AC3" },	/* ATSC A/53 */
+	{ 0x06, 0x56, ES_TELETEXT,    CODEC_UNKNOWN,     "TELETEXT" },
+	{ 0x06, 0x59, ES_SUBTITLING,  CODEC_UNKNOWN,     "SUBTITLING" },
+	{ 0x06, 0x6a, ES_AC3,         CODEC_AC3,         "AC3" },
+	{ 0x06, 0x7a, ES_AC3,         CODEC_EAC3,        "E-AC3" },
+	{ 0x06, 0x7b, ES_AC3,         CODEC_DTS,         "DTS" },
+	{ 0x06, 0x7c, ES_AUDIO,       CODEC_AAC,         "AAC" },
+};
+
+static const struct es_type es_other = { 0, 0, ES_OTHER, CODEC_UNKNOWN, "OTHER" };
+
+static const struct es_type *classify_es(int stream_type, const unsigned char *desc, int desc_len)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(es_types) / sizeof(es_types[0]); i++) {
+		if (es_types[i].stream_type != stream_type)
+			continue;
+		if (es_types[i].descriptor == 0 ||
+			find_descriptor(es_types[i].descriptor, desc, desc_len, NULL, NULL))
+			return &es_types[i];
+	}
+	return &es_other;
+}
+
 static int find_descriptor(uint8_t tag, const unsigned char *buf,
 						   int descriptors_loop_len,
 						   const unsigned char **desc, int *desc_len)
@@ -1018,18 +1446,11 @@ static int find_descriptor(uint8_t tag, const unsigned char *buf,
 	return 0;
 }
 
-static void add_plp_id(const unsigned char *buf)
-{
-	int i = buf[3] & 0xff;
-	if(lock_mplp_id)
-		return;
-	info("Found PLP ID = %d\n", i);
-	mplp_id[i][0] = 1;
-}
-
 static void parse_descriptors(enum table_type t, const unsigned char *buf,
 							  int descriptors_loop_len, void *data)
 {
+	uint32_t pds = 0;	/* private data specifier for the following descriptors */
+
 	while (descriptors_loop_len > 0) {
 		unsigned char descriptor_tag = getBits(buf, 0, 8);
 		unsigned char descriptor_len = getBits(buf, 8, 8) + 2;
@@ -1051,6 +1472,21 @@ static void parse_descriptors(enum table_type t, const unsigned char *buf,
 				parse_iso639_language_descriptor (buf, data);
 			break;
 
+		case 0x52:
+			if (t == PMT)
+				parse_stream_identifier_descriptor (buf, data);
+			break;
+
+		case 0x56:
+			if (t == PMT)
+				parse_teletext_descriptor (buf, data);
+			break;
+
+		case 0x59:
+			if (t == PMT)
+				parse_subtitling_descriptor (buf, data);
+			break;
+
 		case 0x40:
 			if (t == NIT)
 				parse_network_name_descriptor (buf, data);
@@ -1062,18 +1498,18 @@ static void parse_descriptors(enum table_type t, const unsigned char *buf,
 			break;
 
 		case 0x79:
-			info("ERROR: S2_satellite_delivery_system_descriptor not parsed\n");
-			if( t == NIT)
+			if (t == NIT)
 				parse_s2_satellite_delivery_system_descriptor (buf, data);
 			break;
 
 		case 0x7f:
-			/* McMCC */
 			if (t == NIT) {
 				switch(buf[2]) {
 					case 0x04: /* DVB-T2 delivery system descriptor */
+						parse_t2_delivery_system_descriptor (buf, data);
+						break;
 					case 0x0d: /* DVB-C2 delivery system descriptor */
-						add_plp_id(buf);
+						parse_c2_delivery_system_descriptor (buf, data);
 						break;
 				}
 			}
@@ -1106,10 +1542,22 @@ static void parse_descriptors(enum table_type t, const unsigned char *buf,
 
 		case 0x83:
 			/* 0x83 is in the privately defined range of descriptor tags,
-			* so we parse this only if the user says so to avoid
-			* problems when 0x83 is something entirely different... */
-			if (t == NIT && vdr_dump_channum)
-				parse_terrestrial_uk_channel_number (buf, data);
+			* so we parse this only if the user says so (-u or -L) to
+			* avoid problems when 0x83 is something entirely different.
+			* The numbers are kept by (onid, tsid, sid) and given to the
+			* services once the scan is done. */
+			/* fall through */
+		case 0x87:
+			if (t == NIT && sc->lcn && data) {
+				struct transponder *tn = data;
+				lcn_parse_nit_descriptor(sc->lcn, buf,
+					tn->original_network_id, tn->transport_stream_id, pds);
+			}
+			break;
+
+		case 0x5f:
+			if (descriptor_len >= 6)
+				pds = getBits(buf + 2, 0, 32);
 			break;
 
 		default:
@@ -1122,29 +1570,84 @@ static void parse_descriptors(enum table_type t, const unsigned char *buf,
 }
 
 
-static void parse_pat(struct section_buf *sb, const unsigned char *buf, int section_length,
-					  int transport_stream_id)
+static void add_pmt_program(int pid, int service_id)
 {
-	(void)transport_stream_id;
-
-	while (section_length > 0) {
-		struct service *s;
-		int service_id = (buf[0] << 8) | buf[1];
+	struct list_head *pos;
+	struct pmt_filter *pf = NULL;
+	int i;
 
-		info("service_id = 0x%X\n",service_id);
+	list_for_each(pos, &sc->pmt_filters) {
+		pf = list_entry(pos, struct pmt_filter, list);
+		if (pf->sb.pid == pid)
+			break;
+		pf = NULL;
+	}
+	if (!pf) {
+		pf = calloc(1, sizeof(struct pmt_filter));
+		setup_filter(&pf->sb, sc->demux_devname, pid, TID_PMT, -1, 1, 0, 5);
+		pf->sb.pmt_group = 1;
+		list_add_tail(&pf->list, &sc->pmt_filters);
+	}
+
+	for (i = 0; i < pf->n_programs; i++) {
+		if (pf->programs[i].service_id == service_id)
+			return;
+	}
+	if (pf->n_programs == pf->size) {
+		pf->size = (pf->size)? pf->size * 2 : 4;
+		pf->programs = realloc(pf->programs, pf->size * sizeof(struct pmt_program));
+	}
+	pf->programs[pf->n_programs].service_id = service_id;
+	pf->programs[pf->n_programs].done = 0;
+	pf->n_programs++;
+
+	/* new, or finished before a later PAT section named this program */
+	if (list_empty(&pf->sb.list)) {
+		pf->sb.sectionfilter_done = 0;
+		add_filter(&pf->sb);
+	}
+}
+
+static void free_pmt_filters(void)
+{
+	struct pmt_filter *pf;
+
+	while (!list_empty(&sc->pmt_filters)) {
+		pf = list_entry(sc->pmt_filters.next, struct pmt_filter, list);
+		list_del(&pf->list);
+		free(pf->programs);
+		free(pf);
+	}
+}
+
+static void parse_pat(struct section_buf *sb, const unsigned char *buf, int section_length,
+					  int transport_stream_id)
+{
+	(void)transport_stream_id;
+
+	while (section_length > 0) {
+		struct service *s;
+		int service_id = (buf[0] << 8) | buf[1];
+
+		info("service_id = 0x%X\n",service_id);
 		if (service_id == 0)
 			goto skip;	/* nit pid entry */
 
 		/* SDT might have been parsed first... */
-		s = find_service(current_tp, service_id);
+		s = find_service(sc->current_tp, service_id);
 		if (!s)
-			s = alloc_service(current_tp, service_id);
+			s = alloc_service(sc->current_tp, service_id);
 		s->pmt_pid = ((buf[2] & 0x1f) << 8) | buf[3];
 		info("pmt_pid = 0x%X\n",s->pmt_pid);
-		if (!s->priv && s->pmt_pid) {
+		if (!sc->cfg.monitor) {
+			if (s->pmt_pid && !sc->defer_pmt)
+				add_pmt_program(s->pmt_pid, s->service_id);
+		}
+		else if (!s->priv && s->pmt_pid) {
 			s->priv = malloc(sizeof(struct section_buf));
-			setup_filter(s->priv, demux_devname,
-				s->pmt_pid, TID_PMT, s->service_id, 1, 0, 5);
+			setup_filter(s->priv, sc->demux_devname,
+				s->pmt_pid, TID_PMT, s->service_id, !sc->cfg.monitor, 0, 5);
+			((struct section_buf *)s->priv)->monitor = !!sc->cfg.monitor;
 
 			add_filter (s->priv);
 		}
@@ -1160,16 +1663,26 @@ static void parse_pmt (struct section_buf *sb, const unsigned char *buf, int sec
 {
 	int program_info_len;
 	struct service *s;
-	char msg_buf[14 * AUDIO_CHAN_MAX + 1];
+	const struct service_es *e;
+	char *msg_buf;
 	char *tmp;
 	int i;
+	int vct_video = -1, vct_audio = -1;
 
-	s = find_service (current_tp, service_id);
+	s = find_service (sc->current_tp, service_id);
 	if (!s) {
 		error("PMT for service_id 0x%04X was not in PAT\n", service_id);
 		return;
 	}
 
+	/* verification of the VCT, the PMT has the final word */
+	if (s->vct_located) {
+		vct_video = s->video_pid;
+		vct_audio = s->audio_pid;
+		clear_streams(s);
+		s->vct_located = 0;
+	}
+
 	s->pcr_pid = ((buf[0] & 0x1f) << 8) | buf[1];
 
 	program_info_len = ((buf[2] & 0x0f) << 8) | buf[3];
@@ -1189,87 +1702,168 @@ static void parse_pmt (struct section_buf *sb, const unsigned char *buf, int sec
 	while (section_length >= 5) {
 		int ES_info_len = ((buf[3] & 0x0f) << 8) | buf[4];
 		int elementary_pid = ((buf[1] & 0x1f) << 8) | buf[2];
+		const struct es_type *type = classify_es(buf[0], buf + 5, ES_info_len);
 
-		switch (buf[0]) 
-		{
-		case 0x01:
-		case 0x02:
-		case 0x1b:
-			info("  VIDEO     : PID 0x%04X\n", elementary_pid);
+		info("  %-10s: PID 0x%04X TYPE 0x%02X\n", type->name, elementary_pid, buf[0]);
+		switch (type->kind) {
+		case ES_VIDEO:
 			if (s->video_pid == 0)
 				s->video_pid = elementary_pid;
 			break;
-
-		case 0x03:
-		case 0x81: /* Audio per ATSC A/53B [2] Annex B */
-		case 0x04:
-			info("  AUDIO     : PID 0x%04X\n", elementary_pid);
-			if (s->audio_num < AUDIO_CHAN_MAX) {
-				s->audio_pid[s->audio_num] = elementary_pid;
-				parse_descriptors (PMT, buf + 5, ES_info_len, s);
-				s->audio_num++;
-			}
-			else
-				warning("more than %i audio channels, truncating\n",
-				AUDIO_CHAN_MAX);
-			break;
-
-		case 0x06:
-			if (find_descriptor(0x56, buf + 5, ES_info_len, NULL, NULL)) {
-				info("  TELETEXT  : PID 0x%04X\n", elementary_pid);
-				s->teletext_pid = elementary_pid;
-				break;
-			}
-			else if (find_descriptor(0x59, buf + 5, ES_info_len, NULL, NULL)) {
-				/* Note: The subtitling descriptor can also signal
-				* teletext subtitling, but then the teletext descriptor
-				* will also be present; so we can be quite confident
-				* that we catch DVB subtitling streams only here, w/o
-				* parsing the descriptor. */
-				info("  SUBTITLING: PID 0x%04X\n", elementary_pid);
-				s->subtitling_pid = elementary_pid;
-				break;
-			}
-			else if (find_descriptor(0x6a, buf + 5, ES_info_len, NULL, NULL)) {
-				info("  AC3       : PID 0x%04X\n", elementary_pid);
+		case ES_AC3:
+			if (s->ac3_pid == 0)
 				s->ac3_pid = elementary_pid;
-				break;
-			}
-			/* fall through */
+			break;
+		case ES_TELETEXT:
+			s->teletext_pid = elementary_pid;
+			break;
+		case ES_SUBTITLING:
+			s->subtitling_pid = elementary_pid;
+			break;
+		}
 
-		default:
-			info("  OTHER     : PID 0x%04X TYPE 0x%02X\n", elementary_pid, buf[0]);
-		};
+		add_es(s, elementary_pid, buf[0], type->kind)->codec = type->codec;
+		parse_descriptors (PMT, buf + 5, ES_info_len, s);
 
 		buf += ES_info_len + 5;
 		section_length -= ES_info_len + 5;
 	};
 
-	tmp = msg_buf;
-	tmp += sprintf(tmp, "0x%04X (%.4s)", s->audio_pid[0], s->audio_lang[0]);
+	if (vct_video >= 0 && (vct_video != s->video_pid || vct_audio != s->audio_pid))
+		warning("VCT and PMT of program %d differ: video 0x%04X/0x%04X, audio 0x%04X/0x%04X\n",
+			service_id, vct_video, s->video_pid, vct_audio, s->audio_pid);
 
-	if (s->audio_num > AUDIO_CHAN_MAX) {
-		warning("more than %i audio channels: %i, truncating to %i\n",
-			AUDIO_CHAN_MAX, s->audio_num, AUDIO_CHAN_MAX);
-		s->audio_num = AUDIO_CHAN_MAX;
+	if (verbosity >= 5) {
+		tmp = msg_buf = malloc(14 * s->audio_num + 1);
+		*tmp = '\0';
+		for (i = 0; (e = service_find_es(s, ES_AUDIO, i)) != NULL; i++)
+			tmp += sprintf(tmp, "%s0x%04X (%.4s)", (i)? ", " : "", e->pid, e->lang);
+
+		debug("0x%04X 0x%04X: %s -- %s, pmt_pid 0x%04X, vpid 0x%04X, apid %s\n",
+			sc->current_tp->transport_stream_id,
+			s->service_id,
+			s->provider_name, s->service_name,
+			s->pmt_pid, s->video_pid, msg_buf);
+		free(msg_buf);
 	}
+}
 
-	for (i=1; i<s->audio_num; i++)
-		tmp += sprintf(tmp, ", 0x%04X (%.4s)", s->audio_pid[i], s->audio_lang[i]);
 
-	debug("0x%04X 0x%04X: %s -- %s, pmt_pid 0x%04X, vpid 0x%04X, apid %s\n",
-		current_tp->transport_stream_id,
-		s->service_id,
-		s->provider_name, s->service_name,
-		s->pmt_pid, s->video_pid, msg_buf);
+/* without a stream_id the frontend picks the first PLP or ISI, usually 0 */
+static int tp_stream(const struct transponder *t)
+{
+	return (t->stream_id == (int)NO_STREAM_ID_FILTER)? 0 : t->stream_id & 0xff;
+}
+
+static struct transponder *find_stream_transponder(uint32_t frequency, int polarisation, int stream)
+{
+	struct list_head *lists[2] = { &sc->scanned_transponders, &sc->new_transponders };
+	struct list_head *pos;
+	struct transponder *tp;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		list_for_each(pos, lists[i]) {
+			tp = list_entry(pos, struct transponder, list);
+			if (is_same_frequency(tp->frequency, frequency) &&
+			    tp->polarisation == polarisation && tp_stream(tp) == stream)
+				return tp;
+		}
+	}
+	return NULL;
+}
+
+/*
+*  Every PLP or S2 input stream listed in the NIT is a transponder of its
+*  own. Those on the carrier being scanned take its parameters and are
+*  tuned next with only a new stream_id; other carriers need -n like any
+*  other TS.
+*/
+static void add_stream_job(struct transponder *tn)
+{
+	struct transponder *cur = sc->current_tp, *t;
+	uint32_t frequency = tn->frequency;
+	int on_current = (frequency == 0), i;
+
+	if (is_same_frequency(frequency, cur->frequency))
+		on_current = 1;
+	for (i = 0; i < tn->n_other_f; i++) {
+		if (is_same_frequency(tn->other_f[i], cur->frequency))
+			on_current = 1;
+	}
+	if (tn->polarisation != cur->polarisation)
+		on_current = 0;
+	if (on_current)
+		frequency = cur->frequency;
+	else if (!sc->cfg.get_other_nits)
+		return;
+
+	if (find_stream_transponder(frequency, tn->polarisation, tn->stream_id))
+		return;
+
+	t = alloc_transponder(frequency);
+	copy_transponder(t, on_current? cur : tn, TRUE);
+	t->network_id = tn->network_id;
+	t->original_network_id = tn->original_network_id;
+	t->transport_stream_id = tn->transport_stream_id;
+	t->frequency = frequency;
+	t->stream_id = tn->stream_id;
+	t->pls_mode = tn->pls_mode;
+	t->pls_code = tn->pls_code;
+	t->stream_listed = 1;
+	t->scan_done = 0;
+	t->last_tuning_failed = 0;
+	if (!keep_transponder(t))
+		return;
+	info("%s %d on %u: TS 0x%04X\n", (tn->delivery_system == SYS_DVBS2)? "ISI" : "PLP",
+		t->stream_id, frequency, t->transport_stream_id);
 }
 
+/*
+*  The cable delivery system descriptor has the true symbol rate and QAM:
+*  the candidates of its frequency collapse into one with them, those of
+*  the other frequencies try them first.
+*/
+static void cable_nit_params(const struct transponder *tn)
+{
+	struct list_head *pos, *n;
+	struct transponder *t, *first = NULL, *keep = NULL;
+
+	list_for_each_safe(pos, n, &sc->new_transponders) {
+		t = list_entry(pos, struct transponder, list);
+		if (!t->cable_guess) {
+			first = NULL;
+			continue;
+		}
+		if (!first || !is_same_frequency(first->frequency, t->frequency))
+			first = t;
+
+		if (is_same_frequency(t->frequency, tn->frequency)) {
+			if (keep) {
+				list_del(&t->list);
+				free(t);
+				continue;
+			}
+			keep = t;
+			t->symbol_rate = tn->symbol_rate;
+			t->modulation = tn->modulation;
+			t->fec = tn->fec;
+			t->delivery_system = tn->delivery_system;
+			t->cable_guess = 0;
+		} else if (t != first && t->symbol_rate == tn->symbol_rate &&
+			t->modulation == tn->modulation) {
+			list_del(&t->list);
+			list_add_tail(&t->list, &first->list);
+			first = t;
+		}
+	}
+}
 
 static void parse_nit (struct section_buf *sb, const unsigned char *buf, int section_length, int network_id)
 {
 	// Update known parameters for current transponder
 	if(sb->table_id == TID_NIT_ACTUAL) {
-		current_tp->network_id = network_id;
+		sc->current_tp->network_id = network_id;
 	}
 
 	// Buffer doesn't include all common fields up to last_section_number
@@ -1331,30 +1925,46 @@ static void parse_nit (struct section_buf *sb, const unsigned char *buf, int sec
 		tn.original_network_id = getBits(buf, 16, 16);
 		tn.transport_stream_id = transport_stream_id;
 		tn.fec = FEC_AUTO;
-		tn.inversion = spectral_inversion;
+		tn.inversion = sc->cfg.spectral_inversion;
 		tn.modulation = QAM_AUTO;
 		tn.rolloff = ROLLOFF_AUTO;
 
 		parse_descriptors (NIT, buf + 6, descriptors_loop_len, &tn);
 
+		if (tn.stream_listed && sc->cfg.scan_mplp) {
+			add_stream_job(&tn);
+			goto next;
+		}
+
+		if ((tn.delivery_system == SYS_DVBC_ANNEX_AC || tn.delivery_system == SYS_DVBC_ANNEX_B) &&
+			tn.symbol_rate && tn.modulation != QAM_AUTO)
+			cable_nit_params(&tn);
+
+		/* the TS is known by the frequency it locked on */
+		if (tried_frequency(tn.frequency))
+			goto next;
+
 		t = find_transponder(tn.frequency, tn.polarisation);
 
 		if (t == NULL) {
-			if(get_other_nits) {
+			if(sc->cfg.get_other_nits) {
 				// New transponder
 				t = alloc_transponder(tn.frequency);
 
 				// For satellites add both DVB-S and DVB-S2 transponders since we don't know what should be used
-				if(current_tp->delivery_system == SYS_DVBS || current_tp->delivery_system == SYS_DVBS2) {
+				if(sc->current_tp->delivery_system == SYS_DVBS || sc->current_tp->delivery_system == SYS_DVBS2) {
 					tn.delivery_system = SYS_DVBS;
 					copy_transponder(t, &tn, TRUE);
+					keep_transponder(t);
 
 					t = alloc_transponder(tn.frequency);
 					tn.delivery_system = SYS_DVBS2;
 					copy_transponder(t, &tn, TRUE);
+					keep_transponder(t);
 				}
 				else {
 					copy_transponder(t, &tn, TRUE);
+					keep_transponder(t);
 				}
 			}
 		}
@@ -1363,6 +1973,8 @@ static void parse_nit (struct section_buf *sb, const unsigned char *buf, int sec
 			copy_transponder(t, &tn, FALSE);
 		}
 
+next:
+		free(tn.other_f);
 		streams_loop_len -= (descriptors_loop_len + 6);
 		buf += (descriptors_loop_len + 6);
 	}
@@ -1377,8 +1989,8 @@ static void parse_sdt (struct section_buf *sb, const unsigned char *buf, int sec
 
 	if(sb->table_id == TID_SDT_ACTUAL) {
 		// update current transporter
-		current_tp->transport_stream_id = transport_stream_id;
-		current_tp->original_network_id = getBits(buf, 0, 16);
+		sc->current_tp->transport_stream_id = transport_stream_id;
+		sc->current_tp->original_network_id = getBits(buf, 0, 16);
 	}
 	
 	buf += 3;	       /*  skip original network id + reserved field */
@@ -1397,10 +2009,10 @@ static void parse_sdt (struct section_buf *sb, const unsigned char *buf, int sec
 			break;
 		}
 
-		s = find_service(current_tp, service_id);
+		s = find_service(sc->current_tp, service_id);
 		if (!s)
 			/* maybe PAT has not yet been parsed... */
-			s = alloc_service(current_tp, service_id);
+			s = alloc_service(sc->current_tp, service_id);
 
 		s->running = getBits(buf, 24, 3);
 		s->scrambled = getBits(buf, 27, 1);
@@ -1416,9 +2028,13 @@ static void parse_sdt (struct section_buf *sb, const unsigned char *buf, int sec
 static void parse_atsc_service_loc_desc(struct service *s,const unsigned char *buf)
 {
 	struct ATSC_service_location_descriptor d = read_ATSC_service_location_descriptor(buf);
+	struct service_es *es;
 	int i;
 	unsigned char *b = (unsigned char *) buf+5;
 
+	/* the descriptor lists every stream, a repeated VCT replaces them */
+	clear_streams(s);
+	s->vct_located = d.number_elements > 0;
 	s->pcr_pid = d.PCR_PID;
 	for (i=0; i < d.number_elements; i++) {
 		struct ATSC_service_location_element e = read_ATSC_service_location_element(b);
@@ -1426,18 +2042,17 @@ static void parse_atsc_service_loc_desc(struct service *s,const unsigned char *b
 		{
 		case 0x02: /* video */
 			s->video_pid = e.elementary_PID;
+			add_es(s, e.elementary_PID, e.stream_type, ES_VIDEO)->codec = CODEC_MPEG2_VIDEO;
 			info("  VIDEO     : PID 0x%04X\n", e.elementary_PID);
 			break;
 
 		case 0x81: /* ATSC audio */
-			if (s->audio_num < AUDIO_CHAN_MAX) {
-				s->audio_pid[s->audio_num] = e.elementary_PID;
-				s->audio_lang[s->audio_num][0] = (e.ISO_639_language_code >> 16) & 0xff;
-				s->audio_lang[s->audio_num][1] = (e.ISO_639_language_code >> 8)  & 0xff;
-				s->audio_lang[s->audio_num][2] =  e.ISO_639_language_code        & 0xff;
-				s->audio_num++;
-			}
-			info("  AUDIO     : PID 0x%04X lang: %s\n",e.elementary_PID,s->audio_lang[s->audio_num-1]);
+			es = add_es(s, e.elementary_PID, e.stream_type, ES_AUDIO);
+			es->codec = CODEC_AC3;
+			es->lang[0] = (e.ISO_639_language_code >> 16) & 0xff;
+			es->lang[1] = (e.ISO_639_language_code >> 8)  & 0xff;
+			es->lang[2] =  e.ISO_639_language_code        & 0xff;
+			info("  AUDIO     : PID 0x%04X lang: %s\n",e.elementary_PID,es->lang);
 			break;
 
 		default:
@@ -1449,37 +2064,15 @@ static void parse_atsc_service_loc_desc(struct service *s,const unsigned char *b
 	}
 }
 
+/* the multiple_string_structure replaces the short name */
 static void parse_atsc_ext_chan_name_desc(struct service *s,const unsigned char *buf)
 {
-	unsigned char *b = (unsigned char *) buf+2;
-	int i,j;
-	int num_str = b[0];
-
-	b++;
-	for (i = 0; i < num_str; i++) {
-		int num_seg = b[3];
-		b += 4; /* skip lang code */
-		for (j = 0; j < num_seg; j++) {
-			int comp_type = b[0],/* mode = b[1],*/ num_bytes = b[2];
-
-			switch (comp_type) 
-			{
-			case 0x00:
-				if (s->service_name)
-					free(s->service_name);
-				s->service_name = malloc(num_bytes * sizeof(char) + 1);
-				memcpy(s->service_name,&b[3],num_bytes);
-				s->service_name[num_bytes] = '\0';
-				break;
-
-			default:
-				warning("compressed strings are not supported yet\n");
-				break;
-			}
+	char *name = atsc_mss_to_utf8(buf + 2, buf[1]);
 
-			b += 3 + num_bytes;
-		}
-	}
+	if (!name)
+		return;
+	free(s->service_name);
+	s->service_name = name;
 }
 
 static void parse_psip_descriptors(struct service *s,const unsigned char *buf,int len)
@@ -1537,28 +2130,21 @@ static void parse_psip_vct (struct section_buf *sb, const unsigned char *buf, in
 
 		case 0x04: /* ATSC Data */
 		default:
+			b += 32 + ch.descriptors_length;
 			continue;
 		}
 
 		if (ch.program_number == 0)
 			ch.program_number = --pseudo_id;
 
-		s = find_service(current_tp, ch.program_number);
+		s = find_service(sc->current_tp, ch.program_number);
 		if (!s)
-			s = alloc_service(current_tp, ch.program_number);
+			s = alloc_service(sc->current_tp, ch.program_number);
 
 		if (s->service_name)
 			free(s->service_name);
 
-		s->service_name = malloc(7*sizeof(unsigned char));
-		/* TODO find a better solution to convert UTF-16 */
-		s->service_name[0] = ch.short_name0;
-		s->service_name[1] = ch.short_name1;
-		s->service_name[2] = ch.short_name2;
-		s->service_name[3] = ch.short_name3;
-		s->service_name[4] = ch.short_name4;
-		s->service_name[5] = ch.short_name5;
-		s->service_name[6] = ch.short_name6;
+		s->service_name = atsc_short_name(&ch);
 
 		parse_psip_descriptors(s,&b[32],ch.descriptors_length);
 
@@ -1579,6 +2165,68 @@ static void parse_psip_vct (struct section_buf *sb, const unsigned char *buf, in
 	}
 }
 
+/* drops a VCT filter the MGT doesn't list, the filter loop removes it */
+static void mgt_drop_vct(struct section_buf *vsb)
+{
+	if (vsb->fd != -1) {
+		vsb->sectionfilter_done = 1;
+		vsb->timeout = 0;
+	} else
+		list_del_init(&vsb->list);
+}
+
+/*
+*  The MGT lists every PSIP table of the mux with PID and version. VCT
+*  filters for a type the MGT doesn't have are dropped instead of waited
+*  for, one it has is started even if -A didn't ask for that type.
+*/
+static void parse_mgt(const unsigned char *buf, int section_length)
+{
+	const unsigned char *end = buf + section_length;
+	struct mgt_table t;
+	int tables_defined, i, n_eit = 0, n_ett = 0;
+	int vct[2] = { 0, 0 };
+	struct section_buf *vsb;
+
+	if (section_length < 3)
+		return;
+	tables_defined = getBits(buf, 8, 16);
+	buf += 3;
+	for (i = 0; i < tables_defined && buf + 11 <= end; i++) {
+		t = read_mgt_table(buf);
+		switch (t.table_type) {
+		case ATSC_MGT_TVCT_CURRENT:
+			vct[0] = 1;
+			break;
+		case ATSC_MGT_CVCT_CURRENT:
+			vct[1] = 1;
+			break;
+		default:
+			if (t.table_type >= ATSC_MGT_EIT_FIRST && t.table_type <= ATSC_MGT_EIT_LAST)
+				n_eit++;
+			else if ((t.table_type >= ATSC_MGT_ETT_FIRST && t.table_type <= ATSC_MGT_ETT_LAST) ||
+					t.table_type == ATSC_MGT_CHANNEL_ETT)
+				n_ett++;
+			break;
+		}
+		verbose("MGT: table type 0x%04X PID 0x%04X version %d, %u bytes\n",
+			t.table_type, t.table_type_PID, t.table_type_version_number, t.number_bytes);
+		buf += 11 + t.table_type_descriptors_length;
+	}
+	info("MGT: %s%s, %d EIT and %d ETT tables\n", vct[0]? "TVCT" : "no TVCT",
+		vct[1]? ", CVCT" : ", no CVCT", n_eit, n_ett);
+
+	for (i = 0; i < 2; i++) {
+		vsb = sc->atsc_vct[i];
+		if (!vsb || vsb->sectionfilter_done)
+			continue;
+		if (!vct[i] && !list_empty(&vsb->list))
+			mgt_drop_vct(vsb);
+		else if (vct[i] && list_empty(&vsb->list))
+			add_filter(vsb);
+	}
+}
+
 static int get_bit (uint8_t *bitfield, int bit)
 {
 	return (bitfield[bit/8] >> (bit % 8)) & 1;
@@ -1590,6 +2238,86 @@ static void set_bit (uint8_t *bitfield, int bit)
 }
 
 
+static void monitor_table_notify(struct section_buf *sb, enum scans2_table_phase phase)
+{
+	if (sc->cb.table_updated)
+		sc->cb.table_updated(sc->priv, sc->current_tp, &sb->table, phase);
+}
+
+/* a new version of a monitored table starts, forget what it described */
+static void monitor_table_begin(struct section_buf *sb)
+{
+	struct list_head *pos;
+	struct service *s = NULL;
+
+	if (!sc->monitor_ready || sb->monitor_changing)
+		return;
+
+	if (sb->table_id == TID_PMT) {
+		s = find_service(sc->current_tp, sb->table_id_ext);
+		if (!s)
+			return;
+	}
+
+	sb->table.pid = sb->pid;
+	sb->table.table_id = sb->table_id;
+	sb->table.table_id_ext = sb->table_id_ext;
+	sb->table.old_version = sb->monitor_version;
+	sb->table.version = sb->section_version_number;
+	sb->monitor_changing = 1;
+	monitor_table_notify(sb, SCANS2_TABLE_CHANGING);
+
+	switch (sb->table_id) {
+	case TID_PMT:
+		clear_streams(s);
+		break;
+
+	case TID_PAT:
+		/* the PMT filters still know the old PIDs, see monitor_pat_done() */
+		list_for_each(pos, &sc->current_tp->services) {
+			s = list_entry(pos, struct service, list);
+			s->pmt_pid = 0;
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+/* a PMT on a shared PID, done once every program of the PAT on it was seen */
+static int parse_pmt_section(struct section_buf *sb, const unsigned char *buf,
+		int section_length, int service_id)
+{
+	struct pmt_filter *pf = list_entry(sb, struct pmt_filter, sb);
+	struct pmt_program *p = NULL;
+	int i;
+
+	for (i = 0; i < pf->n_programs; i++) {
+		if (pf->programs[i].service_id == service_id) {
+			p = &pf->programs[i];
+			break;
+		}
+	}
+	if (!p || p->done)
+		return 0;
+
+	section_length -= CRC_LEN + 5;
+	if (section_length < 0) {
+		warning("truncated section (PID 0x%04X, lenght %d)",
+			sb->pid, section_length + CRC_LEN);
+		return 0;
+	}
+
+	verbose("PMT 0x%04X for service 0x%04X\n", sb->pid, service_id);
+	parse_pmt (sb, buf + 8, section_length, service_id);
+	p->done = 1;
+	if (++pf->n_done < pf->n_programs)
+		return 0;
+	sb->sectionfilter_done = 1;
+	return 1;
+}
+
 /**
 *   returns 0 when more sections are expected
 *	   1 when all sections are read on this pid
@@ -1607,6 +2335,12 @@ static int parse_section(struct section_buf *sb, unsigned char *buf)
 
 	table_id = getBits(buf, 0, 8);
 
+	if (sb->eit) {
+		if (eit_parse_section(sc->eit, buf))
+			sb->sectionfilter_done = 1;
+		return sb->sectionfilter_done;
+	}
+
 	if (sb->table_id != table_id) {
 		info(">>> sb->table_id (%X) != table_id (%X)!\n", sb->table_id, table_id);
 		return -1;
@@ -1621,6 +2355,9 @@ static int parse_section(struct section_buf *sb, unsigned char *buf)
 
 	info(">>> parse_section, section number %d out of %d...!\n", section_number, last_section_number);
 
+	if (sb->pmt_group)
+		return parse_pmt_section(sb, buf, section_length, table_id_ext);
+
 	if (sb->segmented && sb->table_id_ext != -1 && sb->table_id_ext != table_id_ext) {
 		/* find or allocate actual section_buf matching table_id_ext */
 		while (sb->next_seg) {
@@ -1656,6 +2393,9 @@ static int parse_section(struct section_buf *sb, unsigned char *buf)
 		sb->sectionfilter_done = 0;
 		memset (sb->section_done, 0, sizeof(sb->section_done));
 		sb->next_seg = next_seg;
+
+		if (sb->monitor)
+			monitor_table_begin(sb);
 	}
 
 	buf += 8;			/* past generic table header */
@@ -1703,6 +2443,11 @@ static int parse_section(struct section_buf *sb, unsigned char *buf)
 			parse_sdt (sb, buf, section_length, table_id_ext);
 			break;
 
+		case TID_ATSC_MGT:
+			verbose("ATSC MGT\n");
+			parse_mgt(buf, section_length);
+			break;
+
 		case TID_ATSC_CVT1:
 		case TID_ATSC_CVT2:
 			verbose("ATSC VCT\n");
@@ -1711,7 +2456,10 @@ static int parse_section(struct section_buf *sb, unsigned char *buf)
 
 		case TID_BAT:
 			verbose("BAT bouquet_id: %d (0x%04X)\n", table_id_ext, table_id_ext);
-			bouquet_parse_bat(bouquets, buf, section_length, table_id_ext, section_version_number);
+			if (sc->cfg.bouquets)
+				bouquet_parse_bat(sc->cfg.bouquets, buf, section_length, table_id_ext, section_version_number);
+			if (sc->cfg.lcn)
+				lcn_parse_bat(sc->lcn, buf, section_length, table_id_ext);
 			break;
 
 		default:
@@ -1793,12 +2541,6 @@ static int read_sections (struct section_buf *sb)
 	return 0;
 }
 
-static LIST_HEAD(running_filters);
-static LIST_HEAD(waiting_filters);
-static int n_running;
-#define MAX_RUNNING 128
-static struct pollfd poll_fds[MAX_RUNNING];
-static struct section_buf* poll_section_bufs[MAX_RUNNING];
 
 
 static void setup_filter (struct section_buf* s, const char *dmx_devname,
@@ -1812,11 +2554,11 @@ static void setup_filter (struct section_buf* s, const char *dmx_devname,
 	s->pid = pid;
 	s->table_id = tid;
 
-	s->skip_count = skip_count;
+	s->skip_count = sc->cfg.skip_count;
 	s->run_once = run_once;
 	s->segmented = segmented;
 
-	if (long_timeout) {
+	if (sc->cfg.long_timeout) {
 		s->timeout = 5 * timeout;
 	}
 	else {
@@ -1825,6 +2567,7 @@ static void setup_filter (struct section_buf* s, const char *dmx_devname,
 
 	s->table_id_ext = tid_ext;
 	s->section_version_number = -1;
+	s->monitor_version = -1;
 
 	INIT_LIST_HEAD (&s->list);
 }
@@ -1835,24 +2578,24 @@ static void update_poll_fds(void)
 	struct section_buf* s;
 	int i;
 
-	memset(poll_section_bufs, 0, sizeof(poll_section_bufs));
+	memset(sc->poll_section_bufs, 0, sizeof(sc->poll_section_bufs));
 	for (i = 0; i < MAX_RUNNING; i++)
-		poll_fds[i].fd = -1;
+		sc->poll_fds[i].fd = -1;
 	i = 0;
-	list_for_each (p, &running_filters) {
+	list_for_each (p, &sc->running_filters) {
 		if (i >= MAX_RUNNING)
 			fatal("too many poll_fds\n");
 		s = list_entry (p, struct section_buf, list);
 		if (s->fd == -1)
 			fatal("s->fd == -1 on running_filters\n");
 		verbosedebug("poll fd %d\n", s->fd);
-		poll_fds[i].fd = s->fd;
-		poll_fds[i].events = POLLIN;
-		poll_fds[i].revents = 0;
-		poll_section_bufs[i] = s;
+		sc->poll_fds[i].fd = s->fd;
+		sc->poll_fds[i].events = POLLIN;
+		sc->poll_fds[i].revents = 0;
+		sc->poll_section_bufs[i] = s;
 		i++;
 	}
-	if (i != n_running)
+	if (i != sc->n_running)
 		fatal("n_running is hosed\n");
 }
 
@@ -1860,7 +2603,7 @@ static int start_filter (struct section_buf* s)
 {
 	struct dmx_sct_filter_params f;
 
-	if (n_running >= MAX_RUNNING)
+	if (sc->n_running >= MAX_RUNNING)
 		goto err0;
 	if ((s->fd = open (s->dmx_devname, O_RDWR | O_NONBLOCK)) < 0)
 		goto err0;
@@ -1875,12 +2618,23 @@ static int start_filter (struct section_buf* s)
 		f.filter.filter[0] = (uint8_t) s->table_id;
 		f.filter.mask[0]   = 0xff;
 	}
+	if (s->eit) {
+		/* 0x40..0x7F, the EIT table_ids are picked in userspace */
+		f.filter.filter[0] = 0x40;
+		f.filter.mask[0]   = 0xc0;
+	}
 	if (s->table_id_ext < 0x10000 && s->table_id_ext > 0) {
 		f.filter.filter[1] = (uint8_t) ((s->table_id_ext >> 8) & 0xff);
 		f.filter.filter[2] = (uint8_t) (s->table_id_ext & 0xff);
 		f.filter.mask[1] = 0xff;
 		f.filter.mask[2] = 0xff;
 	}
+	if (s->monitor && s->monitor_version >= 0) {
+		/* only current sections with a version other than the known one */
+		f.filter.filter[3] = (s->monitor_version << 1) | 0x01;
+		f.filter.mask[3] = 0x3f;
+		f.filter.mode[3] = 0x3e;
+	}
 
 	f.timeout = 0;
 	f.flags = DMX_IMMEDIATE_START | DMX_CHECK_CRC;
@@ -1894,9 +2648,9 @@ static int start_filter (struct section_buf* s)
 	time(&s->start_time);
 
 	list_del_init (&s->list);  /* might be in waiting filter list */
-	list_add (&s->list, &running_filters);
+	list_add (&s->list, &sc->running_filters);
 
-	n_running++;
+	sc->n_running++;
 	update_poll_fds();
 
 	return 0;
@@ -1915,10 +2669,10 @@ static void stop_filter (struct section_buf *s)
 	ioctl (s->fd, DMX_STOP);
 	close (s->fd);
 	s->fd = -1;
-	list_del (&s->list);
+	list_del_init (&s->list);
 	s->running_time += time(NULL) - s->start_time;
 
-	n_running--;
+	sc->n_running--;
 	update_poll_fds();
 }
 
@@ -1927,7 +2681,7 @@ static void add_filter (struct section_buf *s)
 {
 	verbosedebug("add filter pid 0x%04X\n", s->pid);
 	if (start_filter (s))
-		list_add_tail (&s->list, &waiting_filters);
+		list_add_tail (&s->list, &sc->waiting_filters);
 }
 
 
@@ -1936,8 +2690,8 @@ static void remove_filter (struct section_buf *s)
 	verbosedebug("remove filter pid 0x%04X\n", s->pid);
 	stop_filter (s);
 
-	while (!list_empty(&waiting_filters)) {
-		struct list_head *next = waiting_filters.next;
+	while (!list_empty(&sc->waiting_filters)) {
+		struct list_head *next = sc->waiting_filters.next;
 		s = list_entry (next, struct section_buf, list);
 		if (start_filter (s))
 			break;
@@ -1945,23 +2699,37 @@ static void remove_filter (struct section_buf *s)
 }
 
 
+static void stop_all_filters (void)
+{
+	struct section_buf *s;
+
+	while (!list_empty(&sc->running_filters)) {
+		s = list_entry (sc->running_filters.next, struct section_buf, list);
+		stop_filter (s);
+		INIT_LIST_HEAD (&s->list);
+	}
+	while (!list_empty(&sc->waiting_filters))
+		list_del_init (sc->waiting_filters.next);
+}
+
+
 static void read_filters (void)
 {
 	struct section_buf *sb;
 	int i, n, done;
 
-	n = poll(poll_fds, n_running, 1000);
+	n = poll(sc->poll_fds, sc->n_running, 1000);
 	if (n == -1)
 		errorn("poll");
 
-	for (i = 0; i < n_running; i++) {
-		sb = poll_section_bufs[i];
+	for (i = 0; i < sc->n_running; i++) {
+		sb = sc->poll_section_bufs[i];
 		if (!sb)
 			fatal("poll_section_bufs[%d] is NULL\n", i);
-		if (poll_fds[i].revents)
+		if (sc->poll_fds[i].revents)
 			done = read_sections (sb) == 1;
 		else
-			done = 0; /* timeout */
+			done = sb->sectionfilter_done && !sb->segmented; /* timeout, or dropped */
 		if (done || time(NULL) > sb->start_time + sb->timeout) {
 			if (sb->run_once) {
 				if (done)
@@ -1974,15 +2742,161 @@ static void read_filters (void)
 	}
 }
 
-static int __tune_to_transponder (int frontend_fd, struct transponder *t)
+/* t is on the frequency the frontend is locked to, only its stream differs */
+static int same_rf(const struct transponder *t)
+{
+	return sc->rf_locked &&
+		(t->delivery_system == SYS_DVBT2 || t->delivery_system == SYS_DVBS2) &&
+		t->delivery_system == sc->rf_delivery_system &&
+		t->frequency == sc->rf_frequency &&
+		t->polarisation == sc->rf_polarisation &&
+		t->orbital_pos == sc->rf_orbital_pos;
+}
+
+/* frontends before DVBv5 statistics, some don't support all these ioctls */
+static void read_legacy_stats(int frontend_fd, struct transponder *t)
 {
-	int i;
 	fe_status_t s;
 	uint16_t strength, snr;
 	uint32_t ber, ucblocks;
+
+	if (ioctl(frontend_fd, FE_READ_STATUS, &s) == -1)
+		perror("FE_READ_STATUS failed");
+	if (ioctl(frontend_fd, FE_READ_SIGNAL_STRENGTH, &strength) == -1)
+		strength = -2;
+	if (ioctl(frontend_fd, FE_READ_SNR, &snr) == -1)
+		snr = -2;
+	if (ioctl(frontend_fd, FE_READ_BER, &ber) == -1)
+		ber = -2;
+	if (ioctl(frontend_fd, FE_READ_UNCORRECTED_BLOCKS, &ucblocks) == -1)
+		ucblocks = -2;
+
+	info ("status %02x | signal strength %3u%% | snr %3u%% | ber %d | unc %d\n",
+		s, (strength * 100) / 0xffff, (snr * 100) / 0xffff, ber, ucblocks);
+
+	t->signal_strength = (strength * 100) / 0xffff;
+	t->snr = (snr * 100) / 0xffff;
+	t->ber = ber;
+	t->ucblocks = ucblocks;
+	t->stats_valid = 1;
+}
+
+#ifdef DTV_STAT_SIGNAL_STRENGTH
+// for log messages, two buffers so that one message can show two values
+static const char *stat_str(const struct dtv_stats *st, const char *unit)
+{
+	static __thread char buf[2][24];
+	static __thread int n;
+	char *b = buf[n++ & 1];
+
+	switch (st->scale) {
+	case FE_SCALE_DECIBEL:
+		snprintf(b, sizeof(buf[0]), "%.1f %s", st->svalue / 1000.0, unit);
+		break;
+	case FE_SCALE_RELATIVE:
+		snprintf(b, sizeof(buf[0]), "%3u%%", (unsigned)(st->uvalue * 100 / 0xffff));
+		break;
+	default:
+		return "n/a";
+	}
+	return b;
+}
+#endif
+
+/*
+*  All DVBv5 statistics in one FE_GET_PROPERTY. Called after the lock and,
+*  with cfg.stats_interval, while the tables are read: signal and CNR are
+*  averaged over the samples, the counters are those of the last one.
+*  Returns -1 if the frontend reports none of them.
+*/
+static int read_stats(int frontend_fd, struct transponder *t)
+{
+#ifdef DTV_STAT_SIGNAL_STRENGTH
+	struct dtv_property p[] = {
+		{ .cmd = DTV_STAT_SIGNAL_STRENGTH },
+		{ .cmd = DTV_STAT_CNR },
+		{ .cmd = DTV_STAT_PRE_ERROR_BIT_COUNT },
+		{ .cmd = DTV_STAT_PRE_TOTAL_BIT_COUNT },
+		{ .cmd = DTV_STAT_ERROR_BLOCK_COUNT },
+		{ .cmd = DTV_STAT_TOTAL_BLOCK_COUNT },
+	};
+
+	struct dtv_properties cmdseq = {
+		.num = 6,
+		.props = p
+	};
+	struct dtv_stats *st[6];
+	int i, n = 0, k = t->stats_samples;
+
+	if (ioctl(frontend_fd, FE_GET_PROPERTY, &cmdseq) == -1)
+		return -1;
+
+	/* only the global value, layers are not looked at */
+	for (i = 0; i < 6; i++) {
+		st[i] = &p[i].u.st.stat[0];
+		if (p[i].u.st.len == 0)
+			st[i]->scale = FE_SCALE_NOT_AVAILABLE;
+		else if (st[i]->scale != FE_SCALE_NOT_AVAILABLE)
+			n++;
+	}
+	if (n == 0)
+		return -1;
+
+	if (st[0]->scale != FE_SCALE_NOT_AVAILABLE) {
+		if (k == 0 || t->strength_scale != st[0]->scale)
+			t->strength = st[0]->svalue;
+		else
+			t->strength += (st[0]->svalue - t->strength) / (k + 1);
+		t->strength_scale = st[0]->scale;
+		if (st[0]->scale == FE_SCALE_RELATIVE)
+			t->signal_strength = (t->strength * 100) / 0xffff;
+	}
+	if (st[1]->scale != FE_SCALE_NOT_AVAILABLE) {
+		if (k == 0 || t->cnr_scale != st[1]->scale) {
+			t->cnr = t->cnr_min = st[1]->svalue;
+		} else {
+			t->cnr += (st[1]->svalue - t->cnr) / (k + 1);
+			if (st[1]->svalue < t->cnr_min)
+				t->cnr_min = st[1]->svalue;
+		}
+		t->cnr_scale = st[1]->scale;
+		if (st[1]->scale == FE_SCALE_RELATIVE)
+			t->snr = (t->cnr * 100) / 0xffff;
+	}
+	if (st[2]->scale == FE_SCALE_COUNTER && st[3]->scale == FE_SCALE_COUNTER) {
+		t->pre_error_bits = st[2]->uvalue;
+		t->pre_total_bits = st[3]->uvalue;
+	}
+	if (st[4]->scale == FE_SCALE_COUNTER) {
+		t->error_blocks = st[4]->uvalue;
+		t->total_blocks = (st[5]->scale == FE_SCALE_COUNTER)? st[5]->uvalue : 0;
+		t->ucblocks = t->error_blocks;
+	}
+	t->stats_samples = k + 1;
+	t->stats_valid = 1;
+
+	if (k == 0)
+		info("signal %s | cnr %s | pre-FEC bit errors %llu/%llu | error blocks %llu\n",
+			stat_str(st[0], "dBm"), stat_str(st[1], "dB"),
+			(unsigned long long)t->pre_error_bits, (unsigned long long)t->pre_total_bits,
+			(unsigned long long)t->error_blocks);
+	else
+		verbose("signal sample %d: cnr %s\n", k + 1, stat_str(st[1], "dB"));
+	return 0;
+#else
+	(void)frontend_fd;
+	(void)t;
+	return -1;
+#endif
+}
+
+static int __tune_to_transponder (int frontend_fd, struct transponder *t)
+{
+	int i;
 	uint32_t if_freq = 0, bandwidth_hz = 0;
-	current_tp = t;
+	sc->current_tp = t;
 	int hiband = 0;
+	int fast = same_rf(t);
 
 	struct dtv_property p_clear[] = {
 		{ .cmd = DTV_CLEAR },
@@ -1993,7 +2907,10 @@ static int __tune_to_transponder (int frontend_fd, struct transponder *t)
 		.props = p_clear
 	};
 
-	if ((ioctl(frontend_fd, FE_SET_PROPERTY, &cmdseq_clear)) == -1) {
+	/* a failed fast retune is retried in full */
+	sc->rf_locked = 0;
+
+	if (!fast && (ioctl(frontend_fd, FE_SET_PROPERTY, &cmdseq_clear)) == -1) {
 		perror("FE_SET_PROPERTY DTV_CLEAR failed");
 		return -1;
 	}
@@ -2006,64 +2923,69 @@ static int __tune_to_transponder (int frontend_fd, struct transponder *t)
 		dprintf(1, "\n");
 	}
 
-	fix_dvbt2_delivery_system = SYS_DVBT;
+	sc->fix_dvbt2_delivery_system = SYS_DVBT;
 
-	switch(t->delivery_system) 
+	switch(fast? SYS_UNDEFINED : t->delivery_system) 
 	{
+	case SYS_UNDEFINED:
+		/* the frontend keeps the other properties, LNB and DiSEqC are set */
+		info("same frequency, stream_id %d\n", t->stream_id);
+		break;
+
 	case SYS_DVBS:
 	case SYS_DVBS2:
-		if (lnb_type.high_val) {
-			if (lnb_type.switch_val) {
+		if (sc->cfg.lnb_type.high_val) {
+			if (sc->cfg.lnb_type.switch_val) {
 				/* Voltage-controlled switch */
 				hiband = 0;
 
-				if (t->frequency >= lnb_type.switch_val)
+				if (t->frequency >= sc->cfg.lnb_type.switch_val)
 					hiband = 1;
 
 				setup_switch (frontend_fd,
-					switch_pos,
+					sc->cfg.switch_pos,
 					(t->polarisation == POLARISATION_VERTICAL || t->polarisation == POLARISATION_CIRCULAR_RIGHT)? 0 : 1,
 					hiband,
-					uncommitted_switch_pos);
+					sc->cfg.uncommitted_switch_pos);
 
 				usleep(50000);
 
 				if (hiband)
-					if_freq = abs(t->frequency - lnb_type.high_val);
+					if_freq = abs(t->frequency - sc->cfg.lnb_type.high_val);
 				else
-					if_freq = abs(t->frequency - lnb_type.low_val);
+					if_freq = abs(t->frequency - sc->cfg.lnb_type.low_val);
 			} else {
 				/* C-Band Multipoint LNBf */
 				if_freq = abs(t->frequency - ((t->polarisation == POLARISATION_VERTICAL || t->polarisation == POLARISATION_CIRCULAR_RIGHT)? 
-					lnb_type.low_val: lnb_type.high_val));
+					sc->cfg.lnb_type.low_val: sc->cfg.lnb_type.high_val));
 			}
 		} else	{
 			/* Monopoint LNBf without switch */
-			if_freq = abs(t->frequency - lnb_type.low_val);
+			if_freq = abs(t->frequency - sc->cfg.lnb_type.low_val);
 		}
 		if (verbosity >= 2) {
 			dprintf(1,"DVB-S IF freq is %d\n", if_freq);
 		}
 
 		setup_switch (frontend_fd,
-			switch_pos,
+			sc->cfg.switch_pos,
 			(t->polarisation == POLARISATION_VERTICAL || t->polarisation == POLARISATION_CIRCULAR_RIGHT)? 0 : 1,
 			hiband,
-			uncommitted_switch_pos);
+			sc->cfg.uncommitted_switch_pos);
 
-		if (rotor_pos != 0 ) {
+		if (sc->cfg.rotor_pos != 0 ) {
 			/* Rotate DiSEqC 1.2 rotor to correct orbital position */
-			if (t->orbital_pos!=0) rotor_pos = rotor_nn(t->orbital_pos, t->we_flag);
+			if (t->orbital_pos!=0) sc->cfg.rotor_pos = rotor_nn(t->orbital_pos, t->we_flag);
 			int err;
 			err = rotate_rotor(	frontend_fd,
-						curr_rotor_pos, 
-						rotor_pos,
+						sc->curr_rotor_pos, 
+						sc->cfg.rotor_pos,
 						(t->polarisation == POLARISATION_VERTICAL || t->polarisation == POLARISATION_CIRCULAR_RIGHT)? 0 : 1,
 						hiband);
 			if (err)
 				error("Error in rotate_rotor err=%i\n",err); 
 			else
-				curr_rotor_pos = rotor_pos;
+				sc->curr_rotor_pos = sc->cfg.rotor_pos;
 		}
 		break;
 
@@ -2147,6 +3069,12 @@ static int __tune_to_transponder (int frontend_fd, struct transponder *t)
 		.num = sizeof(p_tune)/sizeof(p_tune[0]),
 		.props = p_tune
 	};
+
+	if (fast) {
+		/* DTV_STREAM_ID and DTV_TUNE */
+		cmdseq_tune.props = p_tune + cmdseq_tune.num - 2;
+		cmdseq_tune.num = 2;
+	}
 	
 	/* discard stale QPSK events */
 	while (1) {
@@ -2166,7 +3094,7 @@ static int __tune_to_transponder (int frontend_fd, struct transponder *t)
 	while(ev.status != 0);
 
 	// Wait for tunning
-	for (i = 0; i < scan_iterations; i++) {
+	for (i = 0; i < sc->cfg.scan_iterations; i++) {
 		usleep (200000);
 
 		if (ioctl(frontend_fd, FE_GET_EVENT, &ev) == -1) {
@@ -2209,24 +3137,22 @@ static int __tune_to_transponder (int frontend_fd, struct transponder *t)
 			t->inversion = p[3].u.data;
 			t->rolloff = p[4].u.data;
 #endif
-			if (ioctl(frontend_fd, FE_READ_STATUS, &s) == -1)
-				perror("FE_READ_STATUS failed");
-			/* some frontends might not support all these ioctls, thus we
-			 * avoid printing errors
-			*/
-			if (ioctl(frontend_fd, FE_READ_SIGNAL_STRENGTH, &strength) == -1)
-				strength = -2;
-			if (ioctl(frontend_fd, FE_READ_SNR, &snr) == -1)
-				snr = -2;
-			if (ioctl(frontend_fd, FE_READ_BER, &ber) == -1)
-				ber = -2;
-			if (ioctl(frontend_fd, FE_READ_UNCORRECTED_BLOCKS, &ucblocks) == -1)
-				ucblocks = -2;
+			t->stats_samples = 0;
+			if (read_stats(frontend_fd, t) == -1)
+				read_legacy_stats(frontend_fd, t);
 
-			info ("status %02x | signal strength %3u%% | snr %3u%% | ber %d | unc %d\n",
-				s, (strength * 100) / 0xffff, (snr * 100) / 0xffff, ber, ucblocks);
+			sc->fix_dvbt2_delivery_system = t->delivery_system;
+			if (t->delivery_system == SYS_DVBC_ANNEX_AC || t->delivery_system == SYS_DVBC_ANNEX_B)
+				cable_priors_learn(sc->cable, t->symbol_rate, t->modulation);
 
-			fix_dvbt2_delivery_system = t->delivery_system;
+			sc->rf_locked = 1;
+			sc->rf_delivery_system = t->delivery_system;
+			sc->rf_frequency = t->frequency;
+			sc->rf_polarisation = t->polarisation;
+			sc->rf_orbital_pos = t->orbital_pos;
+
+			if (sc->cb.tp_locked)
+				sc->cb.tp_locked(sc->priv, t);
 
 			return 0;
 		}
@@ -2243,7 +3169,7 @@ static int tune_to_transponder (int frontend_fd, struct transponder *t)
 {
 	/* move TP from "new" to "scanned" list */
 	list_del_init(&t->list);
-	list_add_tail(&t->list, &scanned_transponders);
+	list_add_tail(&t->list, &sc->scanned_transponders);
 	t->scan_done = 1;
 
 	switch(t->delivery_system) 
@@ -2292,52 +3218,225 @@ static int tune_to_transponder (int frontend_fd, struct transponder *t)
 	return __tune_to_transponder (frontend_fd, t);
 }
 
-static int t_stream_id = -1;
-static struct transponder *tw = NULL;
 
-static int get_mplp_id(void)
+static uint32_t bandwidth_hz(fe_bandwidth_t bw)
+{
+	switch (bw) {
+	case BANDWIDTH_5_MHZ:	return 5000000;
+	case BANDWIDTH_6_MHZ:	return 6000000;
+	case BANDWIDTH_7_MHZ:	return 7000000;
+	case BANDWIDTH_8_MHZ:	return 8000000;
+	case BANDWIDTH_10_MHZ:	return 10000000;
+	default:				return 0;
+	}
+}
+
+/*
+*  Tunes without waiting for the lock: -1 if the frontend reports no carrier
+*  within CARRIER_WAIT_MS, else the signal strength it reads then (0 if it
+*  can't tell). Uses no scan state, so probes can run on several frontends
+*  at once.
+*/
+static int probe_carrier(int frontend_fd, const struct transponder *t)
 {
+	struct dtv_property p[] = {
+		{ .cmd = DTV_CLEAR },
+		{ .cmd = DTV_DELIVERY_SYSTEM,	.u.data = t->delivery_system },
+		{ .cmd = DTV_FREQUENCY,			.u.data = t->frequency },
+		{ .cmd = DTV_MODULATION,		.u.data = t->modulation },
+		{ .cmd = DTV_SYMBOL_RATE,		.u.data = t->symbol_rate },
+		{ .cmd = DTV_INVERSION,			.u.data = t->inversion },
+		{ .cmd = DTV_BANDWIDTH_HZ,		.u.data = bandwidth_hz(t->bandwidth) },
+		{ .cmd = DTV_TUNE },
+	};
+	struct dtv_properties cmdseq = {
+		.num = sizeof(p)/sizeof(p[0]),
+		.props = p
+	};
+	fe_status_t s;
+	uint16_t strength;
 	int i;
 
-	for(i = 1; i < 256; i++) {
-		if(mplp_id[i][0] == 1) {
-			mplp_id[i][0] = -1;
-			lock_mplp_id = 1;
-			return i;
+	if (ioctl(frontend_fd, FE_SET_PROPERTY, &cmdseq) == -1) {
+		perror("FE_SET_PROPERTY TUNE failed");
+		return 0;	/* leave it to the full scan */
+	}
+	for (i = 0; i < CARRIER_WAIT_MS / 50; i++) {
+		usleep(50000);
+		if (ioctl(frontend_fd, FE_READ_STATUS, &s) == 0 &&
+			(s & (FE_HAS_CARRIER | FE_HAS_LOCK))) {
+			if (ioctl(frontend_fd, FE_READ_SIGNAL_STRENGTH, &strength) == -1)
+				strength = 0;
+			return strength;
 		}
 	}
-	lock_mplp_id = 0;
 	return -1;
 }
 
-static int tune_to_next_transponder (int frontend_fd)
-{
+struct carrier_job {
+	int adapter;
+	int frontend;
+	int fd;					/* -1: opened by the job */
+	struct transponder **tps;
+	int *level;				/* probe_carrier() of each */
+	int n;
+	int first;
+	int stride;
+};
+
+static void *carrier_job_run(void *arg)
+{
+	struct carrier_job *j = arg;
+	char devname[80];
+	int fd = j->fd, i;
+
+	if (fd < 0) {
+		snprintf(devname, sizeof(devname), "/dev/dvb/adapter%i/frontend%i",
+			j->adapter, j->frontend);
+		if ((fd = open(devname, O_RDWR | O_NONBLOCK)) < 0) {
+			/* its channels keep level 0 and get the full scan */
+			error("failed to open '%s': %d %m\n", devname, errno);
+			return NULL;
+		}
+	}
+	for (i = j->first; i < j->n; i += j->stride) {
+		j->level[i] = probe_carrier(fd, j->tps[i]);
+		if (j->level[i] < 0)
+			verbose("frontend%i: %u -\n", j->frontend, j->tps[i]->frequency);
+		else
+			verbose("frontend%i: %u carrier, signal %d\n", j->frontend,
+				j->tps[i]->frequency, j->level[i]);
+	}
+	if (j->fd < 0)
+		close(fd);
+	return NULL;
+}
+
+/*
+*  Probes the n channels of tps, spread over the frontend in use and those
+*  of cfg.carrier_frontends, one thread each. level must be 0 on entry.
+*/
+static void probe_carriers(int frontend_fd, struct transponder **tps, int *level, int n)
+{
+	struct carrier_job jobs[1 + SCANS2_MAX_FRONTENDS];
+	pthread_t threads[SCANS2_MAX_FRONTENDS];
+	int started[SCANS2_MAX_FRONTENDS];
+	int n_jobs, i;
+
+	n_jobs = 1 + sc->cfg.n_carrier_frontends;
+	if (n_jobs > n)
+		n_jobs = n;
+	for (i = 0; i < n_jobs; i++) {
+		jobs[i].adapter = sc->cfg.adapter;
+		jobs[i].frontend = i ? sc->cfg.carrier_frontends[i - 1] : sc->cfg.frontend;
+		jobs[i].fd = i ? -1 : frontend_fd;
+		jobs[i].tps = tps;
+		jobs[i].level = level;
+		jobs[i].n = n;
+		jobs[i].first = i;
+		jobs[i].stride = n_jobs;
+	}
+	for (i = 1; i < n_jobs; i++)
+		started[i - 1] = pthread_create(&threads[i - 1], NULL, carrier_job_run, &jobs[i]) == 0;
+	carrier_job_run(&jobs[0]);
+	for (i = 1; i < n_jobs; i++) {
+		if (started[i - 1])
+			pthread_join(threads[i - 1], NULL);
+		else
+			carrier_job_run(&jobs[i]);
+	}
+}
+
+static void add_attempt(struct transponder *t, uint32_t frequency, int level)
+{
+	t->attempts = realloc(t->attempts, (t->n_attempts + 1) * sizeof(*t->attempts));
+	t->attempts[t->n_attempts].frequency = frequency;
+	t->attempts[t->n_attempts].level = level;
+	t->n_attempts++;
+}
+
+/*
+*  DVB-T with other_frequency_flag, the TS didn't lock on t->frequency: the
+*  alternatives not known yet get a carrier probe, on all frontends at once,
+*  and are tuned to by signal strength. Those without a carrier aren't
+*  tuned to at all. Each frequency that fails goes to t->attempts.
+*/
+static int tune_other_frequency(int frontend_fd, struct transponder *t)
+{
+	struct transponder *alt, **tps, *tmp;
+	uint32_t frequency = t->frequency;
+	int *level, n = 0, i, j, l, rc;
+
+	add_attempt(t, t->frequency, 0);
+
+	alt = calloc(t->n_other_f, sizeof(*alt));
+	tps = calloc(t->n_other_f, sizeof(*tps));
+	level = calloc(t->n_other_f, sizeof(*level));
+	for (i = 0; i < t->n_other_f; i++) {
+		if (find_transponder_by_freq(t->other_f[i]) || tried_frequency(t->other_f[i]))
+			continue;
+		alt[n] = *t;
+		alt[n].frequency = t->other_f[i];
+		tps[n] = &alt[n];
+		n++;
+	}
+	if (n > 0) {
+		info("probing %d other frequencies\n", n);
+		probe_carriers(frontend_fd, tps, level, n);
+	}
+
+	/* strongest first, in the order of the descriptor otherwise */
+	for (i = 1; i < n; i++) {
+		for (j = i; j > 0 && level[j] > level[j - 1]; j--) {
+			tmp = tps[j]; tps[j] = tps[j - 1]; tps[j - 1] = tmp;
+			l = level[j]; level[j] = level[j - 1]; level[j - 1] = l;
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		if (level[i] < 0)
+			add_attempt(t, tps[i]->frequency, -1);
+	}
+
+	rc = -1;
+	for (i = 0; i < n && level[i] >= 0; i++) {
+		t->frequency = tps[i]->frequency;
+		info("retrying with f=%d\n", t->frequency);
+		rc = tune_to_transponder(frontend_fd, t);
+		if (rc == 0 || rc == -2)
+			break;
+		add_attempt(t, t->frequency, level[i]);
+	}
+	if (rc != 0)
+		t->frequency = frequency;
+
+	free(level);
+	free(tps);
+	free(alt);
+	return rc;
+}
+
+static int tune_to_next_transponder (int frontend_fd)
+{
 	struct list_head *pos, *tmp;
-	struct transponder *t, *to;
-	uint32_t freq;
 	int rc;
 
-	if(scan_mplp_enable && (t_stream_id = get_mplp_id()) > 0) {
-		goto retry;
+	/* the other PLPs and streams of the locked frequency go first */
+	list_for_each(pos, &sc->new_transponders) {
+		if (same_rf(list_entry (pos, struct transponder, list))) {
+			list_del(pos);
+			list_add(pos, &sc->new_transponders);
+			break;
+		}
 	}
 
-	list_for_each_safe(pos, tmp, &new_transponders) {
-		tw = list_entry (pos, struct transponder, list);
+	list_for_each_safe(pos, tmp, &sc->new_transponders) {
+		sc->tw = list_entry (pos, struct transponder, list);
 
-retry:
-		if(scan_mplp_enable && t_stream_id > 0) {
-			t = calloc(1, sizeof(*t));
-			t->frequency = tw->frequency;
-			t->stream_id = t_stream_id;
-			INIT_LIST_HEAD(&t->list);
-			INIT_LIST_HEAD(&t->services);
-			list_add_tail(&t->list, &scanned_transponders);
-			copy_transponder(t, tw, TRUE);
-			tw = t;
-		} else
-			tw = list_entry (pos, struct transponder, list);
+		rc = tune_to_transponder(frontend_fd, sc->tw);
 
-		rc = tune_to_transponder(frontend_fd, tw);
+		if (rc == -1 && sc->tw->other_frequency_flag && sc->tw->n_other_f)
+			rc = tune_other_frequency(frontend_fd, sc->tw);
 
 		if (rc == 0) {
 			return 0;
@@ -2346,29 +3445,6 @@ retry:
 		if(rc == -2) {
 			return -2;
 		}
-next:
-		if (tw->other_frequency_flag && tw->other_f && tw->n_other_f) {
-			/* check if the alternate freqeuncy is really new to us */
-			freq = tw->other_f[tw->n_other_f - 1];
-			tw->n_other_f--;
-
-			if (find_transponder_by_freq(freq))
-				goto next;
-
-			/* remember tuning to the old frequency failed */
-			to = calloc(1, sizeof(*to));
-			to->frequency = tw->frequency;
-			to->wrong_frequency = 1;
-			INIT_LIST_HEAD(&to->list);
-			INIT_LIST_HEAD(&to->services);
-			list_add_tail(&to->list, &scanned_transponders);
-			copy_transponder(to, tw, FALSE);
-
-			tw->frequency = freq;
-			info("retrying with f=%d\n", tw->frequency);
-
-			goto retry;
-		}
 	}
 	return -1;
 }
@@ -2567,15 +3643,15 @@ static int read_rotor_conf(const char *rotor_conf)
 		if (buf[0] != '#' && buf[0] != '\n') {
 			if (sscanf(buf, "%u %s\n", &nn, angle_we)==2) {
 				i++;
-				rotor[i].nn = nn;
-				strcpy(rotor[i].angle_we,angle_we);
+				sc->rotor[i].nn = nn;
+				strcpy(sc->rotor[i].angle_we,angle_we);
 				strncpy(angle,angle_we,strlen(angle_we)-1);
-				rotor[i].orbital_pos = atof(angle) * 10;
+				sc->rotor[i].orbital_pos = atof(angle) * 10;
 				strncpy(we,angle_we+strlen(angle_we)-1,1);
 				we[1]='\0';
-				rotor[i].we_flag = (strcmp(we,"W")==0 || strcmp(we,"w")==0) ? 0 : 1;
+				sc->rotor[i].we_flag = (strcmp(we,"W")==0 || strcmp(we,"w")==0) ? 0 : 1;
 				//info("rotor: i=%i, nn=%i, orbital_pos=%i we_flag=%i\n", 
-				//	i, rotor[i].nn, rotor[i].orbital_pos, rotor[i].we_flag);
+				//	i, sc->rotor[i].nn, sc->rotor[i].orbital_pos, sc->rotor[i].we_flag);
 			}
 		}
 	}
@@ -2587,20 +3663,20 @@ int rotor_nn(int orbital_pos, int we_flag){
 	/*given say 192,1 return the position number*/
 	int i;
 	for (i=0; i<49; i++){
-		if (rotor[i].orbital_pos == orbital_pos && rotor[i].we_flag == we_flag) {
-			return rotor[i].nn;
+		if (sc->rotor[i].orbital_pos == orbital_pos && sc->rotor[i].we_flag == we_flag) {
+			return sc->rotor[i].nn;
 		}
 	}
 	error("rotor_nn: orbital_pos=%i, we_flag=%i not found.\n", orbital_pos, we_flag);
 	return 0;
 }
 
-int rotor_name2nn(char *angle_we){
+int rotor_name2nn(const char *angle_we){
 	/*given say '19.2E' return the position number*/
 	int i;
 	for (i=0; i<49; i++){
-		if (strcmp(rotor[i].angle_we, angle_we) == 0) {
-			return rotor[i].nn;
+		if (strcmp(sc->rotor[i].angle_we, angle_we) == 0) {
+			return sc->rotor[i].nn;
 		}
 	}
 	error("rotor_name2nn: '%s' not found.\n", angle_we);
@@ -2612,11 +3688,11 @@ float rotor_angle(int nn) {
 	int i;
 	float angle;
 	for (i=0; i<49; i++){
-		if (rotor[i].nn == nn) {
-			if(rotor[i].we_flag == 0) //west
-				angle = 360.00 - rotor[i].orbital_pos / 10;
+		if (sc->rotor[i].nn == nn) {
+			if(sc->rotor[i].we_flag == 0) //west
+				angle = 360.00 - sc->rotor[i].orbital_pos / 10;
 			else //east
-				angle = rotor[i].orbital_pos / 10;
+				angle = sc->rotor[i].orbital_pos / 10;
 			return angle;
 		}
 	}
@@ -2624,7 +3700,38 @@ float rotor_angle(int nn) {
 	return -999;
 }
 
-static int tune_initial (int frontend_fd, const char *initial)
+/*
+*  A cable channel without symbol rate, or without QAM when AUTO is disabled
+*  (-X), becomes one candidate per likely combination, tried in that order.
+*  The first lock drops the others, see remove_duplicate_transponder(), and
+*  the NIT corrects them, see cable_nit_params().
+*/
+static void add_cable_candidates(uint32_t f, uint32_t sr, fe_code_rate_t fec, fe_modulation_t qam)
+{
+	struct cable_prior c[CABLE_MAX_TRIES];
+	struct transponder *t;
+	int n, i;
+
+	n = cable_priors_list(sc->cable, sr, qam, c, CABLE_MAX_TRIES);
+	if (n == 0) {
+		c[0].symbol_rate = sr ? sr : 6900000;
+		c[0].modulation = qam;
+		n = 1;
+	}
+	for (i = 0; i < n; i++) {
+		t = alloc_transponder(f);
+		t->symbol_rate = c[i].symbol_rate;
+		t->delivery_system = t->symbol_rate < 6000000 ? SYS_DVBC_ANNEX_B : SYS_DVBC_ANNEX_AC;
+		t->inversion = sc->cfg.spectral_inversion;
+		t->fec = fec;
+		t->modulation = c[i].modulation;
+		t->stream_id = NO_STREAM_ID_FILTER;
+		t->cable_guess = 1;
+		verbose("candidate %u %u %s\n", f, t->symbol_rate, qam2str(t->modulation));
+	}
+}
+
+static int read_initial (const char *initial)
 {
 	FILE *inif;
 	unsigned int f, sr;
@@ -2642,6 +3749,7 @@ static int tune_initial (int frontend_fd, const char *initial)
 	}
 	while (fgets(buf, sizeof(buf), inif)) {
 		scan_mode = 0;
+		sr = 0;
 		memset(pol, 0, sizeof(pol));
 		memset(fec, 0, sizeof(fec));
 		memset(qam, 0, sizeof(qam));
@@ -2663,18 +3771,18 @@ static int tune_initial (int frontend_fd, const char *initial)
 			{
 			case '1':
 				/* Enable only DVB-S mode */
-				if (!disable_s1) scan_mode1 = TRUE;
+				if (!sc->cfg.disable_s1) scan_mode1 = TRUE;
 				break;
 
 			case '2':
 				/* Enable only DVB-S2 mode */
-				if (!disable_s2) scan_mode2 = TRUE;
+				if (!sc->cfg.disable_s2) scan_mode2 = TRUE;
 				break;
 
 			default:
 				/* Enable both DVB-S and DVB-S2 scan modes */
-				if (!disable_s1) scan_mode1 = TRUE;
-				if (!disable_s2) scan_mode2 = TRUE;
+				if (!sc->cfg.disable_s1) scan_mode1 = TRUE;
+				if (!sc->cfg.disable_s2) scan_mode2 = TRUE;
 				break;
 			}
 
@@ -2696,7 +3804,7 @@ static int tune_initial (int frontend_fd, const char *initial)
 			nmod=2;
 			if (strlen(qam)>0) {
 				modset[0]=str2qam(qam); nmod=1;
-			} else if (noauto) { 
+			} else if (sc->cfg.noauto) { 
 				if (scan_mode1 && !scan_mode2 ) nmod=1;
 			} else {
 				modset[0]=QAM_AUTO; nmod=1;
@@ -2720,7 +3828,7 @@ static int tune_initial (int frontend_fd, const char *initial)
 			nrol=3;
 			if (strlen(rolloff)>0) {
 				rolset[0]=str2rolloff(rolloff); nrol=1;
-			} else if (noauto) { 
+			} else if (sc->cfg.noauto) { 
 				if (scan_mode1 && ! scan_mode2) nrol=1;
 			} else {
 				rolset[0]=ROLLOFF_AUTO; nrol=1;
@@ -2730,7 +3838,7 @@ static int tune_initial (int frontend_fd, const char *initial)
 			fe_code_rate_t fecset[9]={FEC_1_2,FEC_2_3,FEC_3_4,FEC_5_6,FEC_7_8,FEC_8_9,FEC_3_5,FEC_4_5,FEC_9_10};
 			if (strlen(fec)>0) {
 				fecset[0]=str2fec(fec); nfec=1;
-			} else if (noauto) { 
+			} else if (sc->cfg.noauto) { 
 				if (scan_mode1) nfec=6;
 				if (scan_mode2) nfec=9;
 			} else {
@@ -2774,7 +3882,7 @@ static int tune_initial (int frontend_fd, const char *initial)
 								t->polarisation = POLARISATION_VERTICAL;
 								break;
 							}
-							t->inversion = spectral_inversion;
+							t->inversion = sc->cfg.spectral_inversion;
 							t->symbol_rate = sr;
 
 							info("initial transponder DVB-S%s %u %c %d %s %s %s %i %i %i\n",
@@ -2786,10 +3894,15 @@ static int tune_initial (int frontend_fd, const char *initial)
 				}
 			}
 		}
-		else if (sscanf(buf, "C %u %u %4s %6s\n", &f, &sr, fec, qam) >= 2) {
+		else if (sscanf(buf, "C %u %u %4s %6s\n", &f, &sr, fec, qam) >= 1) {
+			if (sr == 0 || (strlen(qam) == 0 && sc->cfg.noauto)) {
+				add_cable_candidates(f, sr, strlen(fec) ? str2fec(fec) : FEC_AUTO,
+					strlen(qam) ? str2qam(qam) : QAM_AUTO);
+				continue;
+			}
 			t = alloc_transponder(f);
 			t->delivery_system = sr < 6000000 ? SYS_DVBC_ANNEX_B : SYS_DVBC_ANNEX_AC;
-			t->inversion = spectral_inversion;
+			t->inversion = sc->cfg.spectral_inversion;
 			t->symbol_rate = sr;
 			t->fec = FEC_AUTO;
 			t->modulation = QAM_AUTO;
@@ -2813,7 +3926,7 @@ static int tune_initial (int frontend_fd, const char *initial)
 			&scan_mode, &f, bw, fec, fec2, qam, mode, guard, hier, &stream_id) >= 2) {
 				t = alloc_transponder(f);
 				t->delivery_system = scan_mode == '2' ? SYS_DVBT2 : SYS_DVBT;
-				t->inversion = spectral_inversion;
+				t->inversion = sc->cfg.spectral_inversion;
 				t->bandwidth = BANDWIDTH_AUTO;
 				t->fecHP = FEC_AUTO;
 				t->fecLP = FEC_AUTO;
@@ -2888,34 +4001,281 @@ static int tune_initial (int frontend_fd, const char *initial)
 
 	fclose(inif);
 
+	return 0;
+}
+
+int scans2_parse_sweep(struct scans2_sweep *w, const char *spec)
+{
+	char sys[4], qam[8];
+	int n;
+
+	memset(w, 0, sizeof(*w));
+	memset(qam, 0, sizeof(qam));
+	n = sscanf(spec, "%3[^:]:%u-%u:%u:%7[^:]:%u", sys, &w->start, &w->end, &w->step,
+		qam, &w->symbol_rate);
+	if (n < 4 || w->step == 0 || w->end < w->start)
+		return -1;
+
+	if (!strcmp(sys, "T"))
+		w->delivery_system = SYS_DVBT;
+	else if (!strcmp(sys, "T2"))
+		w->delivery_system = SYS_DVBT2;
+	else if (!strcmp(sys, "C"))
+		w->delivery_system = SYS_DVBC_ANNEX_AC;
+	else if (!strcmp(sys, "A"))
+		w->delivery_system = SYS_ATSC;
+	else
+		return -1;
+
+	/* a cable symbol rate left out is found by add_cable_candidates() */
+	w->modulation = (n >= 5)? str2qam(qam) : QAM_AUTO;
+	switch (w->step) {
+	case 6000000:	w->bandwidth = BANDWIDTH_6_MHZ; break;
+	case 7000000:	w->bandwidth = BANDWIDTH_7_MHZ; break;
+	case 8000000:	w->bandwidth = BANDWIDTH_8_MHZ; break;
+	default:		w->bandwidth = BANDWIDTH_AUTO; break;
+	}
+	return 0;
+}
+
+static void add_sweep(const struct scans2_sweep *w)
+{
+	struct transponder *t;
+	uint32_t f;
+	int n = 0;
+
+	for (f = w->start; f <= w->end; f += w->step) {
+		if (w->delivery_system == SYS_DVBC_ANNEX_AC &&
+			(w->symbol_rate == 0 || (w->modulation == QAM_AUTO && sc->cfg.noauto))) {
+			add_cable_candidates(f, w->symbol_rate, FEC_AUTO, w->modulation);
+			n++;
+			continue;
+		}
+		t = alloc_transponder(f);
+		t->delivery_system = w->delivery_system;
+		t->inversion = sc->cfg.spectral_inversion;
+		t->modulation = w->modulation;
+		t->symbol_rate = w->symbol_rate;
+		t->fec = FEC_AUTO;
+		t->fecHP = FEC_AUTO;
+		t->fecLP = FEC_AUTO;
+		t->bandwidth = w->bandwidth;
+		t->transmission_mode = TRANSMISSION_MODE_AUTO;
+		t->guard_interval = GUARD_INTERVAL_AUTO;
+		t->hierarchy = HIERARCHY_AUTO;
+		t->stream_id = NO_STREAM_ID_FILTER;
+		n++;
+	}
+	info("sweep: %d channels from %u to %u Hz\n", n, w->start, w->end);
+}
+
+/*
+*  The fast pass of a sweep: every DVB-C/T and ATSC channel still to scan is
+*  tuned just long enough to see a carrier, spread over the frontends of
+*  cfg.carrier_frontends. Channels without one are dropped, the others get
+*  the full lock and scan.
+*/
+static void carrier_pass(int frontend_fd)
+{
+	struct transponder **tps, *t;
+	struct list_head *pos;
+	int *level;
+	int n = 0, kept = 0, i;
+
+	list_for_each(pos, &sc->new_transponders)
+		n++;
+	tps = calloc(n ? n : 1, sizeof(*tps));
+	n = 0;
+	list_for_each(pos, &sc->new_transponders) {
+		t = list_entry(pos, struct transponder, list);
+		switch (t->delivery_system) {
+		case SYS_DVBC_ANNEX_AC:
+		case SYS_DVBC_ANNEX_B:
+		case SYS_DVBT:
+		case SYS_DVBT2:
+		case SYS_ATSC:
+			tps[n++] = t;
+			break;
+		default:
+			break;
+		}
+	}
+	if (n == 0) {
+		free(tps);
+		return;
+	}
+	level = calloc(n, sizeof(*level));
+
+	info("carrier pass over %d channels on %d frontend(s)\n", n,
+		1 + sc->cfg.n_carrier_frontends);
+	probe_carriers(frontend_fd, tps, level, n);
+
+	for (i = 0; i < n; i++) {
+		if (level[i] >= 0) {
+			kept++;
+			continue;
+		}
+		list_del(&tps[i]->list);
+		free(tps[i]->other_f);
+		free(tps[i]);
+	}
+	info("carrier pass: %d of %d channels have a carrier\n", kept, n);
+	free(level);
+	free(tps);
+}
+
+static int tune_initial (int frontend_fd, const char *initial)
+{
+	struct list_head *pos, *tmp;
+
+	if (initial && read_initial(initial) < 0)
+		return -1;
+	if (sc->cfg.sweep.delivery_system != SYS_UNDEFINED)
+		add_sweep(&sc->cfg.sweep);
+	list_for_each_safe(pos, tmp, &sc->new_transponders)
+		keep_transponder(list_entry(pos, struct transponder, list));
+	if (sc->tunes_avoided)
+		info("%d initial transponders dropped, not for this frontend\n", sc->tunes_avoided);
+	if (sc->cfg.carrier_pass || sc->cfg.sweep.delivery_system != SYS_UNDEFINED)
+		carrier_pass(frontend_fd);
+
 	return tune_to_next_transponder(frontend_fd);
 }
 
+static const char *initial_str(int v, const struct strtab *tab)
+{
+	for (; tab->str; tab++) {
+		if (v == tab->val)
+			return tab->str;
+	}
+	return "AUTO";
+}
+
+void scans2_write_initial(struct scans2 *s, FILE *f)
+{
+	static const char pol[] = "HVLR";
+	struct list_head *pos, *prev;
+	struct transponder *t, *u;
 
+	list_for_each(pos, &s->scanned_transponders) {
+		t = list_entry(pos, struct transponder, list);
+		if (!t->scan_done || t->last_tuning_failed)
+			continue;
+		for (prev = s->scanned_transponders.next; prev != pos; prev = prev->next) {
+			u = list_entry(prev, struct transponder, list);
+			if (!u->last_tuning_failed && u->delivery_system == t->delivery_system &&
+				is_same_transponder(u, t))
+				break;
+		}
+		if (prev != pos)
+			continue;
+
+		switch (t->delivery_system) {
+		case SYS_DVBS:
+		case SYS_DVBS2:
+			fprintf(f, "%s %u %c %u %s %s %s", t->delivery_system == SYS_DVBS ? "S1" : "S2",
+				t->frequency, pol[t->polarisation & 3], t->symbol_rate,
+				initial_str(t->fec, fectab), initial_str(t->rolloff, rollofftab),
+				initial_str(t->modulation, qamtab));
+			if (t->delivery_system == SYS_DVBS2 && t->stream_id != (int)NO_STREAM_ID_FILTER)
+				fprintf(f, " %d %d %d", t->stream_id, t->pls_code, t->pls_mode);
+			fprintf(f, "\n");
+			break;
+
+		case SYS_DVBT:
+		case SYS_DVBT2:
+			fprintf(f, "%s %u %s %s %s %s %s %s %s", t->delivery_system == SYS_DVBT ? "T" : "T2",
+				t->frequency, initial_str(t->bandwidth, bwtab),
+				initial_str(t->fecHP, fectab), initial_str(t->fecLP, fectab),
+				initial_str(t->modulation, qamtab), initial_str(t->transmission_mode, modetab),
+				initial_str(t->guard_interval, guardtab), initial_str(t->hierarchy, hiertab));
+			if (t->delivery_system == SYS_DVBT2 && t->stream_id != (int)NO_STREAM_ID_FILTER)
+				fprintf(f, " %d", t->stream_id);
+			fprintf(f, "\n");
+			break;
+
+		case SYS_DVBC_ANNEX_AC:
+		case SYS_DVBC_ANNEX_B:
+			fprintf(f, "C %u %u %s %s\n", t->frequency, t->symbol_rate,
+				initial_str(t->fec, fectab), initial_str(t->modulation, qamtab));
+			break;
+
+		case SYS_ATSC:
+			fprintf(f, "A %u %s\n", t->frequency, initial_str(t->modulation, qamtab));
+			break;
+
+		default:
+			break;
+		}
+	}
+}
+
+
+/* until the filters are done or the scan is stopped */
+static void run_filters(void)
+{
+	do {
+		read_filters ();
+		check_idle ();
+		if (sc->cfg.stats_interval && time(NULL) >= sc->stats_next) {
+			read_stats(sc->frontend_fd, sc->current_tp);
+			sc->stats_next = time(NULL) + sc->cfg.stats_interval;
+		}
+	} while (!sc->stop && !(list_empty(&sc->running_filters) &&
+		list_empty(&sc->waiting_filters)));
+}
+
+/*
+*  With PSIP the PMTs wait for the VCT: the service location descriptor
+*  already has the PCR, video and audio PIDs, so only programs without one
+*  need their PMT, unless the user asked to verify the VCT against them.
+*/
 static void scan_tp_atsc(void)
 {
-	struct section_buf s0,s1,s2;
+	struct section_buf s0,s1,s2,s3;
+	struct list_head *pos;
+	struct service *s;
+	int n = 0;
 
-	if (no_ATSC_PSIP) {
-		setup_filter(&s0, demux_devname, PID_PAT, TID_PAT, -1, 1, 0, 5); /* PAT */
+	if (sc->cfg.no_atsc_psip) {
+		setup_filter(&s0, sc->demux_devname, PID_PAT, TID_PAT, -1, 1, 0, 5); /* PAT */
 		add_filter(&s0);
 	} else {
-		if (ATSC_type & 0x1) {
-			setup_filter(&s0, demux_devname, 0x1ffb, TID_ATSC_CVT1, -1, 1, 0, 5); /* terrestrial VCT */
+		setup_filter(&s3, sc->demux_devname, 0x1ffb, TID_ATSC_MGT, -1, 1, 0, 5); /* MGT */
+		add_filter(&s3);
+		setup_filter(&s0, sc->demux_devname, 0x1ffb, TID_ATSC_CVT1, -1, 1, 0, 5); /* terrestrial VCT */
+		setup_filter(&s1, sc->demux_devname, 0x1ffb, TID_ATSC_CVT2, -1, 1, 0, 5); /* cable VCT */
+		sc->atsc_vct[0] = &s0;
+		sc->atsc_vct[1] = &s1;
+		if (sc->cfg.atsc_type & 0x1)
 			add_filter(&s0);
-		}
-		if (ATSC_type & 0x2) {
-			setup_filter(&s1, demux_devname, 0x1ffb, TID_ATSC_CVT2, -1, 1, 0, 5); /* cable VCT */
+		if (sc->cfg.atsc_type & 0x2)
 			add_filter(&s1);
-		}
-		setup_filter(&s2, demux_devname, PID_PAT, TID_PAT, -1, 1, 0, 5); /* PAT */
+		setup_filter(&s2, sc->demux_devname, PID_PAT, TID_PAT, -1, 1, 0, 5); /* PAT */
 		add_filter(&s2);
+		sc->defer_pmt = 1;
 	}
 
-	do {
-		read_filters ();
-	} while (!(list_empty(&running_filters) &&
-		list_empty(&waiting_filters)));
+	run_filters ();
+
+	if (sc->defer_pmt && !sc->stop) {
+		list_for_each(pos, &sc->current_tp->services) {
+			s = list_entry(pos, struct service, list);
+			if (!s->pmt_pid || (s->vct_located && !sc->cfg.atsc_verify_pmt))
+				continue;
+			add_pmt_program(s->pmt_pid, s->service_id);
+			n++;
+		}
+		info("%d PMTs needed after the VCT\n", n);
+		sc->defer_pmt = 0;
+		run_filters ();
+	}
+	sc->defer_pmt = 0;
+	sc->atsc_vct[0] = sc->atsc_vct[1] = NULL;
+
+	/* the filters live on this stack frame */
+	stop_all_filters ();
+	free_pmt_filters ();
 }
 
 static void scan_tp_dvb (void)
@@ -2925,38 +4285,48 @@ static void scan_tp_dvb (void)
 	struct section_buf s2;
 	struct section_buf s3;
 	struct section_buf s4;
+	struct section_buf s5;
 
 	/**
 	*  filter timeouts > min repetition rates specified in ETR211
 	*/
-	setup_filter (&s0, demux_devname, PID_PAT, TID_PAT, -1, 1, 0, 5); /* PAT */
-	setup_filter (&s1, demux_devname, PID_SDT_BAT_ST, TID_SDT_ACTUAL, -1, 1, 0, 5); /* SDT */
+	setup_filter (&s0, sc->demux_devname, PID_PAT, TID_PAT, -1, 1, 0, 5); /* PAT */
+	setup_filter (&s1, sc->demux_devname, PID_SDT_BAT_ST, TID_SDT_ACTUAL, -1, 1, 0, 5); /* SDT */
 
 	add_filter (&s0);
 	add_filter (&s1);
 
-	if (!current_tp_only) {
-		setup_filter (&s2, demux_devname, PID_NIT_ST, TID_NIT_ACTUAL, -1, 1, 0, 15); /* NIT */
+	if (!sc->cfg.current_tp_only) {
+		setup_filter (&s2, sc->demux_devname, PID_NIT_ST, TID_NIT_ACTUAL, -1, 1, 0, 15); /* NIT */
 		add_filter (&s2);
-		if (get_other_nits) {
+		if (sc->cfg.get_other_nits) {
 			/* get NIT-others
 			* Note: There is more than one NIT-other: one per
 			* network, separated by the network_id.
 			*/
-			setup_filter (&s3, demux_devname, PID_NIT_ST, TID_NIT_OTHER, -1, 1, 1, 15);
+			setup_filter (&s3, sc->demux_devname, PID_NIT_ST, TID_NIT_OTHER, -1, 1, 1, 15);
 			add_filter (&s3);
 		}
 	}
 
-	if (use_bouquets) {
-		setup_filter (&s4, demux_devname, PID_SDT_BAT_ST, TID_BAT, -1, 1, 1, 15);
+	if (sc->cfg.bouquets || sc->cfg.lcn) {
+		setup_filter (&s4, sc->demux_devname, PID_SDT_BAT_ST, TID_BAT, -1, 1, 1, 15);
 		add_filter (&s4);
 	}
 
-	do {
-		read_filters ();
-	} while (!(list_empty(&running_filters) &&
-		list_empty(&waiting_filters)));
+	if (sc->eit) {
+		/* as long as the schedule takes, the other tables are done by then */
+		setup_filter (&s5, sc->demux_devname, PID_EIT_STCIT, -1, -1, 1, 0, 60);
+		s5.eit = 1;
+		eit_begin_tp (sc->eit);
+		add_filter (&s5);
+	}
+
+	run_filters ();
+
+	/* the filters live on this stack frame */
+	stop_all_filters ();
+	free_pmt_filters ();
 }
 
 static void scan_tp(int frontend_fd)
@@ -2975,6 +4345,9 @@ static void scan_tp(int frontend_fd)
 		return;
 	}
 
+	sc->frontend_fd = frontend_fd;
+	sc->stats_next = time(NULL) + sc->cfg.stats_interval;
+
 	switch(p[0].u.data) 
 	{
 	case SYS_DVBS:
@@ -2994,578 +4367,376 @@ static void scan_tp(int frontend_fd)
 	default:
 		break;
 	}
+	sc->frontend_fd = -1;
 }
 
-static void scan_network (int frontend_fd, const char *initial)
+static void monitor_stop_filter(struct section_buf *sb)
 {
-	int rc;
-
-	if (tune_initial (frontend_fd, initial) < 0) {
-		error("initial tuning failed\n");
-		return;
-	}
-
-	init_mplp_id();
-
-	do {
-		scan_tp(frontend_fd);
-		do {
-			rc = tune_to_next_transponder(frontend_fd);
-		} while(rc == -2);
-	} while (rc == 0);
-}
-
-static int sat_number (struct transponder *t)
-{
-	(void) t;
-
-	return switch_pos + uncommitted_switch_pos*4;
+	if (sb->fd >= 0) {
+		remove_filter(sb);
+		INIT_LIST_HEAD(&sb->list);
+	} else
+		list_del_init(&sb->list);	/* still waiting */
 }
 
-static void dump_service(struct transponder *t, struct service *s)
+static void monitor_remove_service(struct service *s)
 {
-	switch (output_format)
-	{
-	case OUTPUT_VDR:
-		vdr_dump_service_parameter_set(stdout, s, t, override_orbital_pos, vdr_dump_channum, vdr_dump_provider, ca_select);
-		break;
-
-	case OUTPUT_VDR_16x:
-		if(t->delivery_system != SYS_DVBS2) {
-			vdr_dump_service_parameter_set(stdout, s, t, override_orbital_pos, vdr_dump_channum, vdr_dump_provider, ca_select);
-		}
-		break;
-
-	case OUTPUT_ZAP:
-		zap_dump_service_parameter_set (stdout, s, t, sat_number(t));
-		break;
-
-	case OUTPUT_M3U:
-		m3u_dump_service_parameter_set (stdout, s, t, url);
-		break;
+	struct section_buf *sb = s->priv;
 
-	default:
-		break;
+	if (sb) {
+		monitor_stop_filter(sb);
+		if (sb->monitor_changing)
+			monitor_table_notify(sb, SCANS2_TABLE_DROPPED);
+		free(sb);
 	}
+	list_del(&s->list);
+	free_service(s);
 }
 
-static void dump_lists (void)
+/* follow the PAT: drop services that left it, move PMT filters to new PIDs */
+static void monitor_pat_done(void)
 {
-	struct list_head *p1, *p2;
-	struct transponder *t;
+	struct list_head *pos, *n;
+	struct section_buf *sb;
 	struct service *s;
-	int n = 0, i;
-	char sn[20];
-	int anon_services = 0;
 
-	list_for_each(p1, &scanned_transponders) {
-		t = list_entry(p1, struct transponder, list);
-		if (t->wrong_frequency)
+	list_for_each_safe(pos, n, &sc->current_tp->services) {
+		s = list_entry(pos, struct service, list);
+		sb = s->priv;
+		if (!sb || sb->pid == s->pmt_pid)
+			continue;
+		if (!s->pmt_pid) {
+			monitor_remove_service(s);
 			continue;
-		list_for_each(p2, &t->services) {
-			n++;
 		}
+		monitor_stop_filter(sb);
+		sb->pid = s->pmt_pid;
+		sb->section_version_number = -1;
+		sb->monitor_version = -1;
+		add_filter(sb);
 	}
-	info("dumping lists (%d services)\n", n);
+}
 
-	list_for_each(p1, &scanned_transponders) {
-		t = list_entry(p1, struct transponder, list);
-		if (t->wrong_frequency) {
-			warning("wrong_frequency\n");
-			continue;
-		}
-		list_for_each(p2, &t->services) {
-			s = list_entry(p2, struct service, list);
+static void monitor_table_done(struct section_buf *sb)
+{
+	int version = sb->section_version_number;
+
+	if (sc->monitor_ready && sb->table_id == TID_PAT)
+		monitor_pat_done();
+	if (sb->monitor_changing) {
+		sb->table.version = version;
+		monitor_table_notify(sb, SCANS2_TABLE_UPDATED);
+		sb->monitor_changing = 0;
+	}
 
-			if (!s->service_name) {
-				/* not in SDT */
-				if (unique_anon_services)
-					snprintf(sn, sizeof(sn), "[%03x-%04x]",
-					anon_services, s->service_id);
-				else
-					snprintf(sn, sizeof(sn), "[%04x]",
-					s->service_id);
-				s->service_name = strdup(sn);
-				anon_services++;
-			}
-			/* ':' is field separator in szap and vdr service lists */
-			for (i = 0; s->service_name[i]; i++) {
-				if (s->service_name[i] == ':')
-					s->service_name[i] = ' ';
-			}
-			for (i = 0; s->provider_name && s->provider_name[i]; i++) {
-				if (s->provider_name[i] == ':')
-					s->provider_name[i] = ' ';
-			}
-			if (s->video_pid && !(serv_select & 1)) {
-				warning("no TV services\n");
-				continue; /* no TV services */
-			}
-			if (!s->video_pid && s->audio_num && !(serv_select & 2)) {
-				warning("no radio services\n");
-				continue; /* no radio services */
-			}
-			if (!s->video_pid && !s->audio_num && !(serv_select & 4)) {
-				warning("no data/other services\n");
-				continue; /* no data/other services */
-			}
+	sb->monitor_seen = 1;
+	sb->monitor_version = version;
 
-			if (s->scrambled && ca_select==0)
-				continue; /* FTA only */
+	/* re-arm with the new version filtered out, keeping the slot */
+	stop_filter(sb);
+	INIT_LIST_HEAD(&sb->list);
+	add_filter(sb);
+}
 
-			if(s->audio_pid[0] == 0 && s->ac3_pid != 0)
-				s->audio_pid[0] = s->ac3_pid;
+static int monitor_initial_scan_done(void)
+{
+	struct list_head *pos;
+	struct section_buf *sb;
 
-			if (!use_bouquets)
-				dump_service(t, s);
-		}
+	list_for_each(pos, &sc->running_filters) {
+		sb = list_entry(pos, struct section_buf, list);
+		if (!sb->monitor_seen)
+			return 0;
 	}
-
-	if (use_bouquets)
-		bouquet_dump(bouquets, &scanned_transponders, ca_select, serv_select, dump_service);
-
-	info("Done.\n");
+	if (!list_empty(&sc->waiting_filters))
+		warning("monitor: more than %d tables, some PMTs are not monitored\n", MAX_RUNNING);
+	return 1;
 }
 
-static void show_existing_tuning_data_files(void)
-{
-#ifndef DATADIR
-#define DATADIR "/usr/local/share"
-#endif
-	static const char* prefixlist[] = { DATADIR "/dvb", "/etc/dvb",
-		DATADIR "/doc/packages/dvb", 0 };
-	unsigned int i;
-	const char **prefix;
-	fprintf(stderr, "initial tuning data files:\n");
-	for (prefix = prefixlist; *prefix; prefix++) {
-		glob_t globbuf;
-		char* globspec = malloc (strlen(*prefix)+9);
-		strcpy (globspec, *prefix); strcat (globspec, "/dvb-?/*");
-		if (! glob (globspec, 0, 0, &globbuf)) {
-			for (i=0; i < globbuf.gl_pathc; i++)
-				fprintf(stderr, " file: %s\n", globbuf.gl_pathv[i]);
-		}
-		free (globspec);
-		globfree (&globbuf);
-	}
-}
-
-static void handle_sigint(int sig)
-{
-	(void)sig;
-	error("interrupted by SIGINT, dumping partial result...\n");
-	dump_lists();
-	exit(2);
-}
-
-static const char *usage = "\n"
-"usage: %s [options...] [-c | initial-tuning-data-file]\n"
-"	atsc/dvbscan doesn't do frequency scans, hence it needs initial\n"
-"	tuning data for at least one transponder/channel.\n"
-"	-c	scan on currently tuned transponder only\n"
-"	-v 	verbose (repeat for more)\n"
-"	-q 	quiet (repeat for less)\n"
-"	-a N	use DVB /dev/dvb/adapterN/\n"
-"	-f N	use DVB /dev/dvb/adapter?/frontendN\n"
-"	-d N	use DVB /dev/dvb/adapter?/demuxN\n"
-"	-s N	use DiSEqC switch position N (DVB-S only)\n"
-"	-S N    use DiSEqC uncommitted switch position N (DVB-S only)\n"
-"	-r sat  move DiSEqC rotor to satellite location, e.g. '13.0E' or '1.0W'\n"
-"	-R N    move DiSEqC rotor to position number N\n"
-"	-i N	spectral inversion setting (0: off, 1: on, 2: auto [default])\n"
-"	-n	evaluate NIT messages for full network scan (slow!)\n"
-"	-5	multiply all filter timeouts by factor 5\n"
-"		for non-DVB-compliant section repitition rates\n"
-"	-O pos	Orbital position override 'S4W', 'S19.2E' - good for VDR output\n"
-"	-k cnt	Skip count: skip the first cnt \n"
-"		messages of each message type (default 0)\n"
-"	-I cnt	Scan iterations count (default 10).\n"
-"		Larger number will make scan longer on every channel\n"
-"	-M	Scan with support Multiple-PLP (DVB-T2 only)\n"
-"	-H url	Generation M3U playlist for SATIP, use as 'http://host:port' or 'rtsp://host:port'\n"
-"	-o fmt	output format: 'm3u', 'vdr' (default), 'vdr16x' for VDR version 1.6.x or 'zap'\n"
-"	-x N	Conditional Access, (default -1)\n"
-"		N=-2  gets all channels (FTA and encrypted),\n"
-"		      output received CAID :CAID:\n"
-"		N=-1  gets all channels (FTA and encrypted),\n"
-"		      output CA is set to :0:\n"
-"		N=0   gets only FTA channels\n"
-"		N=xxx  sets ca field in vdr output to :xxx:\n"
-"	-t N  Service select, Combined bitfield parameter.\n"
-"		1 = TV, 2 = Radio, 4 = Other, (default 7)\n"
-"	-p	for vdr output format: dump provider name\n"
-"	-e N  VDR version, default 2 for VDR-1.2.x\n"
-"		ANYTHING ELSE GIVES NONZERO NIT and TID\n"
-"		Vdr version 1.3.x and up implies -p.\n"
-"	-l lnb-type (DVB-S Only) (use -l help to print types) or \n"
-"	-l low[,high[,switch]] in Mhz\n"
-"	-u UK DVB-T Freeview channel numbering for VDR\n\n"
-"	-P do not use ATSC PSIP tables for scanning\n"
-"	    (but only PAT and PMT) (applies for ATSC only)\n"
-"	-A N	check for ATSC 1=Terrestrial [default], 2=Cable or 3=both\n"
-"	-U	Uniquely name unknown services\n"
-"	-D s	Disable specified scan mode (by default all modes are enabled)\n"
-"		s=S1  Disable DVB-S scan\n"
-"		s=S2  Disable DVB-S2 scan (good for owners of cards that do not\n"
-"		      support DVB-S2 systems)\n"
-"	-X	Disable AUTOs for initial transponders (esp. for hardware which\n"
-"		not support it). Instead try each value of any free parameters.\n"
-"	-B opts	Parse BAT and create channel groups for VDR output.\n"
-"		Use -B help for options.\n"
-"	-b	The same as -B, default options.\n";
-
-
-void bad_usage(char *pname, int problem)
+static void monitor_read_filters(void)
 {
-	int i;
-	struct lnb_types_st *lnbp;
-	char **cp;
+	struct section_buf *sb;
+	int i, n;
 
-	switch (problem) 
-	{
-	default:
-	case 0:
-		fprintf (stderr, usage, pname);
-		break;
+	n = poll(sc->poll_fds, sc->n_running, 1000);
+	if (n == -1)
+		errorn("poll");
 
-	case 1:
-		i = 0;
-		fprintf(stderr, "-l <lnb-type> or -l low[,high[,switch]] in Mhz\n"
-			"where <lnb-type> is:\n");
-		while(NULL != (lnbp = lnb_enum(i))) {
-			fprintf (stderr, "%s\n", lnbp->name);
-			for (cp = lnbp->desc; *cp ; cp++) {
-				fprintf (stderr, "   %s\n", *cp);
-			}
-			i++;
+	/* update_poll_fds() clears revents whenever the filter set changes */
+	for (i = 0; i < sc->n_running; i++) {
+		sb = sc->poll_section_bufs[i];
+		if (sc->poll_fds[i].revents && read_sections(sb) == 1)
+			monitor_table_done(sb);
+		else if (!sb->monitor_seen && time(NULL) > sb->start_time + sb->timeout) {
+			warning("filter timeout pid 0x%04X\n", sb->pid);
+			sb->monitor_seen = 1;
 		}
-		break;
-
-	case 2:
-		show_existing_tuning_data_files();
-		fprintf (stderr, usage, pname);
-		break;
 	}
 }
 
-int main (int argc, char **argv)
+/*
+*  Keeps PAT, SDT/NIT actual and all PMTs of the current transponder
+*  filtered. Once a table is complete its filter is re-armed to drop the
+*  version just seen, so the demux stays silent until the broadcaster
+*  changes something and only the changed table is parsed again.
+*/
+static void monitor_tp(void)
 {
-	char frontend_devname [80];
-	int adapter = 0, frontend = 0, demux = 0;
-	int opt, i;
-	int frontend_fd;
-	int fe_open_mode;
-	const char *initial = NULL;
-
-	if (argc <= 1) {
-		bad_usage(argv[0], 2);
-		return -1;
+	struct section_buf *pat = &sc->monitor_pat;
+	struct section_buf *sdt = &sc->monitor_sdt;
+	struct section_buf *nit = &sc->monitor_nit;
+	int dvb = sc->current_tp->delivery_system != SYS_ATSC;
+
+	setup_filter (pat, sc->demux_devname, PID_PAT, TID_PAT, -1, 0, 0, 5);
+	pat->monitor = 1;
+	add_filter (pat);
+
+	if (dvb) {
+		setup_filter (sdt, sc->demux_devname, PID_SDT_BAT_ST, TID_SDT_ACTUAL, -1, 0, 0, 5);
+		sdt->monitor = 1;
+		add_filter (sdt);
+		setup_filter (nit, sc->demux_devname, PID_NIT_ST, TID_NIT_ACTUAL, -1, 0, 0, 15);
+		nit->monitor = 1;
+		add_filter (nit);
 	}
 
-	info("API major %d, minor %d\n", DVB_API_VERSION, DVB_API_VERSION_MINOR);
-
-	/* start with default lnb type */
-	lnb_type = *lnb_enum(0);
-	while ((opt = getopt(argc, argv, "5cnMXpa:f:d:O:k:I:S:s:r:R:H:o:D:x:t:i:l:vquPA:UbB:")) != -1) {
-		switch (opt) 
-		{
-		case 'a':
-			adapter = strtoul(optarg, NULL, 0);
-			break;
-
-		case 'b':
-		case 'B':
-			if (opt == 'B' && optarg && strcmp(optarg, "help") == 0) {
-				fprintf(stderr, "%s", bouquet_help_msg());
-				return -1;
-			}
-			if (!use_bouquets) {
-				bouquets = bouquet_create((opt == 'B')? optarg : "");
-				if (!bouquets)
-					return -1;
-				use_bouquets = 1;
-			}
-			break;
-
-		case 'c':
-			current_tp_only = 1;
-			if (!output_format_set)
-				output_format = OUTPUT_VDR;
-			break;
-
-		case 'n':
-			get_other_nits = 1;
-			break;
-
-		case 'X':
-			noauto = 1;
-			break;
-
-		case 'M':
-			scan_mplp_enable = 1;
-			break;
-
-		case 'd':
-			demux = strtoul(optarg, NULL, 0);
-			break;
-
-		case 'f':
-			frontend = strtoul(optarg, NULL, 0);
-			break;
-
-		case 'k':
-			skip_count = strtoul(optarg, NULL, 0);
-			break;
-
-		case 'I':
-			scan_iterations = strtoul(optarg, NULL, 0);
-			break;
-
-		case 'p':
-			vdr_dump_provider = 1;
-			break;
-
-		case 's':
-			switch_pos = strtoul(optarg, NULL, 0);
-			break;
-
-		case 'S':
-			uncommitted_switch_pos = strtoul(optarg, NULL, 0);
-			break;
+	while (!sc->stop) {
+		monitor_read_filters();
+		if (!sc->monitor_ready && monitor_initial_scan_done()) {
+			info("monitor: initial scan done\n");
+			sc->monitor_ready = 1;
+			report_services(sc->current_tp);
+			report_progress(1, 1);
+		}
+		check_idle();
+	}
+	stop_all_filters();
+}
 
-		case 'r':
-			strncpy(rotor_pos_name,optarg,sizeof(rotor_pos_name)-1);
-			break;
+static int count_transponders(struct list_head *l)
+{
+	struct list_head *pos;
+	int n = 0;
 
-		case 'R':
-			rotor_pos = strtoul(optarg, NULL, 0);
-			break;
+	list_for_each(pos, l)
+		n++;
+	return n;
+}
 
-		case 'O':
-			strncpy(override_orbital_pos, optarg, sizeof(override_orbital_pos)-1);
-			break;
+static void scan_network (int frontend_fd, const char *initial)
+{
+	int rc, done;
 
-		case 'o':
-			if      (strcmp(optarg, "zap") == 0) output_format = OUTPUT_ZAP;
-			else if (strcmp(optarg, "vdr") == 0) output_format = OUTPUT_VDR;
-			else if (strcmp(optarg, "vdr16x") == 0) output_format = OUTPUT_VDR_16x;
-			else if (strcmp(optarg, "m3u") == 0) output_format = OUTPUT_M3U;
-			else {
-				bad_usage(argv[0], 0);
-				return -1;
-			}
-			output_format_set = 1;
-			break;
+	if (tune_initial (frontend_fd, initial) < 0) {
+		error("initial tuning failed\n");
+		return;
+	}
 
-		case 'H':
-			if(!strncmp(optarg, "http://", 7) || !strncmp(optarg, "rtsp://", 7))
-				strncpy(url, optarg, sizeof(url)-1);
-			else {
-				bad_usage(argv[0], 0);
-				return -1;
-			}
+	do {
+		scan_tp(frontend_fd);
+		report_services(sc->current_tp);
+		done = count_transponders(&sc->scanned_transponders);
+		report_progress(done, done + count_transponders(&sc->new_transponders));
+		if (sc->stop)
 			break;
+		do {
+			rc = tune_to_next_transponder(frontend_fd);
+		} while(rc == -2);
+	} while (rc == 0);
+}
 
-		case 'D':
-			if      (strcmp(optarg, "S1") == 0) disable_s1 = TRUE;
-			else if (strcmp(optarg, "S2") == 0) disable_s2 = TRUE;
-			else {
-				bad_usage(argv[0], 0);
-				return -1;
-			}
-			output_format_set = 1;
-			break;
+/* the transponder the frontend is tuned to, with its parameters from the driver */
+static int query_current_tp(int frontend_fd)
+{
+	struct dtv_property p[] = {
+		{ .cmd = DTV_FREQUENCY },
+		{ .cmd = DTV_DELIVERY_SYSTEM },
+		{ .cmd = DTV_MODULATION },
+		{ .cmd = DTV_SYMBOL_RATE },
+		{ .cmd = DTV_INNER_FEC },
+		{ .cmd = DTV_INVERSION },
+		{ .cmd = DTV_ROLLOFF },
+		{ .cmd = DTV_BANDWIDTH_HZ },
+		{ .cmd = DTV_STREAM_ID },
+	};
 
-		case '5':
-			long_timeout = 1;
-			break;
+	struct dtv_properties cmdseq = {
+		.num = sizeof(p)/sizeof(p[0]),
+		.props = p
+	};
 
-		case 'x':
-			ca_select = strtoul(optarg, NULL, 0);
-			break;
+	/* query for currently tuned parameters */
+	if ((ioctl(frontend_fd, FE_GET_PROPERTY, &cmdseq)) == -1) {
+		perror("FE_GET_PROPERTY failed");
+		return -1;
+	}
+	sc->current_tp = alloc_transponder(p[0].u.data);
+	sc->current_tp->delivery_system = p[1].u.data;
+	sc->current_tp->modulation = p[2].u.data;
+	sc->current_tp->symbol_rate = p[3].u.data;
+	sc->current_tp->fec = p[4].u.data;
+	sc->current_tp->inversion = p[5].u.data;
+	sc->current_tp->rolloff = p[6].u.data;
+	sc->current_tp->stream_id = p[8].u.data & 0xff;
+	sc->current_tp->pls_code = (p[8].u.data >> 8) & 0x3ffff;
+	sc->current_tp->pls_mode = (p[8].u.data >> 26) & 0x3;
+
+	switch(p[6].u.data) 
+	{
+	case 6000000: sc->current_tp->bandwidth = BANDWIDTH_6_MHZ; break;
+	case 7000000: sc->current_tp->bandwidth = BANDWIDTH_7_MHZ; break;
+	case 8000000: sc->current_tp->bandwidth = BANDWIDTH_8_MHZ; break;
+	default:
+	case 0:	sc->current_tp->bandwidth = BANDWIDTH_AUTO; break;
+	}
 
-		case 't':
-			serv_select = strtoul(optarg, NULL, 0);
-			break;
+	/* move TP from "new" to "scanned" list */
+	list_del_init(&sc->current_tp->list);
+	list_add_tail(&sc->current_tp->list, &sc->scanned_transponders);
+	sc->current_tp->scan_done = 1;
 
-		case 'i':
-			spectral_inversion = strtoul(optarg, NULL, 0);
-			break;
+	return 0;
+}
 
-		case 'l':
-			if (lnb_decode(optarg, &lnb_type) < 0) {
-				bad_usage(argv[0], 1);
-				return -1;
-			}
-			break;
+void scans2_config_init(struct scans2_config *cfg)
+{
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->scan_iterations = 10;
+	cfg->atsc_type = 1;
+	cfg->spectral_inversion = INVERSION_AUTO;
+	cfg->lnb_type = *lnb_enum(0);
+	cfg->rotor_conf = "rotor.conf";
+	cfg->lcn_select.bouquet_id = -1;
+	cfg->lcn_select.region = -1;
+}
 
-		case 'v':
-			verbosity++;
-			break;
+struct scans2 *scans2_create(const struct scans2_config *cfg,
+		const struct scans2_callbacks *cb, void *priv)
+{
+	struct scans2 *s = calloc(1, sizeof(*s));
+	int i;
 
-		case 'q':
-			if (--verbosity < 0)
-				verbosity = 0;
-			break;
+	if (!s)
+		return NULL;
+	s->cfg = *cfg;
+	if (cb)
+		s->cb = *cb;
+	s->priv = priv;
+
+	INIT_LIST_HEAD(&s->scanned_transponders);
+	INIT_LIST_HEAD(&s->new_transponders);
+	INIT_LIST_HEAD(&s->running_filters);
+	INIT_LIST_HEAD(&s->waiting_filters);
+	INIT_LIST_HEAD(&s->pmt_filters);
+	for (i = 0; i < MAX_RUNNING; i++)
+		s->poll_fds[i].fd = -1;
+
+	if (cfg->lcn || cfg->channel_numbers)
+		s->lcn = lcn_table_create();
+	s->cable = cable_priors_create(cfg->cable_region);
+	if (cfg->cable_priors && cable_priors_load(s->cable, cfg->cable_priors) < 0 && errno != ENOENT)
+		warning("cannot read '%s': %m\n", cfg->cable_priors);
+	if (cfg->eit && s->cb.eit_event)
+		s->eit = eit_table_create(cfg->eit, s->cb.eit_event, priv);
+
+	snprintf (s->frontend_devname, sizeof(s->frontend_devname),
+		"/dev/dvb/adapter%i/frontend%i", cfg->adapter, cfg->frontend);
+	snprintf (s->demux_devname, sizeof(s->demux_devname),
+		"/dev/dvb/adapter%i/demux%i", cfg->adapter, cfg->demux);
+	return s;
+}
 
-		case 'u':
-			vdr_dump_channum = 1;
-			break;
+int scans2_run(struct scans2 *s, const char *initial)
+{
+	int frontend_fd;
+	int fe_open_mode;
+	int rc = 0;
 
-		case 'P':
-			no_ATSC_PSIP = 1;
-			break;
+	sc = s;
 
-		case 'A':
-			ATSC_type = strtoul(optarg,NULL,0);
-			if (ATSC_type == 0 || ATSC_type > 3) {
-				bad_usage(argv[0], 1);
+	if (sc->cfg.rotor_conf && read_rotor_conf(sc->cfg.rotor_conf) == 0) {
+		if (sc->cfg.rotor_pos_name && strlen(sc->cfg.rotor_pos_name) > 0) {
+			sc->cfg.rotor_pos = rotor_name2nn(sc->cfg.rotor_pos_name);
+			if (sc->cfg.rotor_pos == 0) {
+				error("Rotor position '%s' not found. Check config.\n", sc->cfg.rotor_pos_name);
 				return -1;
 			}
-			break;
-
-		case 'U':
-			unique_anon_services = 1;
-			break;
-
-		default:
-			bad_usage(argv[0], 0);
-			return -1;
-		};
+		}
 	}
 
-	if (use_bouquets && !(output_format == OUTPUT_VDR || output_format == OUTPUT_VDR_16x)) {
-		fprintf(stderr, "Bouquets require a VDR output format.\n");
-		return -1;
-	}
+	info("using '%s' and '%s'\n", sc->frontend_devname, sc->demux_devname);
 
-	if (optind < argc)
-		initial = argv[optind];
-	if ((!initial && !current_tp_only) || (initial && current_tp_only) ||
-		(spectral_inversion > 2)) {
-			bad_usage(argv[0], 0);
-			return -1;
-	}
-
-	lnb_type.low_val *= 1000;	/* convert to kiloherz */
-	lnb_type.high_val *= 1000;	/* convert to kiloherz */
-	lnb_type.switch_val *= 1000;	/* convert to kiloherz */
-	if (switch_pos >= 4) {
-		fprintf (stderr, "switch position needs to be < 4!\n");
-		return -1;
-	}
-	if (uncommitted_switch_pos >= 16) {
-		fprintf (stderr, "uncommitted_switch position needs to be < 16!\n");
+	fe_open_mode = sc->cfg.current_tp_only ? O_RDONLY : O_RDWR;
+	if ((frontend_fd = open (sc->frontend_devname, fe_open_mode | O_NONBLOCK)) < 0) {
+		error("failed to open '%s': %d %m\n", sc->frontend_devname, errno);
 		return -1;
 	}
 
-	if(read_rotor_conf("rotor.conf") == 0) {
-		if (strlen(rotor_pos_name)>0){
-			rotor_pos=rotor_name2nn(rotor_pos_name);
-			if (rotor_pos == 0){
-				fprintf(stderr,"Rotor position '%s' not found. Check config.",rotor_pos_name);
-				return -1;
-			}
-		}
-	}
-
-	if (initial)
-		info("scanning %s\n", initial);
-
-	snprintf (frontend_devname, sizeof(frontend_devname),
-		"/dev/dvb/adapter%i/frontend%i", adapter, frontend);
-
-	snprintf (demux_devname, sizeof(demux_devname),
-		"/dev/dvb/adapter%i/demux%i", adapter, demux);
-	info("using '%s' and '%s'\n", frontend_devname, demux_devname);
-
-	for (i = 0; i < MAX_RUNNING; i++)
-		poll_fds[i].fd = -1;
-
-	fe_open_mode = current_tp_only ? O_RDONLY : O_RDWR;
-	if ((frontend_fd = open (frontend_devname, fe_open_mode | O_NONBLOCK)) < 0)
-		fatal("failed to open '%s': %d %m\n", frontend_devname, errno);
-
-	signal(SIGINT, handle_sigint);
-
-	if (current_tp_only) {
-		struct dtv_property p[] = {
-			{ .cmd = DTV_FREQUENCY },
-			{ .cmd = DTV_DELIVERY_SYSTEM },
-			{ .cmd = DTV_MODULATION },
-			{ .cmd = DTV_SYMBOL_RATE },
-			{ .cmd = DTV_INNER_FEC },
-			{ .cmd = DTV_INVERSION },
-			{ .cmd = DTV_ROLLOFF },
-			{ .cmd = DTV_BANDWIDTH_HZ },
-			{ .cmd = DTV_STREAM_ID },
-		};
-
-		struct dtv_properties cmdseq = {
-			.num = sizeof(p)/sizeof(p[0]),
-			.props = p
-		};
+	if (!sc->cfg.current_tp_only)
+		probe_frontend(frontend_fd);
 
-		/* query for currently tuned parameters */
-		if ((ioctl(frontend_fd, FE_GET_PROPERTY, &cmdseq)) == -1) {
-			perror("FE_GET_PROPERTY failed");
-			return 1;
-		}
-		current_tp = alloc_transponder(p[0].u.data);
-		current_tp->delivery_system = p[1].u.data;
-		current_tp->modulation = p[2].u.data;
-		current_tp->symbol_rate = p[3].u.data;
-		current_tp->fec = p[4].u.data;
-		current_tp->inversion = p[5].u.data;
-		current_tp->rolloff = p[6].u.data;
-		current_tp->stream_id = p[8].u.data & 0xff;
-		current_tp->pls_code = (p[8].u.data >> 8) & 0x3ffff;
-		current_tp->pls_mode = (p[8].u.data >> 26) & 0x3;
-
-		switch(p[6].u.data) 
-		{
-		case 6000000: current_tp->bandwidth = BANDWIDTH_6_MHZ; break;
-		case 7000000: current_tp->bandwidth = BANDWIDTH_7_MHZ; break;
-		case 8000000: current_tp->bandwidth = BANDWIDTH_8_MHZ; break;
-		default:
-		case 0:	current_tp->bandwidth = BANDWIDTH_AUTO; break;
+	if (sc->cfg.current_tp_only) {
+		if (query_current_tp(frontend_fd) < 0)
+			rc = -1;
+		else if (sc->cfg.monitor)
+			monitor_tp();
+		else {
+			scan_tp(frontend_fd);
+			report_services(sc->current_tp);
+			report_progress(1, 1);
 		}
-
-		/* move TP from "new" to "scanned" list */
-		list_del_init(&current_tp->list);
-		list_add_tail(&current_tp->list, &scanned_transponders);
-		current_tp->scan_done = 1;
-
-		scan_tp(frontend_fd);
 	}
 	else
 		scan_network (frontend_fd, initial);
 
 	close (frontend_fd);
 
-	dump_lists ();
-
-	if (bouquets)
-		bouquet_free(bouquets);
+	if (sc->tunes_avoided)
+		info("%d tunes avoided, the frontend can't do them\n", sc->tunes_avoided);
+	if (sc->lcn)
+		lcn_apply(sc->lcn, &sc->scanned_transponders, &sc->cfg.lcn_select);
+	if (sc->cfg.cable_priors && !sc->cfg.current_tp_only &&
+		cable_priors_save(sc->cable, sc->cfg.cable_priors) < 0)
+		warning("cannot write '%s': %m\n", sc->cfg.cable_priors);
 
-	return 0;
+	return rc;
 }
 
-static void dump_dvb_parameters (FILE *f, struct transponder *t)
+struct list_head *scans2_transponders(struct scans2 *s)
 {
-	switch (output_format)
-	{
-	case OUTPUT_VDR:
-	case OUTPUT_VDR_16x:
-	case OUTPUT_M3U:
-		vdr_dump_dvb_parameters(f, t, override_orbital_pos);
-		break;
+	return &s->scanned_transponders;
+}
 
-	case OUTPUT_ZAP:
-		zap_dump_dvb_parameters(f, t, sat_number(t));
-		break;
+static void free_transponders(struct list_head *l)
+{
+	struct list_head *p1, *p2, *n1, *n2;
+	struct transponder *t;
+	struct service *s;
 
-	default:
-		break;
+	list_for_each_safe(p1, n1, l) {
+		t = list_entry(p1, struct transponder, list);
+		list_for_each_safe(p2, n2, &t->services) {
+			s = list_entry(p2, struct service, list);
+			free(s->priv);
+			free_service(s);
+		}
+		free(t->other_f);
+		free(t->attempts);
+		free(t);
 	}
 }
+
+void scans2_free(struct scans2 *s)
+{
+	if (!s)
+		return;
+	sc = s;
+	stop_all_filters();
+	free_transponders(&s->scanned_transponders);
+	free_transponders(&s->new_transponders);
+	lcn_table_free(s->lcn);
+	cable_priors_free(s->cable);
+	eit_table_free(s->eit);
+	sc = NULL;
+	free(s);
+}
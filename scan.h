@@ -46,11 +46,69 @@ extern int verbosity;
 	#define NO_STREAM_ID_FILTER	(~0U)
 #endif
 
+enum pid {
+	PID_PAT			= 0x0000,
+	PID_CAT			= 0x0001,
+	PID_TSDT		= 0x0002,
+	PID_NIT_ST		= 0x0010,
+	PID_SDT_BAT_ST	= 0x0011,
+	PID_EIT_STCIT	= 0x0012,
+	PID_RST_ST		= 0x0013,
+	PID_TDT_TOT_ST	= 0x0014,
+	PID_NET_SYNC	= 0x0015,
+	PID_RNT			= 0x0016,
+	PID_INBAND_SIG	= 0x001C,
+	PID_MEASUREMENT	= 0x001D,
+	PID_DIT			= 0x001E,
+	PID_SIT			= 0x001F,
+};
+
+enum table_id {
+	TID_PAT			= 0x00,		// Program association table
+	TID_CAT			= 0x01,		// Conditional access table
+	TID_PMT			= 0x02,		// Program map table
+	TID_SDT			= 0x03,		// Stream description table
+	// 0x04 .. 0x3F - Reserved
+	TID_NIT_ACTUAL	= 0x40,		// Network information table - actual network
+	TID_NIT_OTHER	= 0x41,		// Network information table - other network
+	TID_SDT_ACTUAL	= 0x42,		// Service description table - actual stream
+	// 0x43 .. 0x45 - Reserved
+	TID_SDT_OTHER	= 0x46,		// Service description table - other stream
+	// 0x47 .. 0x49 - Reserved
+	TID_BAT			= 0x4A,		// Bouquet association table
+	// 0x4B .. 0x4D - Reserved
+	TID_EIT_ACTUAL	= 0x4E,		// Event information table - actual stream - present/following
+	TID_EIT_OTHER	= 0x4F,		// Event information table - other stream - present/following
+	// 0x50 .. 0x5F					// Event information table - actual stream - schedule
+	// 0x60 .. 0x6F					// Event information table - other stream - schedule
+	TID_TDT			= 0x70,		// Time date table
+	TID_RST			= 0x71,		// Running status table
+	TID_ST			= 0x72,		// Stuffing table
+	TID_TOT			= 0x73,		// Time offset table
+	TID_AIT			= 0x74,		// Application information table
+	TID_CT			= 0x75,		// Container table
+	TID_RCT			= 0x76,		// Related content table
+	TID_CIT			= 0x77,		// Content identifier table
+	TID_MPE_FEC		= 0x78,		// MPE-FEC table
+	TID_RNT			= 0x79,		// Resolution notification table
+	// 0x7A .. 0x7D - Reserved
+	TID_DIT			= 0x7E,		// Discountinuity information table
+	TID_SIT			= 0x7F,		// Selection information table
+	// 0x80 .. 0xFE - User defined
+	TID_ATSC_MGT	= 0xC7,
+	TID_ATSC_CVT1	= 0xC8,
+	TID_ATSC_CVT2	= 0xC9,
+	// 0xFF - Reserved
+};
+
 enum format {
 	OUTPUT_ZAP,
 	OUTPUT_VDR,
 	OUTPUT_VDR_16x,
-	OUTPUT_M3U
+	OUTPUT_M3U,
+	OUTPUT_JSON,
+	OUTPUT_NDJSON,
+	OUTPUT_CHANDB
 };
 
 enum running_mode {
@@ -69,9 +127,44 @@ enum polarisation {
 
 
 
-#define AUDIO_CHAN_MAX (32)
-#define CA_SYSTEM_ID_MAX (16)
+enum es_kind {
+	ES_VIDEO,
+	ES_AUDIO,
+	ES_AC3,			/* AC3, E-AC3 and DTS in private data, VDR's Dpids */
+	ES_TELETEXT,
+	ES_SUBTITLING,
+	ES_OTHER
+};
+
+enum es_codec {
+	CODEC_UNKNOWN,
+	CODEC_MPEG2_VIDEO,	/* and MPEG-1 */
+	CODEC_MPEG4_VIDEO,
+	CODEC_H264,
+	CODEC_HEVC,
+	CODEC_MPEG_AUDIO,
+	CODEC_AAC,
+	CODEC_AAC_LATM,
+	CODEC_AC3,
+	CODEC_EAC3,
+	CODEC_DTS
+};
 
+/* an elementary stream from the PMT or the ATSC service location descriptor */
+struct service_es {
+	uint16_t pid;
+	uint8_t stream_type;
+	uint8_t kind;			/* enum es_kind */
+	char lang[4];			/* ISO 639, "" if not signalled */
+	int16_t component_tag;	/* -1 without stream_identifier_descriptor */
+	uint8_t codec;			/* enum es_codec */
+	uint8_t subtype;		/* audio_type, subtitling_type or teletext_type */
+	uint16_t page;			/* subtitling composition page, teletext
+							 * magazine << 8 | page of the first entry */
+};
+
+/* the PIDs up front are the ones the channel lists use, the complete
+ * stream table and the CA system ids are allocated as they are found */
 typedef struct service {
 	struct list_head list;
 	int service_id;
@@ -80,21 +173,32 @@ typedef struct service {
 	uint16_t pmt_pid;
 	uint16_t pcr_pid;
 	uint16_t video_pid;
-	uint16_t audio_pid[AUDIO_CHAN_MAX];
-	char audio_lang[AUDIO_CHAN_MAX][4];
-	int audio_num;
-	uint16_t ca_id[CA_SYSTEM_ID_MAX];
-	int ca_num;
+	uint16_t audio_pid;		/* first audio stream */
 	uint16_t teletext_pid;
 	uint16_t subtitling_pid;
 	uint16_t ac3_pid;
+	uint16_t audio_num;
+	uint16_t es_num;
+	uint16_t es_size;
+	uint16_t ca_num;
+	uint16_t ca_size;
+	struct service_es *es;	/* in PMT order */
+	uint16_t *ca_id;
 	unsigned int type         : 8;
 	unsigned int scrambled	  : 1;
+	unsigned int lcn_hidden	  : 1;	/* channel_num is not for display */
+	unsigned int vct_located  : 1;	/* streams from the ATSC service location descriptor */
 	enum running_mode running;
 	void *priv;
 	int channel_num;
 } service_t;
 
+/* a frequency of a DVB-T TS with other_frequency_flag that didn't lock */
+struct tune_attempt {
+	uint32_t frequency;
+	int level;		/* signal of the carrier probe, -1 for none, 0 if not probed */
+};
+
 typedef struct transponder {
 	struct list_head list;
 	struct list_head services;
@@ -124,9 +228,29 @@ typedef struct transponder {
 	unsigned int scan_done		  : 1;
 	unsigned int last_tuning_failed	  : 1;
 	unsigned int other_frequency_flag : 1;	/* DVB-T */
-	unsigned int wrong_frequency	  : 1;	/* DVB-T with other_frequency_flag */
+	unsigned int stats_valid	  : 1;	/* signal statistics below are set */
+	unsigned int stream_listed	  : 1;	/* stream_id is a PLP (T2/C2) or input stream (S2) of the NIT */
+	unsigned int cable_guess	  : 1;	/* DVB-C symbol rate and QAM from the priors, see cable.h */
 	int n_other_f;
 	uint32_t *other_f;			/* DVB-T freqeuency-list descriptor */
+	int n_attempts;
+	struct tune_attempt *attempts;	/* in the order they were tried */
+	unsigned int signal_strength;	/* percent, read after lock */
+	unsigned int snr;				/* percent */
+	uint32_t ber;
+	uint32_t ucblocks;
+	/* DVBv5 statistics: a *_scale is FE_SCALE_DECIBEL (0.001 dBm or dB),
+	 * FE_SCALE_RELATIVE (0..65535) or 0 if the frontend doesn't report it */
+	int strength_scale;
+	int64_t strength;				/* mean over the samples */
+	int cnr_scale;
+	int64_t cnr;					/* mean over the samples */
+	int64_t cnr_min;
+	uint64_t pre_error_bits;		/* counters of the last sample, */
+	uint64_t pre_total_bits;		/* a total of 0 if not reported */
+	uint64_t error_blocks;
+	uint64_t total_blocks;
+	int stats_samples;
 } transponder_t;
 
 typedef struct rotorslot {
@@ -136,6 +260,9 @@ typedef struct rotorslot {
 	char angle_we[8];		// '19.2E'
 } rotorslot_t;
 
+/* the n-th stream of that kind, NULL if there are fewer */
+extern const struct service_es *service_find_es(const struct service *s, int kind, int n);
+
 float rotor_angle(int nn);
 int rotor_nn(int orbital_pos, int we_flag);
 
@@ -0,0 +1,131 @@
+#ifndef __SCANS2_H__
+#define __SCANS2_H__
+
+/*
+ * libscans2 - the scan engine of scan-s2.
+ *
+ * A scan is described by a struct scans2_config, driven by scans2_run() and
+ * reports through the callbacks. All state lives in the struct scans2
+ * returned by scans2_create(), so independent scans can run concurrently,
+ * one per thread and frontend. The results stay available through
+ * scans2_transponders() until scans2_free().
+ */
+
+#include "scan.h"
+#include "lnb.h"
+#include "lcn.h"
+#include "eit.h"
+
+struct scans2;
+struct bouquet_ctx;
+
+#define SCANS2_MAX_FRONTENDS	8
+
+/* a raster of DVB-C/T/T2 or ATSC channels, scanned instead of or along with
+ * an initial file; see scans2_parse_sweep() */
+struct scans2_sweep {
+	fe_delivery_system_t delivery_system;	/* SYS_UNDEFINED: no sweep */
+	uint32_t start;				/* Hz */
+	uint32_t end;
+	uint32_t step;
+	fe_modulation_t modulation;
+	uint32_t symbol_rate;		/* DVB-C */
+	fe_bandwidth_t bandwidth;	/* DVB-T/T2, from the step */
+};
+
+struct scans2_config {
+	int adapter;
+	int frontend;
+	int demux;
+	int current_tp_only;		/* scan what the frontend is tuned to, no initial file */
+	int get_other_nits;
+	int long_timeout;			/* 5x filter timeouts */
+	int skip_count;				/* skip the first sections of each table */
+	int scan_iterations;
+	int noauto;					/* try each parameter value instead of AUTO */
+	int scan_mplp;				/* every PLP (DVB-T2/C2) and input stream (DVB-S2) of the NIT */
+	int channel_numbers;		/* parse UK Freeview channel numbers */
+	int lcn;					/* collect logical channel numbers of NIT and BAT */
+	struct lcn_select lcn_select;
+	int no_atsc_psip;
+	int atsc_type;				/* 1 terrestrial, 2 cable, 3 both */
+	int atsc_verify_pmt;		/* PMTs also for programs the VCT locates */
+	int disable_s1;
+	int disable_s2;
+	fe_spectral_inversion_t spectral_inversion;
+	struct lnb_types_st lnb_type;	/* frequencies in kHz */
+	int switch_pos;
+	int uncommitted_switch_pos;
+	int rotor_pos;
+	const char *rotor_conf;		/* NULL: no rotor */
+	const char *rotor_pos_name;	/* e.g. "19.2E", looked up in rotor_conf */
+	struct bouquet_ctx *bouquets;	/* parse BATs into this context */
+	int monitor;				/* with current_tp_only: watch for table changes */
+	int eit;					/* EIT_ACTUAL, EIT_OTHER: collect events while tuned */
+	int stats_interval;			/* seconds between signal samples while the tables
+								 * are read, 0: once after the lock */
+	struct scans2_sweep sweep;
+	int carrier_pass;			/* drop DVB-C/T and ATSC channels without a carrier
+								 * before the scan, implied by a sweep */
+	int n_carrier_frontends;	/* more frontends of the adapter for the carrier pass */
+	int carrier_frontends[SCANS2_MAX_FRONTENDS];
+	const char *cable_region;	/* country of the dvb-c/ files whose symbol rates
+								 * and QAMs come first, NULL for none */
+	const char *cable_priors;	/* locks of previous scans, updated afterwards */
+};
+
+/* a table of the tuned transponder, see table_updated */
+struct scans2_table {
+	int pid;
+	int table_id;
+	int table_id_ext;
+	int old_version;			/* -1 for the first complete version */
+	int version;
+	void *user;					/* free for the callback between the phases */
+};
+
+enum scans2_table_phase {
+	SCANS2_TABLE_CHANGING,		/* new version arrives, nothing re-parsed yet */
+	SCANS2_TABLE_UPDATED,		/* new version completely parsed */
+	SCANS2_TABLE_DROPPED		/* not monitored any longer, release table->user */
+};
+
+struct scans2_callbacks {
+	void (*tp_locked)(void *priv, struct transponder *t);
+	// once per service after its transponder was scanned
+	void (*service_found)(void *priv, struct transponder *t, struct service *s);
+	// monitor mode only
+	void (*table_updated)(void *priv, struct transponder *t,
+			struct scans2_table *table, enum scans2_table_phase phase);
+	// transponders done out of those known so far
+	void (*progress)(void *priv, int done, int total);
+	// each new event or new version of one, with cfg.eit
+	void (*eit_event)(void *priv, const struct eit_event *ev);
+	// called about once a second, a non-zero return ends scans2_run()
+	int (*idle)(void *priv);
+	// prints transponder parameters in log messages, optional
+	void (*dump_dvb_parameters)(FILE *f, struct transponder *t);
+};
+
+extern void scans2_config_init(struct scans2_config *cfg);
+
+extern struct scans2 *scans2_create(const struct scans2_config *cfg,
+		const struct scans2_callbacks *cb, void *priv);
+extern void scans2_free(struct scans2 *sc);
+
+// initial is the tuning data file, NULL with current_tp_only; returns 0 or -1
+extern int scans2_run(struct scans2 *sc, const char *initial);
+
+// struct transponder list of everything scanned so far
+extern struct list_head *scans2_transponders(struct scans2 *sc);
+
+// SYS:START-END:STEP[:MODULATION[:SYMBOL_RATE]] with SYS one of T, T2, C or A
+// and frequencies in Hz; returns 0 or -1
+extern int scans2_parse_sweep(struct scans2_sweep *w, const char *spec);
+
+// the transponders that locked as an initial tuning file
+extern void scans2_write_initial(struct scans2 *sc, FILE *f);
+
+extern char *dvbtext2utf8(char* dvbtext, int dvbtextlen);
+
+#endif